@@ -148,6 +148,19 @@ extern "C" {
         You can then call FLValue_FromData (in kFLTrusted mode) to get the root as a Value. */
     FLSliceResult FLData_ConvertJSON(FLSlice json, FLError *outError);
 
+    /** Converts "JSON Lines" (aka NDJSON) data, i.e. one JSON value per line, to Fleece-encoded
+        data whose root is an array with one item per non-blank line. The lines are converted in
+        parallel.
+        @param jsonLines  The input data.
+        @param sharedKeys  SharedKeys to encode dictionary keys with, or NULL.
+        @param maxThreads  The maximum number of threads to use, or 0 for one per CPU core.
+        @param outError  On failure, the error code will be stored here.
+        @return  The encoded data, or a null slice if any line is invalid. */
+    FLSliceResult FLData_ConvertJSONLines(FLSlice jsonLines,
+                                          FLSharedKeys sharedKeys,
+                                          unsigned maxThreads,
+                                          FLError *outError);
+
     /** Produces a human-readable dump of the Value encoded in the data.
         This is only useful if you already know, or want to learn, the encoding format. */
     FLStringResult FLData_Dump(FLSlice data);
@@ -173,6 +186,28 @@ extern "C" {
                                   bool json5,
                                   bool canonicalForm);
 
+    /** Callback that receives JSON output from \ref FLValue_WriteJSON, one chunk at a time.
+        Return false to abort the conversion. */
+    typedef bool (*FLJSONOutputCallback)(void *context, FLSlice chunk);
+
+    /** Encodes a Fleece value as JSON, passing the output to a callback in chunks as it's
+        generated, instead of returning it all at once. This keeps memory use bounded when
+        converting very large values.
+        @return  True on success, false if the callback aborted or an error occurred. */
+    bool FLValue_WriteJSON(FLValue v,
+                           bool json5,
+                           bool canonicalForm,
+                           FLJSONOutputCallback FLNONNULL callback,
+                           void *context,
+                           FLError *outError);
+
+    /** Encodes a Fleece value as JSON, writing it to a file as it's generated. */
+    bool FLValue_WriteJSONToFile(FLValue v,
+                                 bool json5,
+                                 bool canonicalForm,
+                                 FILE* FLNONNULL file,
+                                 FLError *outError);
+
     /** Converts valid JSON5 <https://json5.org> to JSON. Among other things, it converts single
         quotes to double, adds missing quotes around dictionary keys, removes trailing commas,
         and removes comments.
@@ -377,6 +412,26 @@ extern "C" {
     /** Returns an value at an array index, or NULL if the index is out of range. */
     FLValue FLArray_Get(FLArray, uint32_t index);
 
+    /** Copies a range of an array's items into a C array of doubles, converting them as by
+        FLValue_AsDouble. This is much faster than getting each item individually.
+        @param a  The array (may be NULL.)
+        @param start  The index of the first item to copy.
+        @param count  The maximum number of items to copy.
+        @param out  The destination, with room for `count` doubles.
+        @return  The number of items copied; less than `count` if the range extends past the
+                 end of the array. */
+    uint32_t FLArray_CopyDoubles(FLArray a, uint32_t start, uint32_t count, double out[]);
+
+    /** Copies a range of an array's items into a C array of integers, converting them as by
+        FLValue_AsInt. (See FLArray_CopyDoubles for details.) */
+    uint32_t FLArray_CopyInts(FLArray a, uint32_t start, uint32_t count, int64_t out[]);
+
+    /** Copies a range of an array's items into a C array of strings, converting them as by
+        FLValue_AsString, i.e. items that aren't strings become kFLSliceNull. The strings point
+        into the Fleece data, so they're only valid as long as it is.
+        (See FLArray_CopyDoubles for details.) */
+    uint32_t FLArray_CopyStrings(FLArray a, uint32_t start, uint32_t count, FLString out[]);
+
     extern const FLArray kFLEmptyArray;
 
     /** \name Array iteration
@@ -618,6 +673,17 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
         be stored inside the FLDictKey that will speed up subsequent lookups. */
     FLValue FLDict_GetWithKey(FLDict, FLDictKey* FLNONNULL);
 
+    /** Looks up several keys in a dictionary at once, storing each key's value (or NULL) in the
+        corresponding item of the `values` array. This is faster than calling FLDict_GetWithKey
+        for each key, especially if the keys are in the same order as the dictionary's.
+        As with FLDict_GetWithKey, "hint" data is stored in the FLDictKeys.
+        @param d  The dictionary (may be NULL.)
+        @param keys  An array of `count` initialized FLDictKeys.
+        @param count  The number of keys.
+        @param values  An array with room for `count` values.
+        @return  The number of keys that were found. */
+    size_t FLDict_GetMany(FLDict d, FLDictKey keys[], size_t count, FLValue values[]);
+
 
     //////// MUTABLE DICT
 
@@ -758,6 +824,10 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
 
      A '\' can be used to escape a special character ('.', '[' or '$') at the start of a
      property name (but not yet in the middle of a name.)
+
+     The JSONPath wildcard `[*]`, recursive descent `..name`, slices `[a:b]` and filters
+     `[?(@.age > 30)]` are also supported; a path using them can match more than one value, and
+     FLKeyPath_Eval returns the first match.
      */
 
 #ifndef FL_IMPL
@@ -1088,6 +1158,74 @@ while (NULL != (value = FLDictIterator_GetValue(&iter))) {
                                    FLSlice jsonDelta,
                                    FLEncoder encoder);
 
+    /** Combines two JSON deltas into one that has the same effect as applying `jsonDelta1` and
+        then `jsonDelta2`. Where possible the changes are merged (e.g. changes to different keys
+        of a dict, or two edits of a string); otherwise the result applies them in turn.
+        @param jsonDelta1  A JSON-encoded delta created by `FLCreateJSONDelta`.
+        @param jsonDelta2  A JSON-encoded delta to apply to the result of `jsonDelta1`.
+        @param error  On failure, error information will be stored where this points, if non-null.
+        @return  The composed JSON delta, or null on error. */
+    FLSliceResult FLComposeJSONDeltas(FLSlice jsonDelta1,
+                                      FLSlice jsonDelta2,
+                                      FLError *error);
+
+    /** Applies a chain of JSON deltas to the value `old`, each one to the result of the previous,
+        and returns a Fleece document equal to the final value. The deltas are composed first,
+        so `old` is only traversed and re-encoded once.
+        @param old  A value that's typically the old/original state of some data. This must be
+                    equal to the `old` value used when creating the first delta.
+        @param jsonDeltas  An array of JSON-encoded deltas, in the order they were created.
+        @param count  The number of deltas in the array.
+        @param error  On failure, error information will be stored where this points, if non-null.
+        @return  The corresponding Fleece document, or null on error. */
+    FLSliceResult FLApplyJSONDeltaChain(FLValue old,
+                                        const FLSlice jsonDeltas[],
+                                        size_t count,
+                                        FLError *error);
+
+
+    /** Returns a binary delta that encodes the changes to turn the value `old` into `nuu`.
+        This is like `FLCreateJSONDelta`, except that the delta is itself encoded as Fleece, so
+        creating and applying it is faster since no JSON has to be generated or parsed.
+        (The format is documented in Deltas.md, but you should treat it as a black box.)
+        @param old  A value that's typically the old/original state of some data.
+        @param nuu  A value that's typically the new/changed state of the `old` data.
+        @return  Fleece data representing the changes from `old` to `nuu`, or NULL on
+                    (extremely unlikely) failure. */
+    FLSliceResult FLCreateFleeceDelta(FLValue old, FLValue nuu);
+
+    /** Writes a binary delta that describes the changes to turn the value `old` into `nuu`.
+        @param old  A value that's typically the old/original state of some data.
+        @param nuu  A value that's typically the new/changed state of the `old` data.
+        @param encoder  A Fleece encoder to write the delta to. (JSON encoding is not supported.)
+        @return  True on success, false on error; call `FLEncoder_GetError` for details. */
+    bool FLEncodeFleeceDelta(FLValue old, FLValue nuu, FLEncoder FLNONNULL encoder);
+
+    /** Applies the binary delta created by `FLCreateFleeceDelta` to the value `old`, which must be
+        equal to the `old` value originally passed to `FLCreateFleeceDelta`, and returns a Fleece
+        document equal to the original `nuu` value.
+        @param old  A value that's typically the old/original state of some data. This must be
+                    equal to the `old` value used when creating the delta.
+        @param fleeceDelta  A delta created by `FLCreateFleeceDelta` or `FLEncodeFleeceDelta`.
+        @param error  On failure, error information will be stored where this points, if non-null.
+        @return  The corresponding `nuu` value, encoded as Fleece, or null if an error occurred. */
+    FLSliceResult FLApplyFleeceDelta(FLValue old,
+                                     FLSlice fleeceDelta,
+                                     FLError *error);
+
+    /** Applies a binary delta, already parsed as a Fleece value, to the value `old`, and writes
+        the corresponding `nuu` value to the encoder.
+        @param old  A value that's typically the old/original state of some data. This must be
+                    equal to the `old` value used when creating the delta.
+        @param delta  The root value of a delta created by `FLCreateFleeceDelta` or
+                    `FLEncodeFleeceDelta`.
+        @param encoder  A Fleece encoder to write the decoded `nuu` value to. (JSON encoding is not
+                    supported.)
+        @return  True on success, false on error; call `FLEncoder_GetError` for details. */
+    bool FLEncodeApplyingFleeceDelta(FLValue old,
+                                     FLValue delta,
+                                     FLEncoder encoder);
+
     
     /** @} */
 
@@ -547,6 +547,30 @@ namespace fleece {
         static inline bool apply(Value old,
                                  slice jsonDelta,
                                  Encoder &encoder);
+
+        static inline alloc_slice compose(slice jsonDelta1,
+                                          slice jsonDelta2,
+                                          FLError *error);
+        static inline alloc_slice applyChain(Value old,
+                                             const FLSlice jsonDeltas[],
+                                             size_t count,
+                                             FLError *error);
+    };
+
+
+    /** Support for generating and applying binary (Fleece-format) deltas between two Fleece
+        values. */
+    class FleeceDelta {
+    public:
+        static inline alloc_slice create(Value old, Value nuu);
+        static inline bool create(Value old, Value nuu, Encoder &encoder);
+
+        static inline alloc_slice apply(Value old,
+                                        slice fleeceDelta,
+                                        FLError *error);
+        static inline bool apply(Value old,
+                                 Value delta,
+                                 Encoder &encoder);
     };
 
 
@@ -682,6 +706,29 @@ namespace fleece {
                                  Encoder &encoder) {
         return FLEncodeApplyingJSONDelta(old, jsonDelta, encoder);
     }
+    inline alloc_slice JSONDelta::compose(slice jsonDelta1, slice jsonDelta2, FLError *error) {
+        return FLComposeJSONDeltas(jsonDelta1, jsonDelta2, error);
+    }
+    inline alloc_slice JSONDelta::applyChain(Value old, const FLSlice jsonDeltas[], size_t count,
+                                             FLError *error)
+    {
+        return FLApplyJSONDeltaChain(old, jsonDeltas, count, error);
+    }
+
+    inline alloc_slice FleeceDelta::create(Value old, Value nuu) {
+        return FLCreateFleeceDelta(old, nuu);
+    }
+    inline bool FleeceDelta::create(Value old, Value nuu, Encoder &encoder) {
+        return FLEncodeFleeceDelta(old, nuu, encoder);
+    }
+    inline alloc_slice FleeceDelta::apply(Value old, slice fleeceDelta, FLError *error) {
+        return FLApplyFleeceDelta(old, fleeceDelta, error);
+    }
+    inline bool FleeceDelta::apply(Value old,
+                                   Value delta,
+                                   Encoder &encoder) {
+        return FLEncodeApplyingFleeceDelta(old, delta, encoder);
+    }
 
     inline SharedKeys& SharedKeys::operator= (const SharedKeys &other) {
         auto sk = FLSharedKeys_Retain(other._sk);
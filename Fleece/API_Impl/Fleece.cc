@@ -20,6 +20,8 @@
 #include "MutableArray.hh"
 #include "MutableDict.hh"
 #include "JSONDelta.hh"
+#include "FleeceDelta.hh"
+#include "JSONLinesConverter.hh"
 #include "fleece/Fleece.h"
 #include "JSON5.hh"
 #include "betterassert.hh"
@@ -131,6 +133,45 @@ FLSliceResult FLValue_ToJSON(FLValue v)      {return FLValue_ToJSONX(v, false, f
 FLSliceResult FLValue_ToJSON5(FLValue v)     {return FLValue_ToJSONX(v, true,  false);}
 
 
+bool FLValue_WriteJSON(FLValue v,
+                       bool json5,
+                       bool canonical,
+                       FLJSONOutputCallback callback,
+                       void *context,
+                       FLError *outError)
+{
+    try {
+        JSONEncoder encoder(Writer::OutputCallback([=](slice chunk) {
+            if (!callback(context, chunk))
+                FleeceException::_throw(EncodeError, "JSON output callback aborted");
+        }));
+        encoder.setJSON5(json5);
+        encoder.setCanonical(canonical);
+        encoder.writeValue(v);
+        encoder.finish();
+        return true;
+    } catchError(outError)
+    return false;
+}
+
+bool FLValue_WriteJSONToFile(FLValue v,
+                             bool json5,
+                             bool canonical,
+                             FILE *file,
+                             FLError *outError)
+{
+    try {
+        JSONEncoder encoder(file);
+        encoder.setJSON5(json5);
+        encoder.setCanonical(canonical);
+        encoder.writeValue(v);
+        encoder.finish();
+        return true;
+    } catchError(outError)
+    return false;
+}
+
+
 FLSliceResult FLData_ConvertJSON(FLSlice json, FLError *outError) {
     FLEncoderImpl e(kFLEncodeFleece, json.size);
     FLEncoder_ConvertJSON(&e, json);
@@ -138,14 +179,25 @@ FLSliceResult FLData_ConvertJSON(FLSlice json, FLError *outError) {
 }
 
 
+FLSliceResult FLData_ConvertJSONLines(FLSlice jsonLines, FLSharedKeys sk, unsigned maxThreads,
+                                      FLError *outError)
+{
+    try {
+        return toSliceResult(JSONLinesConverter(sk, maxThreads).convertToArray(jsonLines));
+    } catchError(outError)
+    return {nullptr, 0};
+}
+
+
 FLStringResult FLJSON5_ToJSON(FLString json5,
                               FLStringResult *outErrorMessage, size_t *outErrorPos,
                               FLError *error) {
     alloc_slice errorMessage;
     size_t errorPos = 0;
     try {
-        std::string json = ConvertJSON5((std::string((char*)json5.buf, json5.size)));
-        return toSliceResult(alloc_slice(json));
+        JSONEncoder encoder(json5.size);
+        ConvertJSON5(json5, encoder);
+        return toSliceResult(encoder.finish());
     } catch (const json5_error &x) {
         errorMessage = alloc_slice(x.what());
         errorPos = x.inputPos;
@@ -178,6 +230,19 @@ uint32_t FLArray_Count(FLArray a)                    {return a ? a->count() : 0;
 bool FLArray_IsEmpty(FLArray a)                      {return a ? a->empty() : true;}
 FLValue FLArray_Get(FLArray a, uint32_t index)       {return a ? a->get(index) : nullptr;}
 
+uint32_t FLArray_CopyDoubles(FLArray a, uint32_t start, uint32_t count, double out[]) {
+    return a ? a->copyTo(out, count, start) : 0;
+}
+
+uint32_t FLArray_CopyInts(FLArray a, uint32_t start, uint32_t count, int64_t out[]) {
+    return a ? a->copyTo(out, count, start) : 0;
+}
+
+uint32_t FLArray_CopyStrings(FLArray a, uint32_t start, uint32_t count, FLString out[]) {
+    static_assert(sizeof(FLString) == sizeof(slice), "FLString array stride must match");
+    return a ? a->copyTo((slice*)out, count, start) : 0;
+}
+
 void FLArrayIterator_Begin(FLArray a, FLArrayIterator* i) {
     static_assert(sizeof(FLArrayIterator) >= sizeof(Array::iterator),"FLArrayIterator is too small");
     new (i) Array::iterator(a);
@@ -345,6 +410,16 @@ FLValue FLDict_GetWithKey(FLDict d, FLDictKey *k) {
     return d->get(key);
 }
 
+size_t FLDict_GetMany(FLDict d, FLDictKey keys[], size_t count, FLValue values[]) {
+    static_assert(sizeof(FLDictKey) == sizeof(Dict::key), "FLDictKey array stride must match");
+    if (!d) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = nullptr;
+        return 0;
+    }
+    return d->getMany((Dict::key*)keys, count, values);
+}
+
 
 static FLMutableDict _newMutableDict(FLDict d, FLCopyFlags flags) noexcept {
     try {
@@ -470,7 +545,10 @@ void FLKeyPath_Free(FLKeyPath path) {
 }
 
 FLValue FLKeyPath_Eval(FLKeyPath path, FLValue root) {
-    return path->eval(root);
+    try {
+        return path->eval(root);
+    } catchError(nullptr)
+    return nullptr;
 }
 
 FLValue FLKeyPath_EvalOnce(FLSlice specifier, FLValue root, FLError *outError)
@@ -717,3 +795,64 @@ bool FLEncodeApplyingJSONDelta(FLValue old, FLSlice jsonDelta, FLEncoder encoder
         return false;
     }
 }
+
+FLSliceResult FLComposeJSONDeltas(FLSlice jsonDelta1, FLSlice jsonDelta2, FLError *outError) {
+    try {
+        return toSliceResult(JSONDelta::compose(jsonDelta1, jsonDelta2));
+    } catchError(outError);
+    return {};
+}
+
+FLSliceResult FLApplyJSONDeltaChain(FLValue old, const FLSlice jsonDeltas[], size_t count,
+                                    FLError *outError)
+{
+    try {
+        return toSliceResult(JSONDelta::applyChain(old, std::vector<slice>(jsonDeltas,
+                                                                           jsonDeltas + count)));
+    } catchError(outError);
+    return {};
+}
+
+
+FLSliceResult FLCreateFleeceDelta(FLValue old, FLValue nuu) {
+    try {
+        return toSliceResult(FleeceDelta::create(old, nuu));
+    } catch (const std::exception &x) {
+        return {};
+    }
+}
+
+bool FLEncodeFleeceDelta(FLValue old, FLValue nuu, FLEncoder encoder) {
+    try {
+        Encoder *enc = encoder->fleeceEncoder.get();
+        if (!enc)
+            FleeceException::_throw(EncodeError, "FLEncodeFleeceDelta cannot encode JSON");
+        FleeceDelta::create(old, nuu, *enc);
+        return true;
+    } catch (const std::exception &x) {
+        encoder->recordException(x);
+        return false;
+    }
+}
+
+
+FLSliceResult FLApplyFleeceDelta(FLValue old, FLSlice fleeceDelta, FLError *outError) {
+    try {
+        return toSliceResult(FleeceDelta::apply(old, fleeceDelta));
+    } catchError(outError);
+    return {};
+}
+
+bool FLEncodeApplyingFleeceDelta(FLValue old, FLValue delta, FLEncoder encoder) {
+    try {
+        Encoder *enc = encoder->fleeceEncoder.get();
+        if (!enc)
+            FleeceException::_throw(EncodeError, "FLEncodeApplyingFleeceDelta cannot encode JSON");
+        throwIf(!delta, InvalidData, "Missing delta");
+        FleeceDelta::apply(old, delta, *enc);
+        return true;
+    } catch (const std::exception &x) {
+        encoder->recordException(x);
+        return false;
+    }
+}
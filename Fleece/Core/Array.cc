@@ -19,9 +19,14 @@
 #include "Array.hh"
 #include "MutableArray.hh"
 #include "HeapDict.hh"
+#include "Encoder.hh"
+#include "Doc.hh"
 #include "Internal.hh"
 #include "PlatformCompat.hh"
+#include "SIMD.hh"
 #include "varint.hh"
+#include "NumConversion.hh"
+#include <algorithm>
 
 
 namespace fleece { namespace impl {
@@ -37,6 +42,14 @@ namespace fleece { namespace impl {
             _width = kNarrow;
             _count = 0;
         } else if (_usuallyTrue(!v->isMutable())) {
+            if (_usuallyFalse(v->isTypedArray())) {
+                // Typed array: its items are accessed through an equivalent regular Array, which
+                // the containing Scope creates on demand.
+                auto items = Scope::typedArrayItems((const Array*)v);
+                assert(items);      // a typed array's items can't be Values outside a Scope
+                *this = impl(items);
+                return;
+            }
             // Normal immutable case:
             _first = (const Value*)(&v->_byte[2]);
             _width = v->isWideArray() ? kWide : kNarrow;
@@ -108,12 +121,20 @@ namespace fleece { namespace impl {
     uint32_t Array::count() const noexcept {
         if (_usuallyFalse(isMutable()))
             return heapArray()->count();
+        if (_usuallyFalse(isTypedArray())) {
+            typedArrayType type;
+            uint32_t count;
+            const uint8_t *items;
+            return getTypedArray(type, count, items) ? count : 0;
+        }
         return impl(this)._count;
     }
 
     bool Array::empty() const noexcept {
         if (_usuallyFalse(isMutable()))
             return heapArray()->empty();
+        if (_usuallyFalse(isTypedArray()))
+            return count() == 0;
         return countIsZero();
     }
 
@@ -135,6 +156,312 @@ namespace fleece { namespace impl {
     const Array* const Array::kEmpty = &kEmptyArrayInstance;
 
 
+#pragma mark - BULK COPYING:
+
+
+    // Decodes a short int item (which must have a tag of 0.)
+    static inline int16_t decodeShortInt(const uint8_t *item) noexcept {
+        return int16_t(uint16_t(((item[0] << 8) | item[1]) << 4)) >> 4;  // sign-extend 12 bits
+    }
+
+#if FL_SIMD
+    // Decodes 8 consecutive narrow items that are all short ints into `out`. Returns false if
+    // any of them isn't a short int, in which case `out` is left in an undefined state.
+    static inline bool decodeNarrowShortInts(const uint8_t *items, int16_t out[8]) noexcept {
+#if FL_SIMD_SSE2
+        __m128i v = _mm_loadu_si128((const __m128i*)items);
+        // Each item's tag is in the high nibble of its first byte, i.e. of its lane's low byte:
+        __m128i tags = _mm_and_si128(v, _mm_set1_epi16(0x00F0));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(tags, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));  // big-endian to native
+        v = _mm_srai_epi16(_mm_slli_epi16(v, 4), 4);                    // sign-extend 12 bits
+        _mm_storeu_si128((__m128i*)out, v);
+#elif FL_SIMD_NEON
+        uint16x8_t v = vld1q_u16((const uint16_t*)items);
+        uint16x8_t tags = vandq_u16(v, vdupq_n_u16(0x00F0));
+        uint16x4_t anyTags = vorr_u16(vget_low_u16(tags), vget_high_u16(tags));
+        if (vget_lane_u64(vreinterpret_u64_u16(anyTags), 0) != 0)
+            return false;
+        int16x8_t n = vreinterpretq_s16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+        n = vshrq_n_s16(vshlq_n_s16(n, 4), 4);
+        vst1q_s16(out, n);
+#endif
+        return true;
+    }
+#endif
+
+    // Conversions from items to the types supported by Array::copyTo:
+    template <class T> struct itemConverter;
+
+    template <> struct itemConverter<double> {
+        static constexpr bool kFromShortInts = true;
+        static double fromShortInt(int16_t i)           {return i;}
+        static double fromValue(const Value *v)         {return v->asDouble();}
+    };
+
+    template <> struct itemConverter<int64_t> {
+        static constexpr bool kFromShortInts = true;
+        static int64_t fromShortInt(int16_t i)          {return i;}
+        static int64_t fromValue(const Value *v)        {return v->asInt();}
+    };
+
+    template <> struct itemConverter<slice> {
+        static constexpr bool kFromShortInts = false;
+        static slice fromShortInt(int16_t)              {return nullslice;}
+        static slice fromValue(const Value *v)          {return v->asString();}
+    };
+
+
+    template <class T>
+    uint32_t Array::_copyTo(T *out, uint32_t count, uint32_t start) const noexcept {
+        using convert = itemConverter<T>;
+        if (_usuallyFalse(isTypedArray()))
+            return copyTypedTo(out, count, start);
+        impl a(this);
+        if (_usuallyFalse(start >= a._count))
+            return 0;
+        count = std::min(count, a._count - start);
+        if (_usuallyFalse(a.isMutableArray())) {
+            for (uint32_t i = 0; i < count; ++i)
+                out[i] = convert::fromValue(a[start + i]);
+            return count;
+        }
+
+        // Inline short ints are decoded directly; anything else is dereferenced and converted:
+        auto item = (const uint8_t*)a._first + start * a._width;
+        auto convertItem = [](const uint8_t *item, bool wide) -> T {
+            if (convert::kFromShortInts && item[0] < 0x10)
+                return convert::fromShortInt(decodeShortInt(item));
+            auto v = (const Value*)item;
+            return convert::fromValue(wide ? v->deref<true>() : v->deref<false>());
+        };
+        uint32_t i = 0;
+        if (a._width == kNarrow) {
+#if FL_SIMD
+            if (convert::kFromShortInts) {
+                int16_t ints[8];
+                for (; i + 8 <= count; i += 8, item += 8 * kNarrow) {
+                    if (_usuallyTrue(decodeNarrowShortInts(item, ints))) {
+                        for (unsigned j = 0; j < 8; ++j)
+                            out[i + j] = convert::fromShortInt(ints[j]);
+                    } else {
+                        for (unsigned j = 0; j < 8; ++j)
+                            out[i + j] = convertItem(item + j * kNarrow, false);
+                    }
+                }
+            }
+#endif
+            for (; i < count; ++i, item += kNarrow)
+                out[i] = convertItem(item, false);
+        } else {
+            for (; i < count; ++i, item += kWide)
+                out[i] = convertItem(item, true);
+        }
+        return count;
+    }
+
+    uint32_t Array::copyTo(double *out, uint32_t count, uint32_t start) const noexcept {
+        return _copyTo(out, count, start);
+    }
+
+    uint32_t Array::copyTo(int64_t *out, uint32_t count, uint32_t start) const noexcept {
+        return _copyTo(out, count, start);
+    }
+
+    uint32_t Array::copyTo(slice *out, uint32_t count, uint32_t start) const noexcept {
+        return _copyTo(out, count, start);
+    }
+
+
+#pragma mark - TYPED ARRAYS:
+
+
+    // Parses the header of a typed array. Returns false if this isn't one, or it's invalid.
+    bool Array::getTypedArray(typedArrayType &type, uint32_t &count,
+                              const uint8_t* &items) const noexcept
+    {
+        if (_usuallyFalse(isMutable() || !isTypedArray()))
+            return false;
+        auto header = (const uint8_t*)this;
+        type = (typedArrayType)header[kTypedArrayHeaderSize];
+        uint8_t itemsOffset = header[kTypedArrayHeaderSize + 1];
+        size_t countSize = GetUVarInt32(slice(&header[kTypedArrayHeaderSize + 2], kMaxVarintLen32),
+                                        &count);
+        if (_usuallyFalse(type >= kNumTypedArrayTypes || countSize == 0
+                                || kTypedArrayHeaderSize + 2 + countSize > itemsOffset))
+            return false;
+        items = header + itemsOffset;
+        return true;
+    }
+
+    // The size of a typed array including its items, or 0 if its header is invalid.
+    size_t Array::typedArrayDataSize() const noexcept {
+        typedArrayType type;
+        uint32_t count;
+        const uint8_t *items;
+        if (_usuallyFalse(!getTypedArray(type, count, items)))
+            return 0;
+        return (items - (const uint8_t*)this) + count * typedArrayItemSize(type);
+    }
+
+    // Reads a little-endian item of a typed array.
+    template <class ITEM>
+    static inline ITEM readTypedItem(const uint8_t *src) noexcept {
+        ITEM item;
+#ifdef _LITTLE_ENDIAN
+        memcpy(&item, src, sizeof(ITEM));
+#else
+        uint8_t bytes[sizeof(ITEM)];
+        std::reverse_copy(src, src + sizeof(ITEM), bytes);
+        memcpy(&item, bytes, sizeof(ITEM));
+#endif
+        return item;
+    }
+
+    // Converts a typed array item the same way `asDouble`/`asInt` convert a Value:
+    template <class ITEM>
+    static inline double convertTypedItem(ITEM item, double*) noexcept  {return double(item);}
+    template <class ITEM>
+    static inline int64_t convertTypedItem(ITEM item, int64_t*) noexcept {return int64_t(item);}
+    static inline int64_t convertTypedItem(float item, int64_t*) noexcept {return SaturatingInt64(item);}
+    static inline int64_t convertTypedItem(double item, int64_t*) noexcept {return SaturatingInt64(item);}
+
+    template <class ITEM, class T>
+    static void readTypedItems(const uint8_t *src, T *out, uint32_t count) noexcept {
+        for (uint32_t i = 0; i < count; ++i, src += sizeof(ITEM))
+            out[i] = convertTypedItem(readTypedItem<ITEM>(src), out);
+    }
+
+    template <class ITEM>
+    static void readTypedItems(const uint8_t*, slice *out, uint32_t count) noexcept {
+        std::fill(&out[0], &out[count], nullslice);    // numbers aren't strings
+    }
+
+    template <class T>
+    uint32_t Array::copyTypedTo(T *out, uint32_t count, uint32_t start) const noexcept {
+        typedArrayType type;
+        uint32_t itemCount;
+        const uint8_t *items;
+        if (_usuallyFalse(!getTypedArray(type, itemCount, items) || start >= itemCount))
+            return 0;
+        count = std::min(count, itemCount - start);
+        items += start * typedArrayItemSize(type);
+        switch (type) {
+            case kTypedInt8:    readTypedItems<int8_t> (items, out, count); break;
+            case kTypedInt16:   readTypedItems<int16_t>(items, out, count); break;
+            case kTypedInt32:   readTypedItems<int32_t>(items, out, count); break;
+            case kTypedInt64:   readTypedItems<int64_t>(items, out, count); break;
+            case kTypedFloat32: readTypedItems<float>  (items, out, count); break;
+            case kTypedFloat64: readTypedItems<double> (items, out, count); break;
+            default:            return 0;
+        }
+        return count;
+    }
+
+    // Encodes the items of a typed array as a regular Fleece array.
+    alloc_slice Array::encodeTypedArrayItems() const {
+        typedArrayType type;
+        uint32_t count;
+        const uint8_t *items;
+        if (!getTypedArray(type, count, items))
+            return alloc_slice();
+        Encoder enc;
+        enc.beginArray(count);
+        auto itemSize = typedArrayItemSize(type);
+        for (uint32_t i = 0; i < count; ++i, items += itemSize) {
+            switch (type) {
+                case kTypedInt8:    enc.writeInt(readTypedItem<int8_t>(items)); break;
+                case kTypedInt16:   enc.writeInt(readTypedItem<int16_t>(items)); break;
+                case kTypedInt32:   enc.writeInt(readTypedItem<int32_t>(items)); break;
+                case kTypedInt64:   enc.writeInt(readTypedItem<int64_t>(items)); break;
+                case kTypedFloat32: enc.writeFloat(readTypedItem<float>(items)); break;
+                case kTypedFloat64: enc.writeDouble(readTypedItem<double>(items)); break;
+                default:            break;
+            }
+        }
+        enc.endArray();
+        return enc.finish();
+    }
+
+    static void decodeFloat(float f, uint8_t *out) noexcept {
+        littleEndianFloat swapped = f;
+        out[0] = uint8_t(kFloatTag << 4);
+        out[1] = 0;
+        memcpy(&out[2], &swapped, sizeof(swapped));
+    }
+
+    static void decodeDouble(double d, uint8_t *out) noexcept {
+        littleEndianDouble swapped = d;
+        out[0] = uint8_t(kFloatTag << 4) | 0x08;
+        out[1] = 0;
+        memcpy(&out[2], &swapped, sizeof(swapped));
+    }
+
+    static void decodeInt(int64_t i, uint8_t *out) noexcept {
+        if (i < 2048 && i >= -2048) {
+            out[0] = uint8_t(kShortIntTag << 4) | ((i >> 8) & 0x0F);
+            out[1] = uint8_t(i & 0xFF);
+        } else {
+            auto size = PutIntOfLength(&out[1], i);
+            out[0] = uint8_t(kIntTag << 4) | uint8_t(size - 1);
+        }
+    }
+
+    // Decodes a typed array item into `out` as the scalar Value that `Encoder` would write for
+    // it (so an integral float becomes an int, as in the regular Array `Scope` creates.)
+    static void decodeTypedItem(typedArrayType type, const uint8_t *item, uint8_t *out) noexcept {
+        switch (type) {
+            case kTypedInt8:    return decodeInt(readTypedItem<int8_t>(item), out);
+            case kTypedInt16:   return decodeInt(readTypedItem<int16_t>(item), out);
+            case kTypedInt32:   return decodeInt(readTypedItem<int32_t>(item), out);
+            case kTypedInt64:   return decodeInt(readTypedItem<int64_t>(item), out);
+            case kTypedFloat32: {
+                float f = readTypedItem<float>(item);
+                if (Encoder::isIntRepresentable(f))
+                    return decodeInt((int32_t)f, out);
+                return decodeFloat(f, out);
+            }
+            default: {
+                double d = readTypedItem<double>(item);
+                if (Encoder::isIntRepresentable(d))
+                    return decodeInt(SaturatingInt64(d), out);
+                else if (Encoder::isFloatRepresentable(d))
+                    return decodeFloat((float)d, out);
+                return decodeDouble(d, out);
+            }
+        }
+    }
+
+    template <class T> struct typedArrayTypeOf;
+    template <> struct typedArrayTypeOf<int8_t>  {static constexpr typedArrayType value = kTypedInt8;};
+    template <> struct typedArrayTypeOf<int16_t> {static constexpr typedArrayType value = kTypedInt16;};
+    template <> struct typedArrayTypeOf<int32_t> {static constexpr typedArrayType value = kTypedInt32;};
+    template <> struct typedArrayTypeOf<int64_t> {static constexpr typedArrayType value = kTypedInt64;};
+    template <> struct typedArrayTypeOf<float>   {static constexpr typedArrayType value = kTypedFloat32;};
+    template <> struct typedArrayTypeOf<double>  {static constexpr typedArrayType value = kTypedFloat64;};
+
+    template <class T>
+    Array::span<T> Array::asTypedSpan() const noexcept {
+#ifdef _LITTLE_ENDIAN
+        typedArrayType type;
+        uint32_t count;
+        const uint8_t *items;
+        if (getTypedArray(type, count, items) && type == typedArrayTypeOf<T>::value
+                                              && ((size_t)items % alignof(T)) == 0)
+            return span<T>{(const T*)items, count};
+#endif
+        return span<T>{nullptr, 0};
+    }
+
+    template Array::span<int8_t>  Array::asTypedSpan<int8_t>() const noexcept;
+    template Array::span<int16_t> Array::asTypedSpan<int16_t>() const noexcept;
+    template Array::span<int32_t> Array::asTypedSpan<int32_t>() const noexcept;
+    template Array::span<int64_t> Array::asTypedSpan<int64_t>() const noexcept;
+    template Array::span<float>   Array::asTypedSpan<float>() const noexcept;
+    template Array::span<double>  Array::asTypedSpan<double>() const noexcept;
+
+
 #pragma mark - ARRAY::ITERATOR:
     
 
@@ -155,4 +482,25 @@ namespace fleece { namespace impl {
         return *this;
     }
 
+
+#pragma mark - ARRAY::DECODINGITERATOR:
+
+
+    Array::decodingIterator::decodingIterator(const Array *a) noexcept
+    :_iter(a->isTypedArray() ? nullptr : a)
+    ,_typed(a->isTypedArray())
+    {
+        if (_typed && !a->getTypedArray(_type, _typedCount, _typedItem))
+            _typedCount = 0;
+    }
+
+    const Value* Array::decodingIterator::decodeNext() noexcept {
+        if (_usuallyFalse(_typedCount == 0))
+            return nullptr;
+        decodeTypedItem(_type, _typedItem, (uint8_t*)_typedValue);
+        _typedItem += typedArrayItemSize(_type);
+        --_typedCount;
+        return (const Value*)_typedValue;
+    }
+
 } }
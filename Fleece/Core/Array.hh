@@ -44,7 +44,14 @@ namespace fleece { namespace impl {
 
     public:
 
-        /** The number of items in the array. */
+        /** The number of items in the array.
+
+            A typed array (see `Encoder::writeTypedArray`) stores its items as packed numbers,
+            not Values. `copyTo`, `asTypedSpan`, `isEqual`, `contentHash`, `visit` and `toJSON`
+            read them directly. But `get` and `iterator` have to return Values that stay valid,
+            so the first time they're used the array's containing Doc (or other Scope) encodes
+            and caches a regular Array of the items, which uses more memory. Calling them on a
+            typed array that isn't in a Scope is an error. */
         uint32_t count() const noexcept;
 
         bool empty() const noexcept;
@@ -57,6 +64,48 @@ namespace fleece { namespace impl {
         /** If this array is mutable, returns the equivalent MutableArray*, else returns nullptr. */
         MutableArray* asMutable() const;
 
+        /** Copies a range of items into a C array, converting them as by `asDouble`.
+            This is much faster than iterating, especially if the items are small integers.
+            @param out  The destination array, with room for `count` items.
+            @param count  The maximum number of items to copy.
+            @param start  The index of the first item to copy.
+            @return  The number of items copied, which is less than `count` if the range
+                     extends past the end of this array. */
+        uint32_t copyTo(double *out, uint32_t count, uint32_t start =0) const noexcept;
+
+        /** Copies a range of items into a C array, converting them as by `asInt`.
+            (See the `double` version for details.) */
+        uint32_t copyTo(int64_t *out, uint32_t count, uint32_t start =0) const noexcept;
+
+        /** Copies a range of items into a C array, converting them as by `asString`; items that
+            aren't strings become nullslice. (See the `double` version for details.) */
+        uint32_t copyTo(slice *out, uint32_t count, uint32_t start =0) const noexcept;
+
+        /** A read-only view of a contiguous C array of numbers, as returned by `asTypedSpan`. */
+        template <class T>
+        struct span {
+            const T *data;
+            size_t size;
+
+            bool empty() const noexcept                     {return size == 0;}
+            const T* begin() const noexcept                 {return data;}
+            const T* end() const noexcept                   {return data + size;}
+            const T& operator[] (size_t i) const noexcept   {return data[i];}
+        };
+
+        /** True if this array was encoded as a typed array (see `Encoder::writeTypedArray`.) */
+        bool isTyped() const noexcept                       {return isTypedArray();}
+
+        /** If this array was encoded as a typed array (see `Encoder::writeTypedArray`) of items
+            of type T, returns a span pointing directly at the items, without copying.
+            Otherwise, or if the items aren't suitably aligned in memory, or this is a big-endian
+            CPU, returns an empty span; use `copyTo` instead. (The encoder aligns items relative
+            to the start of the complete data, including any base it's appended to, so they're
+            aligned if the data is, as in a mapped file.)
+            T may be int8_t, int16_t, int32_t, int64_t, float or double. */
+        template <class T>
+        span<T> asTypedSpan() const noexcept;
+
         /** An empty Array. */
         static const Array* const kEmpty;
 
@@ -99,13 +148,51 @@ namespace fleece { namespace impl {
 
         iterator begin() const noexcept                      {return iterator(this);}
 
+        /** For internal use: iterates an Array's items like `iterator`, except that a typed
+            array's items are decoded as they're read, without needing a Scope. Each one is
+            decoded into a scalar Value stored in this object, which is valid only until the
+            next `read` call. */
+        class decodingIterator {
+        public:
+            explicit decodingIterator(const Array* NONNULL) noexcept;
+
+            /** Returns the number of _remaining_ items. */
+            uint32_t count() const noexcept     {return _typed ? _typedCount : _iter.count();}
+
+            explicit operator bool() const noexcept          {return count() > 0;}
+
+            /** Returns the current item and advances to the next. */
+            const Value* read() noexcept {
+                return _usuallyFalse(_typed) ? decodeNext() : _iter.read();
+            }
+
+        private:
+            const Value* decodeNext() noexcept;
+
+            iterator                    _iter;          // Iterates a regular array
+            const uint8_t*              _typedItem;     // Next packed item of a typed array
+            uint32_t                    _typedCount {0};
+            internal::typedArrayType    _type;
+            bool                        _typed;
+            uint16_t                    _typedValue[5]; // The decoded item (a scalar Value)
+        };
+
         constexpr Array()  :Value(internal::kArrayTag, 0, 0) { }
 
     protected:
         internal::HeapArray* heapArray() const;
 
     private:
+        template <class T> uint32_t _copyTo(T *out, uint32_t count, uint32_t start) const noexcept;
+        template <class T> uint32_t copyTypedTo(T *out, uint32_t count, uint32_t start) const noexcept;
+        bool getTypedArray(internal::typedArrayType&, uint32_t &count,
+                           const uint8_t* &items) const noexcept;
+        size_t typedArrayDataSize() const noexcept;
+        alloc_slice encodeTypedArrayItems() const;
+
         friend class Value;
+        friend class Scope;
+        friend class Encoder;
         friend class Dict;
         template <bool WIDE> friend struct dictImpl;
         friend class internal::HeapArray;
@@ -22,6 +22,8 @@
 #include "Doc.hh"
 #include "Internal.hh"
 #include "PlatformCompat.hh"
+#include "SIMD.hh"
+#include <algorithm>
 #include <atomic>
 #include <string>
 #include "betterassert.hh"
@@ -91,7 +93,13 @@ namespace fleece { namespace impl {
 
         inline const Value* get(int keyToFind) const noexcept {
             assert(keyToFind >= 0);
-            auto key = search(keyToFind, [](int target, const Value *key) {
+            const Value *key;
+#if FL_SIMD
+            if (_count <= kMaxVectorSearchCount && _usuallyTrue(keyToFind < 2048))
+                key = vectorSearch(keyToFind);
+            else
+#endif
+            key = search(keyToFind, [](int target, const Value *key) {
                 countComparison();
                 return compareKeys(target, key);
             });
@@ -136,6 +144,70 @@ namespace fleece { namespace impl {
             return finishGet(key, keyToFind);
         }
 
+        size_t getMany(Dict::key keys[], size_t nKeys, const Value* values[]) const noexcept {
+            // Look up the Dict's SharedKeys at most once for the whole batch, and only if a key
+            // doesn't already know it (that lookup is relatively expensive):
+            SharedKeys *dictSharedKeys = nullptr;
+            bool checkedSharedKeys = false;
+            // Each search resumes where the previous one ended, so keys that are in the same
+            // order as the Dict's turn the whole batch into a single merge-walk:
+            const Value *cursor = _first;
+            size_t nFound = 0;
+            for (size_t i = 0; i < nKeys; ++i) {
+                Dict::key &keyToFind = keys[i];
+                auto sharedKeys = keyToFind._sharedKeys;
+                if (!sharedKeys) {
+                    if (!checkedSharedKeys) {
+                        checkedSharedKeys = true;
+                        if (usesSharedKeys()) {
+                            dictSharedKeys = findSharedKeys();
+                            assert(dictSharedKeys || gDisableNecessarySharedKeysCheck);
+                        }
+                    }
+                    if (dictSharedKeys) {
+                        keyToFind.setSharedKeys(dictSharedKeys);
+                        sharedKeys = dictSharedKeys;
+                    }
+                }
+                if (sharedKeys && !keyToFind._hasNumericKey && _count > 0
+                        && lookupSharedKey(keyToFind._rawString, sharedKeys, keyToFind._numericKey))
+                    keyToFind._hasNumericKey = true;
+
+                const Value *value;
+                if (sharedKeys && keyToFind._hasNumericKey) {
+                    int numericKey = keyToFind._numericKey;
+                    const Value *key;
+#if FL_SIMD
+                    if (_count <= kMaxVectorSearchCount && _usuallyTrue(numericKey < 2048))
+                        key = vectorSearch(numericKey);     // faster than any merge-walk
+                    else
+#endif
+                    key = searchFrom(cursor, numericKey, [](int target, const Value *key) {
+                        countComparison();
+                        return compareKeys(target, key);
+                    });
+                    value = finishGet(key, numericKey);
+                } else {
+                    auto key = findKeyByHint(keyToFind);
+                    if (key) {
+                        cursor = offsetby(key, 2*kWidth);
+                    } else {
+                        key = searchFrom(cursor, keyToFind._rawString, [](slice target, const Value *val) {
+                            countComparison();
+                            return compareKeys(target, val);
+                        });
+                        if (key)
+                            keyToFind._hint = (uint32_t)indexOf(key) / 2;
+                    }
+                    value = finishGet(key, keyToFind);
+                }
+                values[i] = value;
+                if (value)
+                    ++nFound;
+            }
+            return nFound;
+        }
+
         bool hasParent() const {
             return _usuallyTrue(_count > 0) && _usuallyFalse(Dict::isMagicParentKey(_first));
         }
@@ -196,6 +268,102 @@ namespace fleece { namespace impl {
             return nullptr;
         }
 
+        // Searches for a key at or after `cursor`, by probing 1, 2, 4, 8... keys ahead until
+        // passing the target, then binary-searching that span. Starts over from the beginning if
+        // the target sorts before the cursor. On return, `cursor` points just past the target's
+        // position in the dict (whether or not it was found.)
+        template <class T, class CMP>
+        inline const Value* searchFrom(const Value* &cursor, T target, CMP comparator) const {
+            if (cursor != _first && comparator(target, offsetby(cursor, -(ptrdiff_t)(2*kWidth))) <= 0)
+                cursor = _first;
+            const Value *begin = cursor;
+            size_t n = ((const uint8_t*)_first + _count * 2*kWidth - (const uint8_t*)begin) / (2*kWidth);
+
+            // Gallop forward to find a range [lo, hi) that must contain the target:
+            size_t lo = 0, bound = 1;
+            while (bound <= n) {
+                const Value *probe = offsetby(begin, (bound - 1) * 2*kWidth);
+                int cmp = comparator(target, probe);
+                if (_usuallyFalse(cmp == 0)) {
+                    cursor = offsetby(probe, 2*kWidth);
+                    return probe;
+                } else if (cmp < 0) {
+                    break;
+                }
+                lo = bound;
+                bound *= 2;
+            }
+            size_t hi = std::min(bound - 1, n);
+
+            // Then binary-search it:
+            while (lo < hi) {
+                size_t mid = (lo + hi) >> 1;
+                const Value *midVal = offsetby(begin, mid * 2*kWidth);
+                int cmp = comparator(target, midVal);
+                if (_usuallyFalse(cmp == 0)) {
+                    cursor = offsetby(midVal, 2*kWidth);
+                    return midVal;
+                } else if (cmp < 0) {
+                    hi = mid;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+            cursor = offsetby(begin, lo * 2*kWidth);
+            return nullptr;
+        }
+
+#if FL_SIMD
+        // Finds an integer key by comparing all the keys at once using vector instructions, which
+        // beats a binary search on small dicts since there are no unpredictable branches.
+        // A short-int key is stored big-endian, so loaded as a little-endian uint16 it equals
+        // the byte-swapped key. Each key is compared as a 16-bit lane, and the lanes holding
+        // values (or the high half of a wide key) are masked out. A string or pointer key can't
+        // match because its tag is nonzero.
+        const Value* vectorSearch(int keyToFind) const noexcept {
+            const uint16_t pattern = uint16_t(((keyToFind & 0xFF) << 8) | (keyToFind >> 8));
+            auto cur = (const uint8_t*)_first;
+            auto end = cur + _count * 2*kWidth;
+            countComparison();
+#if FL_SIMD_AVX2
+            const __m256i needle32 = _mm256_set1_epi16((short)pattern);
+            for (; cur + 32 <= end; cur += 32) {
+                __m256i block = _mm256_loadu_si256((const __m256i*)cur);
+                uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, needle32));
+                bits &= (WIDE ? 0x03030303 : 0x33333333);
+                if (bits)
+                    return (const Value*)(cur + countTrailingZeros(bits));
+            }
+#endif
+#if FL_SIMD_SSE2
+            const __m128i needle = _mm_set1_epi16((short)pattern);
+            for (; cur + 16 <= end; cur += 16) {
+                __m128i block = _mm_loadu_si128((const __m128i*)cur);
+                uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi16(block, needle));
+                bits &= (WIDE ? 0x0303 : 0x3333);
+                if (bits)
+                    return (const Value*)(cur + countTrailingZeros(bits));
+            }
+#elif FL_SIMD_NEON
+            const uint16x8_t needle = vdupq_n_u16(pattern);
+            for (; cur + 16 <= end; cur += 16) {
+                uint16x8_t block = vld1q_u16((const uint16_t*)cur);
+                uint8x8_t eq = vmovn_u16(vceqq_u16(block, needle));     // 1 byte per lane
+                uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(eq), 0);
+                bits &= (WIDE ? 0x000000FF000000FFull : 0x00FF00FF00FF00FFull);
+                if (bits)
+                    return (const Value*)(cur + countTrailingZeros64(bits) / 4);
+            }
+#endif
+            // Remaining keys that don't fill a whole vector:
+            for (; cur < end; cur += 2*kWidth) {
+                if (((cur[0] << 8) | cur[1]) == keyToFind)
+                    return (const Value*)cur;
+            }
+            return nullptr;
+        }
+#endif
+
         const Value* findKeyByHint(Dict::key &keyToFind) const {
             if (keyToFind._hint < _count) {
                 const Value *key  = offsetby(_first, keyToFind._hint * 2 * kWidth);
@@ -251,6 +419,7 @@ namespace fleece { namespace impl {
         }
 
         static constexpr size_t kWidth = (WIDE ? 4 : 2);
+        static constexpr uint32_t kMaxVectorSearchCount = 32;   // Max dict size for vectorSearch
         static constexpr uint32_t kPtrMask = (WIDE ? 0x80000000 : 0x8000);
     };
 
@@ -330,6 +499,21 @@ namespace fleece { namespace impl {
             return dictImpl<false>(this).get(keyToFind);
     }
 
+    size_t Dict::getMany(key keys[], size_t count, const Value* values[]) const noexcept {
+        if (_usuallyFalse(isMutable())) {
+            size_t nFound = 0;
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = heapDict()->get(keys[i]);
+                if (values[i])
+                    ++nFound;
+            }
+            return nFound;
+        } else if (isWideArray())
+            return dictImpl<true>(this).getMany(keys, count, values);
+        else
+            return dictImpl<false>(this).getMany(keys, count, values);
+    }
+
     const Value* Dict::get(const key_t &keyToFind) const noexcept {
         if (_usuallyFalse(isMutable()))
             return heapDict()->get(keyToFind);
@@ -356,7 +540,14 @@ namespace fleece { namespace impl {
             return dictImpl<false>(this).getParent();
     }
 
-    bool Dict::isEqualToDict(const Dict* dv) const {
+    unsigned Dict::parentDepth() const noexcept {
+        unsigned depth = 0;
+        for (auto parent = getParent(); parent; parent = parent->getParent())
+            ++depth;
+        return depth;
+    }
+
+    bool Dict::isEqualToDict(const Dict* dv, bool useHash) const {
         Dict::iterator i(this);
         Dict::iterator j(dv);
         if (!this->getParent() && !dv->getParent() && i.count() != j.count())
@@ -364,13 +555,17 @@ namespace fleece { namespace impl {
         if (sharedKeys() == dv->sharedKeys()) {
             // If both dicts use same sharedKeys, their keys must be in the same order.
             for (; i; ++i, ++j)
-                if (i.keyString() != j.keyString() || !i.value()->isEqual(j.value()))
+                if (i.keyString() != j.keyString() || !i.value()->isEqual(j.value(), useHash))
                     return false;
         } else {
+            // Looking up every key is expensive, so first rule out differing contents. The hash
+            // covers all nested values, so nested Dicts don't need to check it again:
+            if (useHash && contentHash() != dv->contentHash())
+                return false;
             unsigned n = 0;
             for (; i; ++i, ++n) {
                 auto dvalue = dv->get(i.keyString());
-                if (!dvalue || !i.value()->isEqual(dvalue))
+                if (!dvalue || !i.value()->isEqual(dvalue, false))
                     return false;
             }
             if (dv->count() != n)
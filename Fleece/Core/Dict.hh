@@ -50,7 +50,11 @@ namespace fleece { namespace impl {
         }
 #endif
 
-        bool isEqualToDict(const Dict* NONNULL) const;
+        /** The number of Dicts this one inherits from: 0 if it has no parent, 1 if its parent
+            has none, etc. (See Encoder::beginDictionary(const Dict*).) */
+        unsigned parentDepth() const noexcept;
+
+        bool isEqualToDict(const Dict *dv NONNULL) const    {return isEqualToDict(dv, true);}
 
         /** An empty Dict. */
         static const Dict* const kEmpty;
@@ -139,12 +143,19 @@ namespace fleece { namespace impl {
 
         const Value* get(const key_t&) const noexcept;
 
+        /** Looks up several keys at once, storing each one's Value (or nullptr) in the
+            corresponding item of `values`. This is faster than calling `get` for each key,
+            especially if the keys are in the same order as the Dict's.
+            @return  The number of keys found. */
+        size_t getMany(key keys[], size_t count, const Value* values[]) const noexcept;
+
         constexpr Dict()  :Value(internal::kDictTag, 0, 0) { }
 
     protected:
         internal::HeapDict* heapDict() const;
         uint32_t rawCount() const noexcept;
         const Dict* getParent() const;
+        bool isEqualToDict(const Dict* NONNULL, bool useHash) const;
 
         static bool isMagicParentKey(const Value *v);
         static constexpr int kMagicParentKey = -2048;
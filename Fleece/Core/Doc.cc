@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <functional>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 #include "betterassert.hh"
 
@@ -235,6 +236,32 @@ namespace fleece { namespace impl {
     }
 
 
+    // Maps the typed arrays in a Scope to Docs containing equivalent regular Arrays.
+    struct Scope::TypedArrayCache : public unordered_map<const Array*, Retained<Doc>> { };
+
+
+    // Array items have to be Values, but a typed array's items aren't, so the first time its
+    // items are accessed as Values they're encoded as a regular Array, which lives as long as
+    // this Scope. (Operations that can read the packed items directly don't call this.)
+    /*static*/ const Array* Scope::typedArrayItems(const Array *array) noexcept {
+        auto scope = containing(array);
+        if (_usuallyFalse(!scope))
+            return nullptr;
+        lock_guard<mutex> lock(scope->_typedArraysMutex);
+        if (!scope->_typedArrays)
+            scope->_typedArrays.reset(new TypedArrayCache);
+        Retained<Doc> &items = (*scope->_typedArrays)[array];
+        if (!items) {
+            try {
+                items = new Doc(array->encodeTypedArrayItems(), Doc::kTrusted);
+            } catch (...) {
+                return nullptr;
+            }
+        }
+        return items->asArray();
+    }
+
+
     void Scope::dumpAll() {
         lock_guard<mutex> lock(sMutex);
         if (_usuallyFalse(!sMemoryMap)) {
@@ -293,6 +320,15 @@ namespace fleece { namespace impl {
     }
 
 
+    ContentHash Doc::contentHash() const {
+        std::call_once(_contentHashOnce, [this] {
+            if (_root)
+                _contentHash = _root->contentHash();
+        });
+        return _contentHash;
+    }
+
+
     /*static*/ RetainedConst<Doc> Doc::containing(const Value *src) noexcept {
         src = resolveMutable(src);
         if (!src)
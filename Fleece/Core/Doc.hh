@@ -8,10 +8,13 @@
 #include "RefCounted.hh"
 #include "Value.hh"
 #include "fleece/slice.hh"
+#include <memory>
+#include <mutex>
 
 namespace fleece { namespace impl {
     class SharedKeys;
     class Value;
+    class Array;
     namespace internal {
         class Pointer;
     }
@@ -50,6 +53,7 @@ namespace fleece { namespace impl {
         static std::pair<const Value*,slice> resolvePointerFromWithRange(
                                                                          const internal::Pointer* NONNULL src,
                                                                          const void* NONNULL dst) noexcept;
+        static const Array* typedArrayItems(const Array* NONNULL) noexcept;
         static void dumpAll();
 
     protected:
@@ -57,6 +61,8 @@ namespace fleece { namespace impl {
         void unregister() noexcept;
 
     private:
+        struct TypedArrayCache;
+
         Scope(const Scope&) =delete;
         void registr() noexcept;
 
@@ -65,6 +71,8 @@ namespace fleece { namespace impl {
         slice const         _data;                      // The memory range I represent
         alloc_slice const   _alloced;                   // Retains data if it's an alloc_slice
         std::atomic_flag    _unregistered ATOMIC_FLAG_INIT; // False if registered in sMemoryMap
+        mutable std::unique_ptr<TypedArrayCache> _typedArrays; // Regular Arrays for typed arrays
+        mutable std::mutex  _typedArraysMutex;          // Guards _typedArrays
 #if DEBUG
         uint32_t            _dataHash;                  // hash of _data, for troubleshooting
 #endif
@@ -107,6 +115,10 @@ namespace fleece { namespace impl {
         const Dict* asDict() const              {return _root ? _root->asDict() : nullptr;}
         const Array* asArray() const            {return _root ? _root->asArray() : nullptr;}
 
+        /** Returns the contentHash of the root Value. It's computed on the first call and
+            remembered, so comparing Docs' hashes is cheap. */
+        ContentHash contentHash() const;
+
     protected:
         virtual ~Doc() =default;
 
@@ -115,6 +127,8 @@ namespace fleece { namespace impl {
 
         const Value*        _root {nullptr};            // The root object of the Fleece
         RetainedConst<Doc>  _parent;
+        mutable std::once_flag _contentHashOnce;        // Guards computing _contentHash
+        mutable ContentHash _contentHash {0, 0};        // Memoized root contentHash
     };
 
 } }
@@ -27,6 +27,7 @@
 #include "ParseDate.hh"
 #include "PlatformCompat.hh"
 #include "TempArray.hh"
+#include "ValueVisitor.hh"
 #include <algorithm>
 #include <cmath>
 #include <float.h>
@@ -75,6 +76,7 @@ namespace fleece { namespace impl {
         _out.reset();
         _strings.clear();
         _writingKey = _blockedOnKey = false;
+        _reservedString = nullslice;
         resetStack();
     }
 
@@ -365,35 +367,133 @@ namespace fleece { namespace impl {
         _writeString(slice(s));
     }
 
+    char* Encoder::beginString(size_t maxSize) {
+        assert(!_reservedString);
+        nextWritePos();
+        // Reserve room for the largest header, the string, and a padding byte:
+        size_t headerSize = 1 + SizeOfVarInt(maxSize);
+        size_t size = headerSize + maxSize + 1;
+        _reservedString = slice(_out.reserveSpace(size), size);
+        return (char*)_reservedString.buf + headerSize;
+    }
+
+    void Encoder::finishString(char *str, size_t size) {
+        slice reserved = _reservedString;
+        _reservedString = nullslice;
+        assert(reserved.buf && str > reserved.buf && str + size < reserved.end());
+        _out.unreserveSpace(reserved.size);
+        if (size <= kMaxSharedStringSize) {
+            // Short strings may be inline or shared, so write them the usual way:
+            char buf[kMaxSharedStringSize];
+            memcpy(buf, str, size);
+            _writeString(slice(buf, size));
+        } else {
+            // Otherwise the value goes where the space was reserved; since it's the next thing
+            // written it'll land at the same address, so at most the string has to slide down
+            // if its header turned out shorter than the one allowed for:
+            size_t headerSize = 1 + SizeOfVarInt(size);
+            memmove((byte*)reserved.buf + headerSize, str, size);
+            byte *buf = placeValue<false>(kStringTag, 0x0F, headerSize + size);
+            assert(buf == reserved.buf);
+            PutUVarInt(buf + 1, size);
+        }
+    }
+
+    void Encoder::cancelString() {
+        assert(_reservedString);
+        _out.unreserveSpace(_reservedString.size);
+        _reservedString = nullslice;
+    }
+
     void Encoder::writeData(slice s) {
         writeData(kBinaryTag, s);
     }
 
+    // Writes a typed array (see Internal.hh.) `items` are in native byte order unless
+    // `littleEndian` is true.
+    void Encoder::writeTypedArray(typedArrayType type, const void *items, size_t count,
+                                  bool littleEndian)
+    {
+        throwIf(count > UINT32_MAX, InvalidData, "typed array is too large");
+        if (!littleEndian) {
+            if (type == kTypedFloat32) {
+                throwIf(std::any_of((const float*)items, (const float*)items + count,
+                                    [](float n) {return std::isnan(n);}),
+                        InvalidData, "Can't write NaN");
+            } else if (type == kTypedFloat64) {
+                throwIf(std::any_of((const double*)items, (const double*)items + count,
+                                    [](double n) {return std::isnan(n);}),
+                        InvalidData, "Can't write NaN");
+            }
+        }
+        if (count == 0) {
+            beginArray();
+            endArray();
+            return;
+        }
+        size_t itemSize = typedArrayItemSize(type);
+        byte countBuf[kMaxVarintLen32];
+        size_t countSize = PutUVarInt(countBuf, count);
+        // Pad the header so the items are aligned relative to the start of the complete data,
+        // which begins with the base (if any) that the output will be appended to:
+        size_t pos = _base.size + nextWritePos();
+        size_t countPos = kTypedArrayHeaderSize + 2;
+        size_t itemsOffset = countPos + countSize;
+        itemsOffset += (itemSize - (pos + itemsOffset) % itemSize) % itemSize;
+        size_t itemsSize = count * itemSize;
+
+        byte *buf = placeValue<false>(itemsOffset + itemsSize);
+        memcpy(buf, kTypedArrayHeader, kTypedArrayHeaderSize);
+        buf[kTypedArrayHeaderSize] = type;
+        buf[kTypedArrayHeaderSize + 1] = (byte)itemsOffset;
+        memcpy(&buf[countPos], countBuf, countSize);
+        memset(&buf[countPos + countSize], 0, itemsOffset - countPos - countSize);
+        byte *dst = &buf[itemsOffset];
+        memcpy(dst, items, itemsSize);
+#ifndef _LITTLE_ENDIAN
+        if (!littleEndian && itemSize > 1) {
+            for (byte *item = dst; item < dst + itemsSize; item += itemSize)
+                std::reverse(item, item + itemSize);
+        }
+#endif
+    }
+
 
     void Encoder::reuseBaseStrings() {
         reuseBaseStrings(Value::fromTrustedData(_base));
     }
 
     void Encoder::reuseBaseStrings(const Value *value) {
-        if (value < _baseCutoff)
-            return;
-        switch (value->tag()) {
-            case kStringTag:
-                cacheString(value->asString(), (size_t)value - (ssize_t)_base.buf);
-                break;
-            case kArrayTag:
-                for (Array::iterator iter(value->asArray()); iter; ++iter)
-                    reuseBaseStrings(iter.value());
-                break;
-            case kDictTag:
-                for (Dict::iterator iter(value->asDict()); iter; ++iter) {
-                    reuseBaseStrings(iter.key());
-                    reuseBaseStrings(iter.value());
-                }
-                break;
-            default:
-                break;
-        }
+        // Caches every string (and key) in the base data past the cutoff:
+        struct Visitor : public ValueVisitor {
+            explicit Visitor(Encoder &enc)              :_enc(enc) { }
+
+            VisitAction value(const Value *v) {
+                if (v >= _enc._baseCutoff && v->tag() == kStringTag)
+                    _enc.cacheString(v->asString(), (size_t)v - (ssize_t)_enc._base.buf);
+                return kVisitContinue;
+            }
+
+            VisitAction beginArray(const Array *a) {
+                // A typed array contains only numbers:
+                bool skip = (a < _enc._baseCutoff || a->isTypedArray());
+                return skip ? kVisitSkipChildren : kVisitContinue;
+            }
+
+            VisitAction beginDict(const Dict *d) {
+                return (d < _enc._baseCutoff) ? kVisitSkipChildren : kVisitContinue;
+            }
+
+            VisitAction key(const Dict::iterator &iter) {
+                return value(iter.key());
+            }
+
+        private:
+            Encoder &_enc;
+        };
+
+        Visitor visitor(*this);
+        value->visit(visitor);
     }
 
 
@@ -417,31 +517,38 @@ namespace fleece { namespace impl {
     // Returns the minimum address used by the given Value (transitively).
     // If that minimum address comes before _baseCutoff, immediately returns null.
     const Value* Encoder::minUsed(const Value *value) {
-        if (value < _baseCutoff)
-            return nullptr;
-        switch (value->type()) {
-        case kArray: {
-            const Value *minVal = value;
-            for (Array::iterator i((const Array*)value); i; ++i) {
-                minVal = std::min(minVal, minUsed(i.value()));
-                if (minVal == nullptr)
-                    break;
+        struct Visitor : public ValueVisitor {
+            Visitor(const void *cutoff, const Value *root)   :_cutoff(cutoff), minVal(root) { }
+
+            VisitAction value(const Value *v) {
+                if (v < _cutoff) {
+                    minVal = nullptr;
+                    return kVisitStop;
+                }
+                minVal = std::min(minVal, v);
+                return kVisitContinue;
             }
-            return minVal;
-        }
-        case kDict: {
-            const Value *minVal = value;
-            for (Dict::iterator i((const Dict*)value, false); i; ++i) {
-                minVal = std::min(minVal, minUsed(i.key()));
-                minVal = std::min(minVal, minUsed(i.value()));
-                if (minVal == nullptr)
-                    break;
+
+            VisitAction beginArray(const Array *a) {
+                auto action = value(a);
+                if (action == kVisitContinue && a->isTypedArray())
+                    action = kVisitSkipChildren;    // its items are stored inline
+                return action;
             }
-            return minVal;
-        }
-        default:
-            return value;
-        }
+
+            VisitAction beginDict(const Dict *d)            {return value(d);}
+            VisitAction key(const Dict::iterator &iter)     {return value(iter.key());}
+
+            // The dict's parent is a value in the data like any other:
+            static constexpr bool rawDicts()                {return true;}
+
+            const void* const _cutoff;
+            const Value* minVal;
+        };
+
+        Visitor visitor(_baseCutoff, value);
+        value->visit(visitor);
+        return visitor.minVal;
     }
 
 
@@ -475,6 +582,13 @@ namespace fleece { namespace impl {
                 writeData(value->asData());
                 break;
             case kArrayTag: {
+                typedArrayType type;
+                uint32_t count;
+                const uint8_t *items;
+                if (_usuallyFalse(value->asArray()->getTypedArray(type, count, items))) {
+                    writeTypedArray(type, items, count, true);
+                    break;
+                }
                 ++_copyingCollection;
                 auto iter = value->asArray()->begin();
                 beginArray(iter.count());
@@ -691,6 +805,27 @@ namespace fleece { namespace impl {
         writeValue(parent);
     }
 
+    void Encoder::writeFlattened(const Dict *dict) {
+        const SharedKeys *sk = nullptr;
+        ++_copyingCollection;
+        Dict::iterator iter(dict);
+        beginDictionary(iter.count());
+        for (; iter; ++iter) {
+            if (!sk && iter.key()->isInteger())
+                sk = dict->sharedKeys();
+            writeKey(iter.key(), sk);
+            writeValue(iter.value(), sk, nullptr);
+        }
+        endDictionary();
+        --_copyingCollection;
+    }
+
+    bool Encoder::shouldInheritFrom(const Dict *parent, size_t overlayCount, size_t count) const {
+        return valueIsInBase(parent)
+            && overlayCount + 1 < count * _maxOverlayRatio
+            && parent->parentDepth() < _maxParentDepth;
+    }
+
     void Encoder::endArray() {
         endCollection(internal::kArrayTag);
     }
@@ -92,10 +92,32 @@ namespace fleece { namespace impl {
         void writeString(const std::string&);
         void writeString(slice s)           {(void)_writeString(s);}
 
+        /** Writes a string whose contents are generated in place, saving a copy: returns a buffer
+            of at least `maxSize` bytes, into which the caller writes the string, and then calls
+            finishString() with its actual size. No other Encoder methods may be called in between.
+            (If the string turns out to be short enough to be shared, it's moved into place.)
+            If the string can't be completed (e.g. its input is invalid), call cancelString()
+            instead of finishString(); nothing is written. */
+        char* beginString(size_t maxSize);
+        void finishString(char *str, size_t size);
+        void cancelString();
+
         void writeDateString(int64_t timestamp, bool asUTC =true);
 
         void writeData(slice s);
 
+        /** Writes an array of numbers in the compact "typed array" format: the items are stored
+            contiguously in little-endian form, instead of as individual Values. It reads as a
+            regular Array inside a Doc, and `Array::asTypedSpan` can access the items without
+            copying. (See `Array::count` for the limitations when there's no Doc.)
+            Readers older than this format reject data containing typed arrays as invalid. */
+        void writeTypedArray(const int8_t *items, size_t count)  {writeTypedArray(internal::kTypedInt8, items, count);}
+        void writeTypedArray(const int16_t *items, size_t count) {writeTypedArray(internal::kTypedInt16, items, count);}
+        void writeTypedArray(const int32_t *items, size_t count) {writeTypedArray(internal::kTypedInt32, items, count);}
+        void writeTypedArray(const int64_t *items, size_t count) {writeTypedArray(internal::kTypedInt64, items, count);}
+        void writeTypedArray(const float *items, size_t count)   {writeTypedArray(internal::kTypedFloat32, items, count);}
+        void writeTypedArray(const double *items, size_t count)  {writeTypedArray(internal::kTypedFloat64, items, count);}
+
         void writeValue(const Value* NONNULL v)             {writeValue(v, nullptr);}
 
         using WriteValueFunc = function_ref<bool(const Value *key, const Value *value)>;
@@ -139,6 +161,30 @@ namespace fleece { namespace impl {
             the next outermost collection (or made the root if there is no collection active.) */
         void endDictionary();
 
+        /** Writes a Dict merged with all the Dicts it inherits from, as a new Dict with no
+            parent. Deleted keys are omitted. Unlike writeValue, this copies the Dict even if it's
+            in the base. (Nested Dicts are written as usual, i.e. not flattened.) */
+        void writeFlattened(const Dict* NONNULL);
+
+        /** Controls when a mutable Dict derived from a Dict in the base is written as a delta
+            (a Dict containing only the changes, that inherits from the original), and when it's
+            written flattened.
+            @param maxParentDepth  The maximum number of ancestors a written Dict can have.
+            @param maxOverlayRatio  Limits the size of a delta relative to the whole Dict. A Dict
+                        with `n` changed keys and `count` keys in total is written as a delta only
+                        if `n + 1 < count * maxOverlayRatio` (the delta also stores a key pointing
+                        to its parent.) The default, 1.0, writes a delta only if it has fewer
+                        entries than the full Dict would. */
+        void setDictInheritanceLimits(unsigned maxParentDepth, float maxOverlayRatio) {
+            _maxParentDepth = maxParentDepth;
+            _maxOverlayRatio = maxOverlayRatio;
+        }
+
+        /** Returns true if a Dict with `overlayCount` changed keys and `count` keys in total
+            should be written as a delta inheriting from `parent`, according to the limits set
+            by setDictInheritanceLimits. */
+        bool shouldInheritFrom(const Dict *parent, size_t overlayCount, size_t count) const;
+
         /** Writes a key to the current dictionary. This must be called before adding a value. */
         void writeKey(const std::string&);
         /** Writes a key to the current dictionary. This must be called before adding a value. */
@@ -217,6 +263,8 @@ namespace fleece { namespace impl {
         void writeInt(uint64_t i, bool isShort, bool isUnsigned);
         void _writeFloat(float);
         slice writeData(internal::tags, slice s);
+        void writeTypedArray(internal::typedArrayType, const void *items, size_t count,
+                             bool littleEndian =false);
         slice _writeString(slice);
         void addingKey();
         void addedKey(slice str);
@@ -246,11 +294,14 @@ namespace fleece { namespace impl {
         slice _base;                 // Base Fleece data being appended to (if any)
         const void* _baseCutoff {0}; // Lowest addr in _base that I can write a ptr to
         const void* _baseMinUsed {0};// Lowest addr in _base I've written a ptr to
+        slice _reservedString;       // Output space reserved by beginString()
         int _copyingCollection {0};  // Nonzero inside writeValue when writing array/dict
         bool _writingKey    {false}; // True if Value being written is a key
         bool _blockedOnKey  {false}; // True if writes should be refused
         bool _trailer       {true};  // Write standard trailer at end?
         bool _markExternPtrs{false}; // Mark pointers outside encoded data as 'extern'
+        unsigned _maxParentDepth {2};// Max ancestors of a Dict written as a delta
+        float _maxOverlayRatio {1.0};// Max size of a delta Dict relative to the full Dict
 
         friend class EncoderTests;
 #ifndef NDEBUG
@@ -0,0 +1,439 @@
+//
+// FleeceDelta.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "FleeceDelta.hh"
+#include "JSONDelta.hh"
+#include "FleeceException.hh"
+#include "TempArray.hh"
+#include <vector>
+#include "betterassert.hh"
+
+
+namespace fleece { namespace impl {
+    using namespace std;
+
+
+    // A delta is either a scalar (the replacement value), a dict (an incremental update of a
+    // dict, mapping keys to deltas), or an array whose first item is one of these opcodes:
+    enum {
+        kDeleteOp       = 0,    // [0]              — delete the value
+        kReplaceOp      = 1,    // [1, value]       — replace with an array or dict
+        kTextDiffOp     = 2,    // [2, "diff"]      — patch a string (same diff as JSONDelta's)
+        kArrayPatchOp   = 3,    // [3, item-op...]  — incremental update of an array
+    };
+
+    // The item-ops in an array patch are applied in order to consecutive items of the old array.
+    // Each is an integer or an array starting with an opcode:
+    //   n (> 0)            — keep the next n old items
+    //   -n                 — skip (delete) the next n old items
+    //   [1, value...]      — insert the values
+    //   [4, index, n]      — insert n old items starting at `index` (they moved)
+    //   [5, delta]         — apply `delta` to the next old item
+    //   {...}              — shorthand for [5, {...}]
+    enum {
+        kInsertItemsOp  = 1,
+        kCopyItemsOp    = 4,
+        kPatchItemOp    = 5,
+    };
+
+
+#pragma mark - CREATING DELTAS:
+
+
+    unsigned FleeceDelta::gMaxArrayDiffEdits = 100;
+
+
+    /*static*/ alloc_slice FleeceDelta::create(const Value *old, const Value *nuu) {
+        Encoder enc;
+        create(old, nuu, enc);
+        return enc.finish();
+    }
+
+
+    /*static*/ bool FleeceDelta::create(const Value *old, const Value *nuu, Encoder &enc) {
+        FleeceDelta delta(enc);
+        if (delta._write(old, nuu, nullptr))
+            return true;
+        // If there is no difference, write a no-op delta:
+        delta.writeNoOp();
+        return false;
+    }
+
+
+    // An empty dict is a delta that leaves the value unchanged.
+    void FleeceDelta::writeNoOp() {
+        _encoder.beginDictionary();
+        _encoder.endDictionary();
+    }
+
+
+    struct FleeceDelta::pathItem {
+        pathItem *parent;
+        bool isOpen;
+        slice key;
+    };
+
+
+    void FleeceDelta::writePath(pathItem *path) {
+        if (!path)
+            return;
+        writePath(path->parent);
+        path->parent = nullptr;
+        if (!path->isOpen) {
+            _encoder.beginDictionary();
+            path->isOpen = true;
+        }
+        _encoder.writeKey(path->key);
+    }
+
+
+    // Main encoder function. Called recursively, traversing the hierarchy.
+    bool FleeceDelta::_write(const Value *old, const Value *nuu, pathItem *path) {
+        if (_usuallyFalse(old == nuu))
+            return false;
+        if (old) {
+            if (!nuu) {
+                // `old` was deleted:
+                writePath(path);
+                _encoder.beginArray(1);
+                _encoder.writeInt(kDeleteOp);
+                _encoder.endArray();
+                return true;
+            }
+
+            auto oldType = old->type(), nuuType = nuu->type();
+            if (oldType == nuuType) {
+                if (oldType == kDict) {
+                    // Possibly-modified dict: write a dict with the modified keys
+                    pathItem curLevel = {path, false, nullslice};
+                    JSONDelta::diffDicts((const Dict*)old, (const Dict*)nuu,
+                                         [&](slice key, const Value *oldValue,
+                                             const Value *nuuValue) {
+                        curLevel.key = key;
+                        _write(oldValue, nuuValue, &curLevel);
+                    });
+                    if (!curLevel.isOpen)
+                        return false;
+                    _encoder.endDictionary();
+                    return true;
+
+                } else if (oldType == kArray) {
+                    return writeArrayDelta((const Array*)old, (const Array*)nuu, path);
+
+                } else if (old->isEqual(nuu)) {
+                    return false;
+
+                } else if (oldType == kString) {
+                    slice nuuStr = nuu->asString();
+                    TempArray(strPatch, char, nuuStr.size);
+                    size_t patchSize = JSONDelta::createStringDelta(old->asString(), nuuStr,
+                                                                    strPatch);
+                    if (patchSize > 0) {
+                        writePath(path);
+                        _encoder.beginArray(2);
+                        _encoder.writeInt(kTextDiffOp);
+                        _encoder.writeString(slice(strPatch, patchSize));
+                        _encoder.endArray();
+                        return true;
+                    }
+                }
+            }
+        }
+
+        // Generic modification/insertion:
+        writePath(path);
+        if (nuu->type() < kArray) {
+            _encoder.writeValue(nuu);
+        } else {
+            _encoder.beginArray(2);
+            _encoder.writeInt(kReplaceOp);
+            _encoder.writeValue(nuu);
+            _encoder.endArray();
+        }
+        return true;
+    }
+
+
+    bool FleeceDelta::writeArrayDelta(const Array *oldArray, const Array *nuuArray,
+                                      pathItem *path)
+    {
+        vector<JSONDelta::ArrayEdit> plan;
+        JSONDelta::planArrayDiff(oldArray, nuuArray, gMaxArrayDiffEdits, true, plan);
+        if (plan.empty() || (plan.size() == 1 && plan[0].op == JSONDelta::ArrayEdit::kKeep))
+            return false;
+
+        writePath(path);
+        _encoder.beginArray();
+        _encoder.writeInt(kArrayPatchOp);
+        for (size_t i = 0; i < plan.size(); ++i) {
+            auto &edit = plan[i];
+            switch (edit.op) {
+                case JSONDelta::ArrayEdit::kKeep:
+                    _encoder.writeInt(edit.count);
+                    break;
+                case JSONDelta::ArrayEdit::kRemove:
+                    _encoder.writeInt(-int64_t(edit.count));
+                    break;
+                case JSONDelta::ArrayEdit::kInsert:
+                    // Coalesce consecutive insertions into one op:
+                    _encoder.beginArray();
+                    _encoder.writeInt(kInsertItemsOp);
+                    _encoder.writeValue(nuuArray->get(edit.nuuIndex));
+                    while (i + 1 < plan.size() && plan[i+1].op == JSONDelta::ArrayEdit::kInsert)
+                        _encoder.writeValue(nuuArray->get(plan[++i].nuuIndex));
+                    _encoder.endArray();
+                    break;
+                case JSONDelta::ArrayEdit::kCopy: {
+                    // Coalesce copies of consecutive old items into one op:
+                    uint32_t count = 1;
+                    while (i + 1 < plan.size() && plan[i+1].op == JSONDelta::ArrayEdit::kCopy
+                                               && plan[i+1].oldIndex == edit.oldIndex + count) {
+                        ++count;
+                        ++i;
+                    }
+                    _encoder.beginArray(3);
+                    _encoder.writeInt(kCopyItemsOp);
+                    _encoder.writeUInt(edit.oldIndex);
+                    _encoder.writeUInt(count);
+                    _encoder.endArray();
+                    break;
+                }
+                case JSONDelta::ArrayEdit::kPatch: {
+                    auto oldItem = oldArray->get(edit.oldIndex);
+                    auto nuuItem = nuuArray->get(edit.nuuIndex);
+                    // (If `_write` finds no difference after all, it writes nothing; the op
+                    // still has to consume the old item, so write a no-op `{}` delta instead.)
+                    if (oldItem->type() == kDict && nuuItem->type() == kDict) {
+                        if (!_write(oldItem, nuuItem, nullptr))    // writes a dict delta
+                            writeNoOp();
+                    } else {
+                        _encoder.beginArray(2);
+                        _encoder.writeInt(kPatchItemOp);
+                        if (!_write(oldItem, nuuItem, nullptr))
+                            writeNoOp();
+                        _encoder.endArray();
+                    }
+                    break;
+                }
+            }
+        }
+        _encoder.endArray();
+        return true;
+    }
+
+
+#pragma mark - APPLYING DELTAS:
+
+
+    /*static*/ alloc_slice FleeceDelta::apply(const Value *old, slice fleeceDelta) {
+        const Value *delta = Value::fromData(fleeceDelta);
+        throwIf(!delta, InvalidData, "Invalid Fleece data in delta");
+        Encoder enc;
+        apply(old, delta, enc);
+        return enc.finish();
+    }
+
+
+    /*static*/ void FleeceDelta::apply(const Value *old, const Value *delta, Encoder &enc) {
+        FleeceDelta(enc)._apply(old, delta);
+    }
+
+
+    // Recursively applies the delta to the value, going down into the tree
+    void FleeceDelta::_apply(const Value *old, const Value *delta) {
+        switch(delta->type()) {
+            case kArray:
+                _applyOp(old, (const Array*)delta);
+                break;
+            case kDict: {
+                auto deltaDict = (const Dict*)delta;
+                if (old && old->type() == kDict)
+                    _patchDict((const Dict*)old, deltaDict);
+                else if (deltaDict->empty() && old)
+                    _encoder.writeValue(old);
+                else
+                    FleeceException::_throw(InvalidData, "Invalid {...} in delta");
+                break;
+            }
+            default:
+                _encoder.writeValue(delta);
+                break;
+        }
+    }
+
+
+    void FleeceDelta::_applyOp(const Value *old, const Array *delta) {
+        const Value *opcode = delta->get(0);
+        throwIf(!opcode || !opcode->isInteger(), InvalidData, "Missing opcode in delta");
+        auto count = delta->count();
+        switch (opcode->asInt()) {
+            case kDeleteOp:
+                throwIf(!old || count != 1, InvalidData, "Invalid deletion in delta");
+                // 'undefined' in the context of a dict value means a deletion of a key
+                // inherited from the parent.
+                _encoder.writeValue(Value::kUndefinedValue);
+                break;
+            case kReplaceOp:
+                throwIf(count != 2, InvalidData, "Invalid replacement in delta");
+                _encoder.writeValue(delta->get(1));
+                break;
+            case kTextDiffOp: {
+                slice oldStr = old ? old->asString() : slice();
+                slice diff = delta->get(1) ? delta->get(1)->asString() : slice();
+                throwIf(!oldStr || diff.size == 0 || count != 2,
+                        InvalidData, "Invalid text diff in delta");
+                JSONDelta::applyStringDelta(oldStr, diff, _encoder);
+                break;
+            }
+            case kArrayPatchOp: {
+                auto oldArray = old ? old->asArray() : nullptr;
+                throwIf(!oldArray, InvalidData, "Invalid array patch in delta");
+                _patchArray(oldArray, delta);
+                break;
+            }
+            default:
+                FleeceException::_throw(InvalidData, "Unknown op in delta");
+        }
+    }
+
+
+    void FleeceDelta::_patchDict(const Dict* NONNULL old, const Dict* NONNULL delta) {
+        if (_encoder.valueIsInBase(old)) {
+            // If the old dict is in the base, we can create an inherited dict:
+            _encoder.beginDictionary(old);
+            for (Dict::iterator i(delta); i; ++i) {
+                slice key = i.keyString();
+                throwIf(!key, InvalidData, "Invalid key in delta");
+                _encoder.writeKey(key);
+                _apply(old->get(key), i.value());  // recurse into dict item!
+            }
+            _encoder.endDictionary();
+        } else {
+            // In the general case, have to write a new dict from scratch:
+            _encoder.beginDictionary();
+            // Process the unaffected, deleted, and modified keys:
+            unsigned deltaKeysUsed = 0;
+            for (Dict::iterator i(old); i; ++i) {
+                slice key = i.keyString();
+                const Value *valueDelta = delta->get(key);
+                if (valueDelta)
+                    ++deltaKeysUsed;
+                if (!isDeltaDeletion(valueDelta)) {                 // skip deletions
+                    _encoder.writeKey(key);
+                    if (valueDelta == nullptr)
+                        _encoder.writeValue(i.value());             // unaffected
+                    else
+                        _apply(i.value(), valueDelta);              // replaced/modified
+                }
+            }
+            // Now add the inserted keys:
+            if (deltaKeysUsed < delta->count()) {
+                for (Dict::iterator i(delta); i; ++i) {
+                    slice key = i.keyString();
+                    throwIf(!key, InvalidData, "Invalid key in delta");
+                    if (old->get(key) == nullptr) {
+                        _encoder.writeKey(key);
+                        _apply(nullptr, i.value());                 // recurse into insertion
+                    }
+                }
+            }
+            _encoder.endDictionary();
+        }
+    }
+
+
+    void FleeceDelta::_patchArray(const Array* NONNULL old, const Array* NONNULL delta) {
+        const uint32_t oldCount = old->count();
+        uint32_t pos = 0;
+        _encoder.beginArray();
+        Array::iterator i(delta);
+        for (++i; i; ++i) {                 // (skip the opcode)
+            const Value *op = i.value();
+            switch (op->type()) {
+                case kNumber: {
+                    int64_t n = op->asInt();
+                    int64_t remaining = oldCount - pos;
+                    throwIf(!op->isInteger() || n == 0 || n > remaining || n < -remaining,
+                            InvalidData, "Invalid count in array delta");
+                    if (n > 0) {
+                        for (uint32_t end = pos + uint32_t(n); pos < end; ++pos)
+                            _encoder.writeValue(old->get(pos));
+                    } else {
+                        pos += uint32_t(-n);
+                    }
+                    break;
+                }
+                case kDict:
+                    throwIf(pos >= oldCount, InvalidData, "Invalid patch in array delta");
+                    _apply(old->get(pos++), op);
+                    break;
+                case kArray: {
+                    auto args = (const Array*)op;
+                    auto opcode = args->get(0);
+                    throwIf(!opcode || !opcode->isInteger(), InvalidData,
+                            "Missing opcode in array delta");
+                    switch (opcode->asInt()) {
+                        case kInsertItemsOp: {
+                            Array::iterator j(args);
+                            for (++j; j; ++j)
+                                _encoder.writeValue(j.value());
+                            break;
+                        }
+                        case kCopyItemsOp: {
+                            auto index = args->get(1), count = args->get(2);
+                            throwIf(args->count() != 3 || !index->isInteger()
+                                        || !count->isInteger()
+                                        || index->asUnsigned() >= oldCount
+                                        || count->asUnsigned() == 0
+                                        || count->asUnsigned() > oldCount - index->asUnsigned(),
+                                    InvalidData, "Invalid item copy in array delta");
+                            auto start = uint32_t(index->asUnsigned());
+                            auto end = start + uint32_t(count->asUnsigned());
+                            for (auto k = start; k < end; ++k)
+                                _encoder.writeValue(old->get(k));
+                            break;
+                        }
+                        case kPatchItemOp:
+                            throwIf(pos >= oldCount || args->count() != 2,
+                                    InvalidData, "Invalid patch in array delta");
+                            _apply(old->get(pos++), args->get(1));
+                            break;
+                        default:
+                            FleeceException::_throw(InvalidData, "Unknown op in array delta");
+                    }
+                    break;
+                }
+                default:
+                    FleeceException::_throw(InvalidData, "Invalid op in array delta");
+            }
+        }
+        throwIf(pos != oldCount, InvalidData, "Length mismatch in array delta");
+        _encoder.endArray();
+    }
+
+
+    // Does this delta represent a deletion?
+    /*static*/ inline bool FleeceDelta::isDeltaDeletion(const Value *delta) {
+        if (!delta)
+            return false;
+        auto array = delta->asArray();
+        return array && array->count() == 1 && array->get(0)->isInteger()
+                     && array->get(0)->asInt() == kDeleteOp;
+    }
+
+} }
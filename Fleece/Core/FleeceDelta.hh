@@ -0,0 +1,76 @@
+//
+// FleeceDelta.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "FleeceImpl.hh"
+
+namespace fleece { namespace impl {
+
+    /** Creates and applies deltas in a binary format that is itself Fleece. They describe the
+        same changes as JSONDelta's, but with typed operations instead of JSON conventions, and
+        they're created and applied without any JSON being generated or parsed.
+        The format is described in Deltas.md. */
+    class FleeceDelta {
+    public:
+        /** Returns Fleece data that describes the changes to turn the value `old` into `nuu`.
+            If the values are equal, the delta is an empty dict (a no-op.) */
+        static alloc_slice create(const Value *old, const Value *nuu);
+
+        /** Writes a delta that describes the changes to turn the value `old` into `nuu`.
+            If the values are equal, writes an empty dict (a no-op delta) and returns false. */
+        static bool create(const Value *old, const Value *nuu, Encoder&);
+
+
+        /** Applies the Fleece-encoded delta created by `create` to the value `old` (which must be
+            equal to the `old` value originally passed to `create`) and returns a Fleece document
+            equal to the original `nuu` value.
+            If the delta is malformed or can't be applied to `old`, throws a FleeceException. */
+        static alloc_slice apply(const Value *old, slice fleeceDelta);
+
+        /** Applies a delta created by `create` to the value `old` (which must be equal to the
+            `old` value originally passed to `create`) and writes the corresponding `nuu` value
+            to the encoder.
+            If the delta is malformed or can't be applied to `old`, throws a FleeceException. */
+        static void apply(const Value *old, const Value* NONNULL delta, Encoder&);
+
+        /** Maximum number of item insertions + deletions that the array-diff algorithm will
+            look for (default 100.) If two arrays differ by more than that, or if this is 0, the
+            array delta just keeps or patches the items at each index. (This is separate from
+            JSONDelta's limit, since every reader of this format understands array diffs.) */
+        static unsigned gMaxArrayDiffEdits;
+
+    private:
+        struct pathItem;
+
+        explicit FleeceDelta(Encoder &enc)      :_encoder(enc) { }
+
+        bool _write(const Value *old, const Value *nuu, pathItem *path);
+        bool writeArrayDelta(const Array* NONNULL old, const Array* NONNULL nuu, pathItem *path);
+        void writePath(pathItem*);
+        void writeNoOp();
+
+        void _apply(const Value *old, const Value* NONNULL delta);
+        void _applyOp(const Value *old, const Array* NONNULL delta);
+        void _patchDict(const Dict* NONNULL old, const Dict* NONNULL delta);
+        void _patchArray(const Array* NONNULL old, const Array* NONNULL delta);
+        static bool isDeltaDeletion(const Value *delta);
+
+        Encoder &_encoder;
+    };
+
+} }
@@ -36,6 +36,14 @@
  0110wccc cccccccc...    array (c = 11-bit item count, if 2047 then count follows as varint;
                                 w = wide, if 1 then following values are 4 bytes wide, not 2)
  0111wccc cccccccc...    dictionary (same as array, but count refers to key/value pairs)
+ 01101111 11111111 10000000 11110000 11111111 11111111 00001111 tttttttt oooooooo cccc...
+                         typed array. The first 7 bytes are a wide array whose count is
+                                2047 + varint 0xFFFFF800 = 2^32-1, whose items could never fit
+                                in valid data, so older readers reject it as corrupt instead of
+                                misreading it. t = item type (see typedArrayType); o = offset of
+                                the first item from the start of the Value; the item count
+                                follows as a varint, then zero padding to align the items, then
+                                the LE items.
  1xoooooo oooooooo       pointer (x = external?, denotes ptr outside data to prev written data;
                                 o = BE unsigned offset in units of 2 bytes back, up to -32KB)
                                 NOTE: In a wide collection, offset field is 30 bits wide
@@ -73,6 +81,27 @@ namespace fleece { namespace impl { namespace internal {
         kSpecialValueTrue       = 0x08,       // 1000
     };
 
+    // Item types of a typed array (the byte following kTypedArrayHeader):
+    enum typedArrayType : uint8_t {
+        kTypedInt8 = 0,
+        kTypedInt16,
+        kTypedInt32,
+        kTypedInt64,
+        kTypedFloat32,
+        kTypedFloat64,
+        kNumTypedArrayTypes
+    };
+
+    // The fixed first bytes of a typed array (see above):
+    static const size_t kTypedArrayHeaderSize = 7;
+    static const uint8_t kTypedArrayHeader[kTypedArrayHeaderSize] =
+                                                {0x6F, 0xFF, 0x80, 0xF0, 0xFF, 0xFF, 0x0F};
+
+    static inline size_t typedArrayItemSize(typedArrayType t) {
+        static const uint8_t kSizes[kNumTypedArrayTypes] = {1, 2, 4, 8, 4, 8};
+        return kSizes[t];
+    }
+
     // Min/max length of string that will be considered for sharing
     // (not part of the format, just a heuristic used by the encoder & Obj-C decoder)
     static const size_t kMinSharedStringSize =  2;
@@ -23,6 +23,73 @@
 
 namespace fleece { namespace impl {
 
+#if !FL_USE_JSONSL
+
+    JSONConverter::JSONConverter(Encoder &e) noexcept
+    :_encoder(e),
+     _parser(e)
+    { }
+
+    JSONConverter::~JSONConverter() =default;
+
+    void JSONConverter::reset() {
+        _parser.reset();
+        _streaming = false;
+        _jsonError = JSONSL_ERROR_SUCCESS;
+        _errorPos = 0;
+    }
+
+    bool JSONConverter::encodeJSON(slice json) {
+        _input = json;
+        _streaming = false;
+        clearError();
+        return callParser([&]{return _parser.parse(json);});
+    }
+
+    bool JSONConverter::feed(slice chunk) {
+        if (!_streaming) {
+            _parser.reset();
+            _streaming = true;
+            clearError();
+        } else if (_jsonError) {
+            return false;
+        }
+        return callParser([&]{return _parser.feed(chunk);});
+    }
+
+    bool JSONConverter::finish() {
+        if (!_streaming && !feed(nullslice))
+            return false;
+        _streaming = false;
+        if (_jsonError)
+            return false;
+        return callParser([&]{return _parser.finish();});
+    }
+
+    // Calls the parser, turning its return value or exception into the converter's error state.
+    template <class FN>
+    bool JSONConverter::callParser(FN fn) noexcept {
+        try {
+            int err = fn();
+            if (err)
+                gotError(err, _parser.errorPos());
+        } catch (const FleeceException &x) {
+            gotException(x.code, x.what(), _parser.errorPos());
+        } catch (...) {
+            gotException(InternalError, "Unexpected C++ exception", _parser.errorPos());
+        }
+        return (_jsonError == JSONSL_ERROR_SUCCESS);
+    }
+
+    int JSONConverter::gotError(int err, size_t pos) noexcept {
+        _jsonError = err;
+        _errorPos = pos;
+        _errorCode = JSONError;
+        return 0;
+    }
+
+#else // FL_USE_JSONSL
+
     static int errorCallback(struct jsonsl_st * jsn,
                              jsonsl_error_t err,
                              struct jsonsl_state_st *state,
@@ -51,28 +118,15 @@ namespace fleece { namespace impl {
 
     void JSONConverter::reset() {
         jsonsl_reset(_jsn);
+        _streaming = false;
         _jsonError = JSONSL_ERROR_SUCCESS;
         _errorPos = 0;
     }
 
-    const char* JSONConverter::errorMessage() noexcept {
-        if (!_errorMessage.empty())
-            return _errorMessage.c_str();
-        else if (_jsonError == kErrExceptionThrown)
-            return "Unexpected C++ exception";
-        else if (_jsonError == kErrTruncatedJSON)
-            return "Truncated JSON";
-        else
-            return jsonsl_strerror((jsonsl_error_t)_jsonError);
-    }
-
 
     bool JSONConverter::encodeJSON(slice json) {
         _input = json;
-        _errorMessage.clear();
-        _errorCode = NoError;
-        _jsonError = JSONSL_ERROR_SUCCESS;
-        _errorPos = 0;
+        clearError();
 
         _jsn->data = this;
         _jsn->action_callback_PUSH = writePushCallback;
@@ -90,12 +144,19 @@ namespace fleece { namespace impl {
         return (_jsonError == JSONSL_ERROR_SUCCESS);
     }
 
-    /*static*/ alloc_slice JSONConverter::convertJSON(slice json, SharedKeys *sk) {
-        Encoder enc;
-        enc.setSharedKeys(sk);
-        JSONConverter cvt(enc);
-        throwIf(!cvt.encodeJSON(slice(json)), JSONError, cvt.errorMessage());
-        return enc.finish();
+    // jsonsl can parse incrementally, but `pop` needs the whole input, so just collect it:
+    bool JSONConverter::feed(slice chunk) {
+        if (!_streaming) {
+            _streamBuffer.clear();
+            _streaming = true;
+        }
+        _streamBuffer.append((const char*)chunk.buf, chunk.size);
+        return true;
+    }
+
+    bool JSONConverter::finish() {
+        _streaming = false;
+        return encodeJSON(slice(_streamBuffer));
     }
 
     inline void JSONConverter::push(struct jsonsl_state_st *state) {
@@ -133,30 +194,24 @@ namespace fleece { namespace impl {
             case JSONSL_T_HKEY: {
                 slice str(&_input[state->pos_begin + 1],
                           state->pos_cur - state->pos_begin - 1);
-                char *buf = nullptr;
-                bool mallocedBuf = false;
                 if (state->nescapes > 0) {
-                    // De-escape str:
-                    mallocedBuf = str.size > 100;
-                    buf = (char*)(mallocedBuf ? malloc(str.size) : alloca(str.size));
+                    // De-escape str into the scratch buffer (unescaping never lengthens it):
+                    if (_scratch.size() < str.size)
+                        _scratch.resize(str.size);
                     jsonsl_error_t err = JSONSL_ERROR_SUCCESS;
                     const char *errat;
-                    auto size = jsonsl_util_unescape_ex((const char*)str.buf, buf, str.size,
-                                                        nullptr, nullptr, &err, &errat);
+                    auto size = jsonsl_util_unescape_ex((const char*)str.buf, &_scratch[0],
+                                                        str.size, nullptr, nullptr, &err, &errat);
                     if (err) {
                         errorCallback(_jsn, err, state, (char*)errat);
-                        if (mallocedBuf)
-                            free(buf);
                         return;
                     }
-                    str = slice(buf, size);
+                    str = slice(_scratch.data(), size);
                 }
                 if (state->type == JSONSL_T_STRING)
                     _encoder.writeString(str);
                 else
                     _encoder.writeKey(str);
-                if (mallocedBuf)
-                    free(buf);
                 break;
             }
             case JSONSL_T_LIST:
@@ -180,12 +235,6 @@ namespace fleece { namespace impl {
         return gotError(err, errat ? (errat - (char*)_input.buf) : 0);
     }
 
-    void JSONConverter::gotException(ErrorCode code, const char *what, size_t pos) noexcept {
-        gotError(kErrExceptionThrown, pos);
-        _errorCode = code;
-        _errorMessage = what;
-    }
-
     // Callbacks:
 
     static inline JSONConverter* converter(jsonsl_t jsn) noexcept {
@@ -228,4 +277,39 @@ namespace fleece { namespace impl {
         return converter(jsn)->gotError(err, errat);
     }
 
+#endif // FL_USE_JSONSL
+
+
+    void JSONConverter::clearError() noexcept {
+        _errorMessage.clear();
+        _errorCode = NoError;
+        _jsonError = JSONSL_ERROR_SUCCESS;
+        _errorPos = 0;
+    }
+
+    const char* JSONConverter::errorMessage() noexcept {
+        if (!_errorMessage.empty())
+            return _errorMessage.c_str();
+        else if (_jsonError == kErrExceptionThrown)
+            return "Unexpected C++ exception";
+        else if (_jsonError == kErrTruncatedJSON)
+            return "Truncated JSON";
+        else
+            return jsonsl_strerror((jsonsl_error_t)_jsonError);
+    }
+
+    void JSONConverter::gotException(ErrorCode code, const char *what, size_t pos) noexcept {
+        gotError(kErrExceptionThrown, pos);
+        _errorCode = code;
+        _errorMessage = what;
+    }
+
+    /*static*/ alloc_slice JSONConverter::convertJSON(slice json, SharedKeys *sk) {
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        JSONConverter cvt(enc);
+        throwIf(!cvt.encodeJSON(slice(json)), JSONError, cvt.errorMessage());
+        return enc.finish();
+    }
+
 } }
@@ -21,13 +21,21 @@
 #include "Encoder.hh"
 #include "Doc.hh"
 #include "FleeceException.hh"
+#include "JSONParser.hh"
 #include "fleece/slice.hh"
 #include <map>
 
+// Define FL_USE_JSONSL as 1 to parse with the jsonsl library instead of JSONParser.
+#ifndef FL_USE_JSONSL
+    #define FL_USE_JSONSL 0
+#endif
+
+#if FL_USE_JSONSL
 extern "C" {
     struct jsonsl_state_st;
     struct jsonsl_st;
 }
+#endif
 
 namespace fleece { namespace impl {
 
@@ -41,6 +49,16 @@ namespace fleece { namespace impl {
             @return  True if parsing succeeded, false if the JSON is invalid. */
         bool encodeJSON(slice json);
 
+        /** Parses the next chunk of JSON data, for when the JSON arrives incrementally (as from
+            a socket.) A chunk can end anywhere, even in the middle of a string or number. Values
+            are written to the encoder as they're completed. Call `finish` after the last chunk.
+            @return  False if the JSON is already known to be invalid. */
+        bool feed(slice chunk);
+
+        /** Call this after the last call to `feed`.
+            @return  True if parsing succeeded, false if the JSON is invalid or incomplete. */
+        bool finish();
+
         /** See jsonsl_error_t for error codes, plus a few more defined below. */
         int jsonError() noexcept                {return _jsonError;}
         ErrorCode errorCode() noexcept          {return _errorCode;}
@@ -62,18 +80,31 @@ namespace fleece { namespace impl {
         static alloc_slice convertJSON(slice json, SharedKeys *sk =nullptr);
 
     //private:
+#if FL_USE_JSONSL
         void push(struct jsonsl_state_st *state NONNULL);
         void pop(struct jsonsl_state_st *state NONNULL);
-        int gotError(int err, size_t pos) noexcept;
         int gotError(int err, const char *errat) noexcept;
+#endif
+        int gotError(int err, size_t pos) noexcept;
+        void clearError() noexcept;
+#if !FL_USE_JSONSL
+        template <class FN> bool callParser(FN) noexcept;
+#endif
         void gotException(ErrorCode code, const char *what NONNULL, size_t pos) noexcept;
 
     private:
         typedef std::map<size_t, uint64_t> startToLengthMap;
 
         Encoder &_encoder;                  // encoder to write to
+#if FL_USE_JSONSL
         struct jsonsl_st * _jsn {nullptr};  // JSON parser
-        int _jsonError {0};                 // Parse error from jsonsl
+        std::string _streamBuffer;          // Input collected by `feed`
+        std::string _scratch;               // Reusable buffer for unescaping strings
+#else
+        JSONParser _parser;                 // JSON parser
+#endif
+        bool _streaming {false};            // True between the first `feed` and `finish`
+        int _jsonError {0};                 // Parse error (a jsonsl_error_t or one of the above)
         ErrorCode _errorCode {NoError};
         std::string _errorMessage;
         size_t _errorPos {0};               // Byte index where parse error occurred
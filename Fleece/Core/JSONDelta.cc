@@ -22,9 +22,11 @@
 #include "JSONConverter.hh"
 #include "JSON5.hh"
 #include "FleeceException.hh"
+#include "NumConversion.hh"
 #include "TempArray.hh"
 #include "diff_match_patch.hh"
-#include <sstream>
+#include <algorithm>
+#include <unordered_map>
 #include <unordered_set>
 #include "betterassert.hh"
 
@@ -41,11 +43,17 @@ namespace fleece { namespace impl {
 
     float JSONDelta::gTextDiffTimeout = 0.25;
 
+    unsigned JSONDelta::gMaxTextDiffEdits = 500;
+
+    unsigned JSONDelta::gMaxArrayDiffEdits = 0;
+
     // Codes that appear as the 3rd item of an array item in a diff
     enum {
         kDeletionCode = 0,
         kTextDiffCode = 2,
         kArraymoveCode = 3,
+        kArrayDiffCode = 4,
+        kSequenceCode = 5,
     };
 
 
@@ -56,7 +64,9 @@ namespace fleece { namespace impl {
     }
 
 
-    static void snapToUTF8Character(long &pos, size_t &length, slice str);
+    static inline bool isDigit(uint8_t c) {
+        return c >= '0' && c <= '9';
+    }
 
 
 #pragma mark - CREATING DELTAS:
@@ -105,6 +115,69 @@ namespace fleece { namespace impl {
     }
 
 
+    // Compares two dict keys in the order they're stored in: integer (shared) keys first.
+    static inline int compareDictKeys(const Value *key1, const Value *key2) {
+        bool int1 = key1->isInteger(), int2 = key2->isInteger();
+        if (int1 != int2)
+            return int1 ? -1 : 1;
+        else if (int1)
+            return int(key1->asInt() - key2->asInt());
+        else
+            return key1->asString().compare(key2->asString());
+    }
+
+
+    /*static*/ void JSONDelta::diffDicts(const Dict *oldDict, const Dict *nuuDict,
+                                         DictDiffCallback changed)
+    {
+        Dict::iterator i_old(oldDict), i_nuu(nuuDict);
+        if (!oldDict->isMutable() && !nuuDict->isMutable()
+                && !(i_old && i_old.key()->isInteger() && i_nuu && i_nuu.key()->isInteger()
+                     && oldDict->sharedKeys() != nuuDict->sharedKeys())) {
+            // Both dicts' keys are sorted the same way, so walk them in parallel. A key that
+            // appears in only one of them is looked up in the other, in case it's encoded
+            // differently there (e.g. as a string in one and a shared key in the other):
+            while (i_old || i_nuu) {
+                int cmp = !i_old ? 1 : (!i_nuu ? -1 : compareDictKeys(i_old.key(), i_nuu.key()));
+                if (cmp == 0) {
+                    changed(i_nuu.keyString(), i_old.value(), i_nuu.value());
+                    ++i_old;
+                    ++i_nuu;
+                } else if (cmp < 0) {
+                    slice key = i_old.keyString();
+                    if (nuuDict->get(key) == nullptr)
+                        changed(key, i_old.value(), nullptr);
+                    ++i_old;
+                } else {
+                    slice key = i_nuu.keyString();
+                    changed(key, oldDict->get(key), i_nuu.value());
+                    ++i_nuu;
+                }
+            }
+            return;
+        }
+
+        // Otherwise look up each key in the other dict:
+        unsigned oldKeysSeen = 0;
+        // Iterate all the new & maybe-changed keys:
+        for (; i_nuu; ++i_nuu) {
+            slice key = i_nuu.keyString();
+            auto oldValue = oldDict->get(key);
+            if (oldValue)
+                ++oldKeysSeen;
+            changed(key, oldValue, i_nuu.value());
+        }
+        // Iterate all the deleted keys:
+        if (oldKeysSeen < oldDict->count()) {
+            for (; i_old; ++i_old) {
+                slice key = i_old.keyString();
+                if (nuuDict->get(key) == nullptr)
+                    changed(key, i_old.value(), nullptr);
+            }
+        }
+    }
+
+
     // Main encoder function. Called recursively, traversing the hierarchy.
     bool JSONDelta::_write(const Value *old, const Value *nuu, pathItem *path) {
         if (_usuallyFalse(old == nuu))
@@ -127,51 +200,38 @@ namespace fleece { namespace impl {
             if (oldType == nuuType) {
                 if (oldType == kDict) {
                     // Possibly-modified dict: write a dict with the modified keys
-                    auto oldDict = (const Dict*)old, nuuDict = (const Dict*)nuu;
                     pathItem curLevel = {path, false, nullslice};
-                    unsigned oldKeysSeen = 0;
-                    // Iterate all the new & maybe-changed keys:
-                    for (Dict::iterator i_nuu(nuuDict); i_nuu; ++i_nuu) {
-                        slice key = i_nuu.keyString();
-                        auto oldValue = oldDict->get(key);
-                        if (oldValue)
-                            ++oldKeysSeen;
+                    diffDicts((const Dict*)old, (const Dict*)nuu,
+                              [&](slice key, const Value *oldValue, const Value *nuuValue) {
                         curLevel.key = key;
-                        _write(oldValue, i_nuu.value(), &curLevel);
-                    }
-                    // Iterate all the deleted keys:
-                    if (oldKeysSeen < oldDict->count()) {
-                        for (Dict::iterator i_old(oldDict); i_old; ++i_old) {
-                            slice key = i_old.keyString();
-                            if (nuuDict->get(key) == nullptr) {
-                                curLevel.key = key;
-                                _write(i_old.value(), nullptr, &curLevel);
-                            }
-                        }
-                    }
+                        _write(oldValue, nuuValue, &curLevel);
+                    });
                     if (!curLevel.isOpen)
                         return false;
                     _encoder->endDictionary();
                     return true;
 
                 } else if (oldType == kArray) {
-                    // Scan forwards through unchanged items:
                     auto oldArray = (const Array*)old, nuuArray = (const Array*)nuu;
+                    if (gMaxArrayDiffEdits > 0 && !gCompatibleDeltas
+                            && writeArrayDiff(oldArray, nuuArray, path))
+                        return true;
+                    // Scan forwards through unchanged items:
                     auto oldCount = oldArray->count(), nuuCount = nuuArray->count();
                     auto minCount = min(oldCount, nuuCount);
                     if (minCount > 0) {
                         pathItem curLevel = {path, false, nullslice};
                         uint32_t index = 0;
-                        char key[10];
+                        char key[kMaxIntStringSize + 1];
                         for (Array::iterator iOld(oldArray), iNew(nuuArray); index < minCount;
                              ++iOld, ++iNew, ++index) {
-                            sprintf(key, "%d", index);
-                            curLevel.key = slice(key);
+                            curLevel.key = slice(key, WriteUInt(index, key));
                             _write(iOld.value(), iNew.value(), &curLevel);
                         }
                         if (oldCount != nuuCount) {
-                            sprintf(key, "%d-", index);
-                            curLevel.key = slice(key);
+                            size_t keyLen = WriteUInt(index, key);
+                            key[keyLen++] = '-';
+                            curLevel.key = slice(key, keyLen);
                             writePath(&curLevel);
                             _encoder->beginArray();
                             for (; index < nuuCount; ++index) {
@@ -193,11 +253,13 @@ namespace fleece { namespace impl {
 
                 } else if (oldType == kString && nuuType == kString) {
                     // Strings: Try to use smart text diff
-                    string strPatch = createStringDelta(old->asString(), nuu->asString());
-                    if (!strPatch.empty()) {
+                    slice nuuStr = nuu->asString();
+                    TempArray(strPatch, char, nuuStr.size);
+                    size_t patchSize = createStringDelta(old->asString(), nuuStr, strPatch);
+                    if (patchSize > 0) {
                         writePath(path);
                         _encoder->beginArray();
-                        _encoder->writeString(strPatch);
+                        _encoder->writeString(slice(strPatch, patchSize));
                         _encoder->writeInt(0);
                         _encoder->writeInt(kTextDiffCode);
                         _encoder->endArray();
@@ -223,6 +285,323 @@ namespace fleece { namespace impl {
     }
 
 
+#pragma mark - ARRAY DIFFS:
+
+
+    // An array diff is written as `[ops, 0, 4]`, where `ops` is an array of operations that are
+    // applied in order to consecutive items of the old array, much like a string diff:
+    //   n          — the next n old items are kept (copied to the new array)
+    //   -n         — the next n old items are deleted (skipped)
+    //   [v, ...]   — the values are inserted
+    //   "@i" or "@i:n" — the old item at index i (or n items starting there) is inserted;
+    //                this describes an item that moved, without repeating its value
+    //   {...}      — the next old item, a dict, is replaced by applying this dict delta to it
+
+
+    enum EditOp : uint8_t {kKeep, kDelete, kInsert};
+
+    // Finds a shortest edit script that turns the sequence `a` into `b`, using Myers' O(ND)
+    // algorithm <http://www.xmailserver.org/diff2.pdf>. Gives up and returns false if that would
+    // take more than `maxEdits` insertions + deletions. (Array diffs compare the items' hashes;
+    // string diffs compare bytes.)
+    template <class T>
+    static bool diffSequences(const T *a, long n, const T *b, long m,
+                              long maxEdits, vector<EditOp> &script)
+    {
+        const long maxD = min(n + m, maxEdits);
+        const long offset = maxD + 1;
+        vector<long> v(2 * maxD + 3, 0);        // v[offset+k] is furthest x on diagonal k
+        vector<long> trace;                     // diagonals -d...d of `v` before step d, at d*d
+        for (long d = 0; d <= maxD; ++d) {
+            trace.insert(trace.end(), &v[offset-d], &v[offset+d+1]);
+            for (long k = -d; k <= d; k += 2) {
+                long x;
+                if (k == -d || (k != d && v[offset+k-1] < v[offset+k+1]))
+                    x = v[offset+k+1];          // move down (insertion)
+                else
+                    x = v[offset+k-1] + 1;      // move right (deletion)
+                long y = x - k;
+                while (x < n && y < m && a[x] == b[y]) {
+                    ++x;
+                    ++y;
+                }
+                v[offset+k] = x;
+                if (x >= n && y >= m) {
+                    // Done! Now backtrack through the trace to recover the path:
+                    script.clear();
+                    for (x = n, y = m; d > 0; --d) {
+                        const long *vd = &trace[d * d + d];     // vd[k] is v[offset+k]
+                        k = x - y;
+                        long prevK = (k == -d || (k != d && vd[k-1] < vd[k+1])) ? k + 1 : k - 1;
+                        long prevX = vd[prevK], prevY = prevX - prevK;
+                        for (; x > prevX && y > prevY; --x, --y)
+                            script.push_back(kKeep);
+                        script.push_back(x == prevX ? kInsert : kDelete);
+                        x = prevX;
+                        y = prevY;
+                    }
+                    script.insert(script.end(), x, kKeep);  // leading run of matches
+                    reverse(script.begin(), script.end());
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+
+    static vector<ContentHash> hashItems(const Array *array) {
+        vector<ContentHash> hashes;
+        hashes.reserve(array->count());
+        for (Array::iterator i(array); i; ++i)
+            hashes.push_back(i.value()->contentHash());
+        return hashes;
+    }
+
+
+    // Is this item big enough that a moved copy of it is worth encoding as a "@i" reference?
+    static bool worthCopying(const Value *item) {
+        switch (item->type()) {
+            case kArray:
+            case kDict:     return true;
+            case kString:
+            case kData:     return item->asString().size >= 8;
+            default:        return false;
+        }
+    }
+
+
+    // Writes the operations of an array diff, coalescing consecutive ones of the same kind.
+    class ArrayDiffWriter {
+    public:
+        explicit ArrayDiffWriter(JSONEncoder &enc)      :_enc(enc) { }
+
+        void keep(size_t n)                 {if (n) {setMode(kKeepOps); _count += n;}}
+        void remove(size_t n)               {if (n) {setMode(kRemoveOps); _count += n;}}
+        void insert(const Value *item)      {setMode(kInsertOps); _enc.writeValue(item);}
+        void patch()                        {flush();}
+
+        void copy(size_t oldIndex) {
+            if (_mode == kCopyOps && oldIndex == _copyStart + _count) {
+                ++_count;
+            } else {
+                setMode(kCopyOps);
+                _copyStart = oldIndex;
+                _count = 1;
+            }
+        }
+
+        void flush() {
+            switch (_mode) {
+                case kKeepOps:      _enc.writeUInt(_count); break;
+                case kRemoveOps:    _enc.writeInt(-int64_t(_count)); break;
+                case kInsertOps:    _enc.endArray(); break;
+                case kCopyOps: {
+                    char str[2 * kMaxIntStringSize + 2];
+                    size_t len = 0;
+                    str[len++] = '@';
+                    len += WriteUInt(_copyStart, &str[len]);
+                    if (_count > 1) {
+                        str[len++] = ':';
+                        len += WriteUInt(_count, &str[len]);
+                    }
+                    _enc.writeString(slice(str, len));
+                    break;
+                }
+                case kNoOps:        break;
+            }
+            _mode = kNoOps;
+            _count = 0;
+        }
+
+    private:
+        enum Mode {kNoOps, kKeepOps, kRemoveOps, kInsertOps, kCopyOps};
+
+        void setMode(Mode mode) {
+            if (mode != _mode || mode == kCopyOps) {
+                flush();
+                _mode = mode;
+                if (mode == kInsertOps)
+                    _enc.beginArray();
+            }
+        }
+
+        JSONEncoder &_enc;
+        Mode _mode {kNoOps};
+        size_t _count {0};
+        size_t _copyStart {0};
+    };
+
+
+    // Plans how to turn one array into another, as a sequence of ArrayEdits. Returns false if
+    // `positionalFallback` is false and the arrays are best described position by position (no
+    // item changed its position), or are too different to diff within `maxEdits`.
+    // If `positionalFallback` is true, in those cases it plans a positional edit instead: each
+    // old item is kept or patched, followed by removing or inserting the ones past the end.
+    /*static*/ bool JSONDelta::planArrayDiff(const Array *oldArray, const Array *nuuArray,
+                                             unsigned maxEdits, bool positionalFallback,
+                                             vector<ArrayEdit> &plan)
+    {
+        plan.clear();
+        const long oldCount = oldArray->count(), nuuCount = nuuArray->count();
+        vector<ContentHash> oldHashes = hashItems(oldArray), nuuHashes = hashItems(nuuArray);
+
+        // Trim the common prefix and suffix, which don't need diffing:
+        long minCount = min(oldCount, nuuCount), prefix = 0, suffix = 0;
+        while (prefix < minCount && oldHashes[prefix] == nuuHashes[prefix])
+            ++prefix;
+        while (suffix < minCount - prefix
+                    && oldHashes[oldCount-1-suffix] == nuuHashes[nuuCount-1-suffix])
+            ++suffix;
+
+        vector<EditOp> script(prefix, kKeep);
+        bool diffed = false;
+        if (suffix > 0 || (prefix < oldCount && prefix < nuuCount)) {  // not just append/truncate
+            vector<EditOp> middle;
+            if (maxEdits > 0 && diffSequences(&oldHashes[prefix],
+                                              oldCount - prefix - suffix,
+                                              &nuuHashes[prefix],
+                                              nuuCount - prefix - suffix,
+                                              maxEdits, middle)) {
+                // Use the diff unless nothing moved, in which case positional is as good:
+                diffed = (suffix > 0 && oldCount != nuuCount)
+                      || find(middle.begin(), middle.end(), kKeep) != middle.end();
+                if (diffed) {
+                    script.insert(script.end(), middle.begin(), middle.end());
+                    script.insert(script.end(), suffix, kKeep);
+                }
+            }
+        }
+
+        // Verify the matches, just in case of a hash collision, and look for deleted items that
+        // could be copied to where they were re-inserted:
+        unordered_map<uint64_t, uint32_t> deletedItems;
+        long o = 0, n = 0;
+        for (size_t i = 0; diffed && i < script.size(); ++i) {
+            switch (script[i]) {
+                case kKeep:
+                    if (_usuallyFalse(!oldArray->get(uint32_t(o))->isEqual(
+                                                                nuuArray->get(uint32_t(n)))))
+                        diffed = false;
+                    ++o; ++n;
+                    break;
+                case kDelete:
+                    if (worthCopying(oldArray->get(uint32_t(o))))
+                        deletedItems.emplace(oldHashes[o].lo, uint32_t(o));
+                    ++o;
+                    break;
+                case kInsert:
+                    ++n;
+                    break;
+            }
+        }
+
+        auto addKeep = [&](uint32_t count) {
+            if (!plan.empty() && plan.back().op == ArrayEdit::kKeep)
+                plan.back().count += count;
+            else
+                plan.push_back({ArrayEdit::kKeep, 0, 0, count});
+        };
+
+        if (!diffed) {
+            if (!positionalFallback)
+                return false;
+            for (long i = 0; i < minCount; ++i) {
+                if (oldHashes[i] == nuuHashes[i] && oldArray->get(uint32_t(i))->isEqual(
+                                                                nuuArray->get(uint32_t(i))))
+                    addKeep(1);
+                else
+                    plan.push_back({ArrayEdit::kPatch, uint32_t(i), uint32_t(i), 1});
+            }
+            if (oldCount > nuuCount)
+                plan.push_back({ArrayEdit::kRemove, 0, 0, uint32_t(oldCount - nuuCount)});
+            for (long i = minCount; i < nuuCount; ++i)
+                plan.push_back({ArrayEdit::kInsert, 0, uint32_t(i), 1});
+            return true;
+        }
+
+        // Convert the script to a plan:
+        o = n = 0;
+        for (size_t i = 0; i < script.size(); ) {
+            if (script[i] == kKeep) {
+                size_t run = 0;
+                for (; i < script.size() && script[i] == kKeep; ++i)
+                    ++run;
+                addKeep(uint32_t(run));
+                o += run;
+                n += run;
+                continue;
+            }
+            // A "hunk" of deletions and insertions between two runs of kept items:
+            long o0 = o, n0 = n;
+            for (; i < script.size() && script[i] != kKeep; ++i)
+                (script[i] == kDelete) ? ++o : ++n;
+            long patched = 0;
+            for (long j = n0; j < n; ++j) {
+                auto item = nuuArray->get(uint32_t(j));
+                if (!deletedItems.empty()) {
+                    auto src = deletedItems.find(nuuHashes[j].lo);
+                    if (src != deletedItems.end() && oldHashes[src->second] == nuuHashes[j]
+                                && oldArray->get(src->second)->isEqual(item)) {
+                        plan.push_back({ArrayEdit::kCopy, src->second, uint32_t(j), 1});
+                        continue;
+                    }
+                }
+                if (o0 + patched < o) {
+                    auto oldItem = oldArray->get(uint32_t(o0 + patched));
+                    if (oldItem->type() == kDict && item->type() == kDict) {
+                        // Describe the change to a dict as a delta instead of replacing it:
+                        plan.push_back({ArrayEdit::kPatch, uint32_t(o0 + patched), uint32_t(j), 1});
+                        ++patched;
+                        continue;
+                    }
+                }
+                plan.push_back({ArrayEdit::kInsert, 0, uint32_t(j), 1});
+            }
+            if (o - o0 > patched)
+                plan.push_back({ArrayEdit::kRemove, 0, 0, uint32_t(o - o0 - patched)});
+        }
+        return true;
+    }
+
+
+    // Tries to describe the changes to an array as an edit script, which represents insertions,
+    // deletions and moves far more compactly than the index-by-index form. Returns false, having
+    // written nothing, if the index-by-index form would do as well.
+    bool JSONDelta::writeArrayDiff(const Array *oldArray, const Array *nuuArray, pathItem *path) {
+        vector<ArrayEdit> plan;
+        if (!planArrayDiff(oldArray, nuuArray, gMaxArrayDiffEdits, false, plan))
+            return false;
+
+        writePath(path);
+        _encoder->beginArray();
+        _encoder->beginArray();
+        ArrayDiffWriter ops(*_encoder);
+        for (auto &edit : plan) {
+            switch (edit.op) {
+                case ArrayEdit::kKeep:      ops.keep(edit.count); break;
+                case ArrayEdit::kRemove:    ops.remove(edit.count); break;
+                case ArrayEdit::kInsert:    ops.insert(nuuArray->get(edit.nuuIndex)); break;
+                case ArrayEdit::kCopy:      ops.copy(edit.oldIndex); break;
+                case ArrayEdit::kPatch:
+                    ops.patch();
+                    if (!_write(oldArray->get(edit.oldIndex), nuuArray->get(edit.nuuIndex),
+                                nullptr)) {
+                        _encoder->beginDictionary();    // no difference after all: no-op patch
+                        _encoder->endDictionary();
+                    }
+                    break;
+            }
+        }
+        ops.flush();
+        _encoder->endArray();
+        _encoder->writeInt(0);
+        _encoder->writeInt(kArrayDiffCode);
+        _encoder->endArray();
+        return true;
+    }
+
+
 #pragma mark - APPLYING DELTAS:
 
 
@@ -235,15 +614,9 @@ namespace fleece { namespace impl {
 
     /*static*/ void JSONDelta::apply(const Value *old, slice jsonDelta, bool isJSON5, Encoder &enc) {
         assert(jsonDelta);
-        string json5;
-        if (isJSON5) {
-            json5 = ConvertJSON5(string(jsonDelta));
-            jsonDelta = slice(json5);
-        }
-
         // Parse JSON delta to Fleece using same SharedKeys as `old`:
         auto sk = old->sharedKeys();
-        alloc_slice fleeceData = JSONConverter::convertJSON(jsonDelta, sk);
+        alloc_slice fleeceData = parseDelta(jsonDelta, isJSON5, sk);
         Scope scope(fleeceData, sk);
         const Value *fleeceDelta = Value::fromTrustedData(fleeceData);
 
@@ -251,6 +624,18 @@ namespace fleece { namespace impl {
     }
 
 
+    /*static*/ alloc_slice JSONDelta::parseDelta(slice jsonDelta, bool isJSON5, SharedKeys *sk) {
+        if (isJSON5) {
+            Encoder deltaEnc(jsonDelta.size);
+            deltaEnc.setSharedKeys(sk);
+            ConvertJSON5(jsonDelta, deltaEnc);
+            return deltaEnc.finish();
+        } else {
+            return JSONConverter::convertJSON(jsonDelta, sk);
+        }
+    }
+
+
     JSONDelta::JSONDelta(Encoder &decoder)
     :_decoder(&decoder)
     { }
@@ -311,6 +696,16 @@ namespace fleece { namespace impl {
                         throwIf(!old, InvalidData, "Invalid deletion in delta");
                         _decoder->writeValue(Value::kUndefinedValue);
                         break;
+                    case kArrayDiffCode:
+                        _applyArrayDiff(old, delta->get(0)->asArray());
+                        break;
+                    case kSequenceCode: {
+                        auto deltas = delta->get(0)->asArray();
+                        throwIf(!deltas || deltas->empty(), InvalidData,
+                                "Invalid delta sequence in delta");
+                        _applySequence(old, deltas, 0);
+                        break;
+                    }
                     case kTextDiffCode: {
                         // Text diff:
                         slice oldStr;
@@ -319,8 +714,7 @@ namespace fleece { namespace impl {
                         throwIf(!oldStr, InvalidData, "Invalid text replace in delta");
                         slice diff = delta->get(0)->asString();
                         throwIf(diff.size == 0, InvalidData, "Invalid text diff in delta");
-                        auto nuuStr = applyStringDelta(oldStr, diff);
-                        _decoder->writeString(nuuStr);
+                        applyStringDelta(oldStr, diff, *_decoder);
                         break;
                     }
                     default:
@@ -334,14 +728,84 @@ namespace fleece { namespace impl {
     }
 
 
+    // Parses an array diff's "@i" or "@i:n" reference to items of the old array.
+    static bool parseItemRef(slice ref, uint64_t &index, uint64_t &count) {
+        index = count = 0;
+        bool ok = (ref.size >= 2 && ref.size <= 22 && ref[0] == '@');
+        size_t c = 1;
+        for (; ok && c < ref.size && isDigit(ref[c]); ++c)
+            index = 10 * index + (ref[c] - '0');
+        if (ok && c < ref.size && ref[c] == ':') {
+            for (++c; c < ref.size && isDigit(ref[c]); ++c)
+                count = 10 * count + (ref[c] - '0');
+        } else {
+            count = 1;
+        }
+        return ok && c == ref.size && count > 0;
+    }
+
+
+    // Applies an array diff (see "ARRAY DIFFS" above.)
+    void JSONDelta::_applyArrayDiff(const Value *old, const Array *ops) {
+        auto oldArray = old ? old->asArray() : nullptr;
+        throwIf(!oldArray || !ops, InvalidData, "Invalid array diff in delta");
+        const uint32_t oldCount = oldArray->count();
+        uint32_t pos = 0;
+        _decoder->beginArray();
+        for (Array::iterator i(ops); i; ++i) {
+            const Value *op = i.value();
+            switch (op->type()) {
+                case kNumber: {
+                    int64_t n = op->asInt();
+                    int64_t remaining = oldCount - pos;
+                    throwIf(!op->isInteger() || n == 0 || n > remaining || n < -remaining,
+                            InvalidData, "Invalid count in array delta");
+                    if (n > 0) {
+                        for (uint32_t end = pos + uint32_t(n); pos < end; ++pos)
+                            _decoder->writeValue(oldArray->get(pos));
+                    } else {
+                        pos += uint32_t(-n);
+                    }
+                    break;
+                }
+                case kArray:
+                    for (Array::iterator j((const Array*)op); j; ++j)
+                        _decoder->writeValue(j.value());
+                    break;
+                case kString: {
+                    // "@i" or "@i:n": copy items from elsewhere in the old array
+                    uint64_t index, count;
+                    throwIf(!parseItemRef(op->asString(), index, count)
+                                || index >= oldCount || count > oldCount - index,
+                            InvalidData, "Invalid item reference in array delta");
+                    for (uint64_t end = index + count; index < end; ++index)
+                        _decoder->writeValue(oldArray->get(uint32_t(index)));
+                    break;
+                }
+                case kDict:
+                    throwIf(pos >= oldCount, InvalidData, "Invalid patch in array delta");
+                    _apply(oldArray->get(pos++), op);
+                    break;
+                default:
+                    FleeceException::_throw(InvalidData, "Invalid op in array delta");
+            }
+        }
+        throwIf(pos != oldCount, InvalidData, "Length mismatch in array delta");
+        _decoder->endArray();
+    }
+
+
     inline void JSONDelta::_patchDict(const Dict* NONNULL old, const Dict* NONNULL delta) {
         // Dict: Incremental update
         if (_decoder->valueIsInBase(old)) {
             // If the old dict is in the base, we can create an inherited dict:
             _decoder->beginDictionary(old);
             for (Dict::iterator i(delta); i; ++i) {
+                auto oldValue = old->get(i.key());
+                if (!oldValue && isDeltaDeletion(i.value()))
+                    continue;                   // deleting a nonexistent key is a no-op
                 _decoder->writeKey(i.keyString());
-                _apply(old->get(i.key()), i.value());  // recurse into dict item!
+                _apply(oldValue, i.value());  // recurse into dict item!
             }
             _decoder->endDictionary();
         } else {
@@ -365,7 +829,7 @@ namespace fleece { namespace impl {
             // Now add the inserted keys:
             if (deltaKeysUsed < delta->count()) {
                 for (Dict::iterator i(delta); i; ++i) {
-                    if (old->get(i.key()) == nullptr) {
+                    if (old->get(i.key()) == nullptr && !isDeltaDeletion(i.value())) {
                         _decoder->writeKey(i.keyString());
                         _apply(nullptr, i.value());  // recurse into insertion
                     }
@@ -383,15 +847,15 @@ namespace fleece { namespace impl {
         const Value *remainder = nullptr;
         for (Array::iterator iOld(old); iOld; ++iOld, ++index) {
             auto oldItem = iOld.value();
-            char key[10];
-            sprintf(key, "%d", index);
-            auto replacement = delta->get(slice(key));
+            char key[kMaxIntStringSize + 1];
+            size_t keyLen = WriteUInt(index, key);
+            auto replacement = delta->get(slice(key, keyLen));
             if (replacement) {
                 // Patch this array item:
                 _apply(oldItem, replacement);
             } else {
-                strcat(key, "-");
-                remainder = delta->get(slice(key));
+                key[keyLen++] = '-';
+                remainder = delta->get(slice(key, keyLen));
                 if (remainder) {
                     break;
                 } else {
@@ -402,9 +866,10 @@ namespace fleece { namespace impl {
         }
 
         if (!remainder) {
-            char key[10];
-            sprintf(key, "%d-", old->count());
-            remainder = delta->get(slice(key));
+            char key[kMaxIntStringSize + 1];
+            size_t keyLen = WriteUInt(old->count(), key);
+            key[keyLen++] = '-';
+            remainder = delta->get(slice(key, keyLen));
         }
         if (remainder) {
             // Remainder of array is replaced by the array from the delta:
@@ -429,125 +894,988 @@ namespace fleece { namespace impl {
     }
 
 
-#pragma mark - STRING DELTAS:
+    // Does this delta replace the value regardless of its old state (or delete it)?
+    /*static*/ bool JSONDelta::isDeltaReplacement(const Value *delta) {
+        switch (delta->type()) {
+            case kArray: {
+                auto array = (const Array*)delta;
+                auto count = array->count();
+                return count < 3 || (count == 3 && array->get(2)->asInt() == kDeletionCode);
+            }
+            case kDict:
+                return false;
+            default:
+                return true;
+        }
+    }
 
 
-    /*static*/ string JSONDelta::createStringDelta(slice oldStr, slice nuuStr) {
-        if (nuuStr.size < gMinStringDiffLength
-                || (gCompatibleDeltas && oldStr.size > gMinStringDiffLength))
-            return "";
-        diff_match_patch<string> dmp;
-        dmp.Diff_Timeout = gTextDiffTimeout;
-        auto patches = dmp.patch_make(string(oldStr), string(nuuStr));
-
-        if (gCompatibleDeltas)
-            return dmp.patch_toText(patches);
-
-        // Iterate over the diffs, writing the encoded form to the output stream:
-        stringstream diff;
-        long lastOldPos = 0, correction = 0;
-        for (auto patch = patches.begin(); patch != patches.end(); ++patch) {
-            long oldPos = patch->start1 + correction;   // position in oldStr
-            long nuuPos = patch->start2;                // position in nuuStr
-            auto &diffs = patch->diffs;
-            for (auto cur_diff = diffs.begin(); cur_diff != diffs.end(); ++cur_diff) {
-                auto length = cur_diff->text.length();
-                if (cur_diff->operation == diff_match_patch<string>::EQUAL) {
-                    oldPos += length;
-                    nuuPos += length;
-                } else {
-                    // Don't break up a UTF-8 multibyte character:
-                    if (cur_diff->operation == diff_match_patch<string>::DELETE)
-                        snapToUTF8Character(oldPos, length, oldStr);
+    // If a delta is a replacement, returns the replacement value, else nullptr.
+    static const Value* replacementValue(const Value *delta) {
+        switch (delta->type()) {
+            case kArray: {
+                auto array = (const Array*)delta;
+                auto count = array->count();
+                return (count == 1 || count == 2) ? array->get(count - 1) : nullptr;
+            }
+            case kDict:
+                return nullptr;
+            default:
+                return delta;
+        }
+    }
+
+
+    // If a delta is a text diff, returns the diff string.
+    static slice textDiff(const Value *delta) {
+        auto array = delta->asArray();
+        if (array && array->count() == 3 && array->get(2)->asInt() == kTextDiffCode)
+            return array->get(0)->asString();
+        return nullslice;
+    }
+
+
+    // Parses a dict key as an array index.
+    static bool parseIndex(slice key, int64_t &index) {
+        if (key.size == 0 || key.size > 18)
+            return false;
+        index = 0;
+        for (size_t i = 0; i < key.size; ++i) {
+            if (!isDigit(key[i]))
+                return false;
+            index = 10 * index + (key[i] - '0');
+        }
+        return true;
+    }
+
+
+    // If an incremental-update delta has a key like "3-", i.e. replaces the tail of an array,
+    // returns that index; else returns -1.
+    static int64_t remainderIndex(const Dict *delta) {
+        for (Dict::iterator i(delta); i; ++i) {
+            slice key = i.keyString();
+            if (key.size >= 2 && key[key.size - 1] == '-') {
+                int64_t index;
+                if (parseIndex(key.upTo(key.size - 1), index))
+                    return index;
+            }
+        }
+        return -1;
+    }
+
+
+    // Can two incremental-update deltas be merged key by key? Not if the first one changes an
+    // array's length, since the second one's indexes would be shifted; or if the second one
+    // truncates the array below an index the first one patches.
+    static bool canMergeDicts(const Dict *delta1, const Dict *delta2) {
+        if (remainderIndex(delta1) >= 0)
+            return false;
+        int64_t end = remainderIndex(delta2);
+        if (end >= 0) {
+            for (Dict::iterator i(delta1); i; ++i) {
+                int64_t index;
+                if (parseIndex(i.keyString(), index) && index >= end)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+
+    // Parses an incremental update of an array, whose keys are indexes plus at most one "n-"
+    // that replaces the tail from index n (returned in `end`, or -1) with `tail`. Returns false
+    // if the delta has any other key, or a key at or past the tail, which `_patchArray` ignores.
+    static bool parseArrayUpdate(const Dict *delta, int64_t &end, const Array* &tail) {
+        end = remainderIndex(delta);
+        tail = nullptr;
+        for (Dict::iterator i(delta); i; ++i) {
+            slice key = i.keyString();
+            int64_t index;
+            if (parseIndex(key, index)) {
+                if (end >= 0 && index >= end)
+                    return false;
+            } else if (key.size >= 2 && key[key.size - 1] == '-'
+                       && parseIndex(key.upTo(key.size - 1), index) && index == end) {
+                tail = i.value()->asArray();
+                if (!tail)
+                    return false;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+
+#pragma mark - COMPOSING DELTAS:
+
+
+    /*static*/ alloc_slice JSONDelta::compose(slice jsonDelta1, slice jsonDelta2, bool isJSON5) {
+        alloc_slice delta1 = parseDelta(jsonDelta1, isJSON5, nullptr);
+        alloc_slice delta2 = parseDelta(jsonDelta2, isJSON5, nullptr);
+        Encoder enc;
+        JSONDelta(enc)._compose(Value::fromTrustedData(delta1), Value::fromTrustedData(delta2));
+        alloc_slice composed = enc.finish();
+        return Value::fromTrustedData(composed)->toJSON();
+    }
+
+
+    /*static*/ alloc_slice JSONDelta::applyChain(const Value *old, const vector<slice> &jsonDeltas,
+                                                 bool isJSON5)
+    {
+        Encoder enc;
+        applyChain(old, jsonDeltas, isJSON5, enc);
+        return enc.finish();
+    }
+
+
+    /*static*/ void JSONDelta::applyChain(const Value *old, const vector<slice> &jsonDeltas,
+                                          bool isJSON5, Encoder &enc)
+    {
+        if (jsonDeltas.empty()) {
+            enc.writeValue(old);
+            return;
+        }
+        // Compose the deltas into one, using the same SharedKeys as `old`, so that applying it
+        // only traverses `old` once:
+        auto sk = old->sharedKeys();
+        alloc_slice composed = parseDelta(jsonDeltas[0], isJSON5, sk);
+        for (size_t i = 1; i < jsonDeltas.size(); ++i) {
+            alloc_slice next = parseDelta(jsonDeltas[i], isJSON5, sk);
+            Scope scope1(composed, sk), scope2(next, sk);
+            Encoder composer;
+            composer.setSharedKeys(sk);
+            JSONDelta(composer)._compose(Value::fromTrustedData(composed),
+                                         Value::fromTrustedData(next));
+            composed = composer.finish();
+        }
+        Scope scope(composed, sk);
+        JSONDelta(enc)._apply(old, Value::fromTrustedData(composed));
+    }
+
+
+    // Writes a delta with the same effect as applying `delta1` and then `delta2`.
+    void JSONDelta::_compose(const Value *delta1, const Value *delta2) {
+        if (isDeltaReplacement(delta2)) {
+            // The second delta doesn't care what the first one did:
+            _decoder->writeValue(delta2);
+            return;
+        }
+        throwIf(isDeltaDeletion(delta1), InvalidData, "Delta applied to a deleted value");
+        if (auto value = replacementValue(delta1)) {
+            // The first delta replaced the value, so the result replaces it with the second
+            // delta applied to that:
+            _decoder->beginArray(1);
+            _apply(value, delta2);
+            _decoder->endArray();
+            return;
+        }
+
+        auto dict1 = delta1->asDict(), dict2 = delta2->asDict();
+        if (dict1 && dict1->empty()) {
+            _decoder->writeValue(delta2);
+            return;
+        } else if (dict2 && dict2->empty()) {
+            _decoder->writeValue(delta1);
+            return;
+        } else if (dict1 && dict2 && canMergeDicts(dict1, dict2)) {
+            // Two incremental updates of a dict (or of array items in place): merge their keys,
+            // composing the deltas of keys they both change:
+            _decoder->beginDictionary();
+            for (Dict::iterator i(dict1); i; ++i) {
+                slice key = i.keyString();
+                _decoder->writeKey(key);
+                if (auto value2 = dict2->get(key))
+                    _compose(i.value(), value2);
+                else
+                    _decoder->writeValue(i.value());
+            }
+            for (Dict::iterator i(dict2); i; ++i) {
+                slice key = i.keyString();
+                if (!dict1->get(key)) {
+                    _decoder->writeKey(key);
+                    _decoder->writeValue(i.value());
+                }
+            }
+            _decoder->endDictionary();
+            return;
+        } else if (dict1 && dict2 && _composeArrayUpdates(dict1, dict2)) {
+            return;
+        }
+
+        if (_composeArrayDiffs(delta1, delta2))
+            return;
+
+        slice diff1 = textDiff(delta1), diff2 = textDiff(delta2);
+        if (diff1 && diff2) {
+            _decoder->beginArray(3);
+            composeStringDeltas(diff1, diff2, *_decoder);
+            _decoder->writeInt(0);
+            _decoder->writeInt(kTextDiffCode);
+            _decoder->endArray();
+            return;
+        }
+
+        // Otherwise the deltas can't be merged, so write a sequence that applies them in turn:
+        _decoder->beginArray(3);
+        _decoder->beginArray();
+        writeSequenceItems(delta1);
+        writeSequenceItems(delta2);
+        _decoder->endArray();
+        _decoder->writeInt(0);
+        _decoder->writeInt(kSequenceCode);
+        _decoder->endArray();
+    }
+
+
+    // Composes two incremental updates of an array that can't be merged key by key, because one
+    // of them replaces the array's tail, into one update of the same form. (This keeps deltas
+    // in the original format composable without the newer sequence form.) Returns false
+    // (having written nothing) if they aren't both array updates.
+    bool JSONDelta::_composeArrayUpdates(const Dict *dict1, const Dict *dict2) {
+        int64_t end1, end2;
+        const Array *tail1, *tail2;
+        if (!parseArrayUpdate(dict1, end1, tail1) || !parseArrayUpdate(dict2, end2, tail2))
+            return false;
+        // After dict1 the array has `end1 + tail1->count()` items, so dict2 can't start its
+        // tail beyond that:
+        if (end1 >= 0 && end2 > end1 + int64_t(tail1->count()))
+            return false;
+        // The composed update replaces the tail from the lower of the two indexes:
+        bool fromTail1 = end1 >= 0 && (end2 < 0 || end1 < end2);
+        int64_t end = fromTail1 ? end1 : end2;
+        assert(end >= 0);
+
+        _decoder->beginDictionary();
+        // Items before `end` are patched just as by a key-by-key merge:
+        int64_t index;
+        for (Dict::iterator i(dict1); i; ++i) {
+            slice key = i.keyString();
+            if (!parseIndex(key, index) || index >= end)
+                continue;
+            _decoder->writeKey(key);
+            if (auto value2 = dict2->get(key))
+                _compose(i.value(), value2);
+            else
+                _decoder->writeValue(i.value());
+        }
+        for (Dict::iterator i(dict2); i; ++i) {
+            slice key = i.keyString();
+            if (parseIndex(key, index) && index < end && !dict1->get(key)) {
+                _decoder->writeKey(key);
+                _decoder->writeValue(i.value());
+            }
+        }
+
+        char key[kMaxIntStringSize + 1];
+        size_t keyLen = WriteUInt(uint64_t(end), key);
+        key[keyLen++] = '-';
+        _decoder->writeKey(slice(key, keyLen));
+        if (fromTail1) {
+            // dict2 patches the items of dict1's tail, up to where its own tail (if any) starts:
+            _decoder->beginArray();
+            auto count = tail1->count();
+            if (end2 >= 0)
+                count = uint32_t(end2 - end1);
+            for (uint32_t j = 0; j < count; ++j) {
+                keyLen = WriteUInt(uint64_t(end1 + j), key);
+                if (auto value2 = dict2->get(slice(key, keyLen)))
+                    _apply(tail1->get(j), value2);
+                else
+                    _decoder->writeValue(tail1->get(j));
+            }
+            if (tail2) {
+                for (Array::iterator i(tail2); i; ++i)
+                    _decoder->writeValue(i.value());
+            }
+            _decoder->endArray();
+        } else {
+            _decoder->writeValue(tail2);
+        }
+        _decoder->endDictionary();
+        return true;
+    }
+
+
+    // An operation of an array diff, parsed (see "ARRAY DIFFS" above.)
+    struct ArrayDiffOp {
+        enum Kind : uint8_t {kKeep, kDelete, kInsert, kCopy, kPatch};
+        Kind kind;
+        uint32_t index, count;      // kCopy: the range of old items; kKeep, kDelete: the count
+        const Value *value;         // kInsert: the item; kPatch: the delta
+    };
+
+
+    // If a delta is an array diff, returns its array of operations.
+    static const Array* arrayDiffOps(const Value *delta) {
+        auto array = delta->asArray();
+        if (array && array->count() == 3 && array->get(2)->asInt() == kArrayDiffCode) {
+            auto ops = array->get(0)->asArray();
+            throwIf(!ops, InvalidData, "Invalid array diff in delta");
+            return ops;
+        }
+        return nullptr;
+    }
+
+
+    // Parses an array diff's operations, returning the length of the array it applies to.
+    static uint32_t parseArrayDiff(const Array *ops, vector<ArrayDiffOp> &diff) {
+        uint64_t oldCount = 0;
+        for (Array::iterator i(ops); i; ++i) {
+            const Value *op = i.value();
+            switch (op->type()) {
+                case kNumber: {
+                    int64_t n = op->asInt();
+                    throwIf(!op->isInteger() || n == 0 || n > UINT32_MAX || n < -int64_t(UINT32_MAX),
+                            InvalidData, "Invalid count in array delta");
+                    if (n > 0)
+                        diff.push_back({ArrayDiffOp::kKeep, 0, uint32_t(n), nullptr});
                     else
-                        snapToUTF8Character(nuuPos, length, nuuStr);
+                        diff.push_back({ArrayDiffOp::kDelete, 0, uint32_t(-n), nullptr});
+                    oldCount += diff.back().count;
+                    break;
+                }
+                case kArray:
+                    for (Array::iterator j((const Array*)op); j; ++j)
+                        diff.push_back({ArrayDiffOp::kInsert, 0, 1, j.value()});
+                    break;
+                case kString: {
+                    uint64_t index, count;
+                    throwIf(!parseItemRef(op->asString(), index, count)
+                                || index + count > UINT32_MAX,
+                            InvalidData, "Invalid item reference in array delta");
+                    diff.push_back({ArrayDiffOp::kCopy, uint32_t(index), uint32_t(count), nullptr});
+                    break;
+                }
+                case kDict:
+                    diff.push_back({ArrayDiffOp::kPatch, 0, 1, op});
+                    ++oldCount;
+                    break;
+                default:
+                    FleeceException::_throw(InvalidData, "Invalid op in array delta");
+            }
+        }
+        throwIf(oldCount > UINT32_MAX, InvalidData, "Invalid count in array delta");
+        return uint32_t(oldCount);
+    }
 
-                    assert(oldPos >= lastOldPos);
-                    if (oldPos > lastOldPos) {
-                        // Write the number of matching bytes since the last insert/delete:
-                        diff << (oldPos-lastOldPos) << '=';
-                    }
-                    if (cur_diff->operation == diff_match_patch<string>::DELETE) {
-                        // Write the number of deleted bytes:
-                        diff << length << '-';
-                        oldPos += length;
-                    } else /* INSERT */ {
-                        // Write an insertion, both the count and the bytes:
-                        diff << length << '+';
-                        diff.write((const char*)&nuuStr[nuuPos], length);
-                        diff << '|';
-                        nuuPos += length;
+
+    // Converts an incremental update of an array of `count` items, like `{"1": {...}, "3-": [...]}`,
+    // to array diff operations. Returns false if it makes changes the operations can't express.
+    static bool indexDeltaToArrayDiff(const Dict *delta, uint32_t count, vector<ArrayDiffOp> &diff) {
+        vector<pair<uint32_t,const Value*>> patches;
+        uint32_t end = count;
+        const Array *remainder = nullptr;
+        for (Dict::iterator i(delta); i; ++i) {
+            slice key = i.keyString();
+            int64_t index;
+            if (parseIndex(key, index)) {
+                if (index < count)
+                    patches.push_back({uint32_t(index), i.value()});
+            } else if (key.size >= 2 && key[key.size - 1] == '-'
+                                      && parseIndex(key.upTo(key.size - 1), index)) {
+                if (index <= count) {
+                    if (remainder)
+                        return false;
+                    remainder = i.value()->asArray();
+                    end = uint32_t(index);
+                    throwIf(!remainder, InvalidData, "Invalid array remainder in delta");
+                }
+            } else {
+                return false;
+            }
+        }
+        sort(patches.begin(), patches.end(),
+             [](const pair<uint32_t,const Value*> &a, const pair<uint32_t,const Value*> &b) {
+                 return a.first < b.first;
+             });
+
+        uint32_t pos = 0;
+        for (auto &patch : patches) {
+            if (patch.first >= end)
+                return false;
+            if (patch.first > pos)
+                diff.push_back({ArrayDiffOp::kKeep, 0, patch.first - pos, nullptr});
+            if (patch.second->type() == kDict) {
+                diff.push_back({ArrayDiffOp::kPatch, 0, 1, patch.second});
+            } else if (auto value = replacementValue(patch.second)) {
+                diff.push_back({ArrayDiffOp::kDelete, 0, 1, nullptr});
+                diff.push_back({ArrayDiffOp::kInsert, 0, 1, value});
+            } else {
+                return false;
+            }
+            pos = patch.first + 1;
+        }
+        if (end > pos)
+            diff.push_back({ArrayDiffOp::kKeep, 0, end - pos, nullptr});
+        if (remainder) {
+            if (count > end)
+                diff.push_back({ArrayDiffOp::kDelete, 0, count - end, nullptr});
+            for (Array::iterator i(remainder); i; ++i)
+                diff.push_back({ArrayDiffOp::kInsert, 0, 1, i.value()});
+        }
+        return true;
+    }
+
+
+    // Composes two deltas of an array, at least one of which is an array diff, into a single
+    // array diff. Returns false (having written nothing) if that's not possible.
+    bool JSONDelta::_composeArrayDiffs(const Value *delta1, const Value *delta2) {
+        const Array *ops1 = arrayDiffOps(delta1), *ops2 = arrayDiffOps(delta2);
+        if (!ops1 && !ops2)
+            return false;
+        vector<ArrayDiffOp> diff1, diff2;
+        uint32_t count1 = 0, count2 = 0;        // lengths of the arrays the deltas apply to
+        if (ops2)
+            count2 = parseArrayDiff(ops2, diff2);
+        if (ops1) {
+            count1 = parseArrayDiff(ops1, diff1);
+        } else {
+            // An incremental update; as long as it doesn't change the array's length, it can
+            // be converted to an array diff:
+            auto dict1 = delta1->asDict();
+            if (!dict1 || remainderIndex(dict1) >= 0)
+                return false;
+            count1 = count2;
+            if (!indexDeltaToArrayDiff(dict1, count1, diff1))
+                return false;
+        }
+
+        // The items of delta1's result, as runs of old items (maybe patched) or inserted items:
+        struct Piece {
+            const Value *value;             // an inserted item, or nullptr for old items
+            uint32_t index, count;          // the range of old items
+            const Value *patch1, *patch2;   // deltas to apply to the item
+        };
+        vector<Piece> pieces1;
+        vector<uint32_t> starts;            // index of each piece in delta1's result
+        uint32_t resultCount = 0, pos = 0;
+        auto add = [&](Piece piece) {
+            pieces1.push_back(piece);
+            starts.push_back(resultCount);
+            resultCount += piece.count;
+        };
+        for (auto &op : diff1) {
+            switch (op.kind) {
+                case ArrayDiffOp::kKeep:
+                    add({nullptr, pos, op.count, nullptr, nullptr});
+                    pos += op.count;
+                    break;
+                case ArrayDiffOp::kDelete:
+                    pos += op.count;
+                    break;
+                case ArrayDiffOp::kInsert:
+                    add({op.value, 0, 1, nullptr, nullptr});
+                    break;
+                case ArrayDiffOp::kCopy:
+                    throwIf(op.index + op.count > count1, InvalidData,
+                            "Invalid item reference in array delta");
+                    add({nullptr, op.index, op.count, nullptr, nullptr});
+                    break;
+                case ArrayDiffOp::kPatch:
+                    add({nullptr, pos++, 1, op.value, nullptr});
+                    break;
+            }
+        }
+        if (!ops2) {
+            auto dict2 = delta2->asDict();
+            count2 = resultCount;
+            if (!dict2 || !indexDeltaToArrayDiff(dict2, count2, diff2))
+                return false;
+        }
+        throwIf(count2 != resultCount, InvalidData, "Length mismatch in array delta");
+
+        // Now run delta2 over those pieces, to get the pieces of its result:
+        vector<Piece> pieces;
+        auto take = [&](uint32_t start, uint32_t n) {
+            throwIf(n > resultCount - start, InvalidData, "Length mismatch in array delta");
+            auto i = upper_bound(starts.begin(), starts.end(), start) - starts.begin() - 1;
+            for (; n > 0; ++i) {
+                Piece piece = pieces1[i];
+                uint32_t offset = start - starts[i], k = min(n, piece.count - offset);
+                piece.index += offset;
+                piece.count = k;
+                pieces.push_back(piece);
+                start += k;
+                n -= k;
+            }
+        };
+        pos = 0;
+        for (auto &op : diff2) {
+            switch (op.kind) {
+                case ArrayDiffOp::kKeep:
+                    take(pos, op.count);
+                    pos += op.count;
+                    break;
+                case ArrayDiffOp::kDelete:
+                    throwIf(op.count > resultCount - pos, InvalidData,
+                            "Length mismatch in array delta");
+                    pos += op.count;
+                    break;
+                case ArrayDiffOp::kInsert:
+                    pieces.push_back({op.value, 0, 1, nullptr, nullptr});
+                    break;
+                case ArrayDiffOp::kCopy:
+                    throwIf(op.index >= resultCount, InvalidData,
+                            "Invalid item reference in array delta");
+                    take(op.index, op.count);
+                    break;
+                case ArrayDiffOp::kPatch: {
+                    take(pos++, 1);
+                    Piece &piece = pieces.back();
+                    if (piece.patch1) {
+                        // The item is patched twice; the patches have to merge into one:
+                        auto dict1 = piece.patch1->asDict(), dict2 = op.value->asDict();
+                        if (!dict1->empty() && !dict2->empty() && !canMergeDicts(dict1, dict2))
+                            return false;
                     }
-                    lastOldPos = oldPos;
+                    piece.patch2 = op.value;
+                    break;
+                }
+            }
+        }
+        throwIf(pos != resultCount, InvalidData, "Length mismatch in array delta");
+
+        // An array diff can't patch an old item it's already passed, so make sure the patched
+        // ones are still in order. (This follows the same logic as the loop below.)
+        uint32_t cursor = 0;
+        for (auto &piece : pieces) {
+            if (piece.value) {
+                continue;
+            } else if (piece.patch1 || piece.patch2) {
+                if (piece.index < cursor)
+                    return false;
+                cursor = piece.index + 1;
+            } else if (piece.index >= cursor) {
+                cursor = piece.index + piece.count;
+            }
+        }
+
+        // Write the pieces as array diff ops, keeping or deleting runs of old items in order, and
+        // referring back to earlier ones with "@i:n":
+        _decoder->beginArray(3);
+        _decoder->beginArray();
+        cursor = 0;
+        uint32_t keep = 0;
+        bool inserting = false;
+        auto flush = [&] {
+            if (keep > 0) {
+                _decoder->writeInt(keep);
+                keep = 0;
+            }
+            if (inserting) {
+                _decoder->endArray();
+                inserting = false;
+            }
+        };
+        auto skipTo = [&](uint32_t index) {
+            if (index > cursor) {
+                flush();
+                _decoder->writeInt(-int64_t(index - cursor));
+                cursor = index;
+            }
+        };
+        for (auto &piece : pieces) {
+            if (piece.value) {
+                if (!inserting) {
+                    flush();
+                    _decoder->beginArray();
+                    inserting = true;
+                }
+                if (piece.patch2)
+                    _apply(piece.value, piece.patch2);
+                else
+                    _decoder->writeValue(piece.value);
+            } else if (piece.patch1 || piece.patch2) {
+                skipTo(piece.index);
+                flush();
+                if (piece.patch1 && piece.patch2)
+                    _compose(piece.patch1, piece.patch2);
+                else
+                    _decoder->writeValue(piece.patch1 ? piece.patch1 : piece.patch2);
+                ++cursor;
+            } else if (piece.index >= cursor) {
+                skipTo(piece.index);
+                if (inserting)
+                    flush();
+                keep += piece.count;
+                cursor += piece.count;
+            } else {
+                flush();
+                char ref[2 * kMaxIntStringSize + 2];
+                size_t refLen = 0;
+                ref[refLen++] = '@';
+                refLen += WriteUInt(piece.index, &ref[refLen]);
+                if (piece.count > 1) {
+                    ref[refLen++] = ':';
+                    refLen += WriteUInt(piece.count, &ref[refLen]);
                 }
-                if ((off_t)diff.tellp() + 6 >= nuuStr.size)
-                    return "";          // Patch is too long; give up on using a diff
+                _decoder->writeString(slice(ref, refLen));
+            }
+        }
+        skipTo(count1);
+        flush();
+        _decoder->endArray();
+        _decoder->writeInt(0);
+        _decoder->writeInt(kArrayDiffCode);
+        _decoder->endArray();
+        return true;
+    }
+
+
+    // Writes a delta as an item of a sequence, flattening it if it's a sequence itself.
+    void JSONDelta::writeSequenceItems(const Value *delta) {
+        auto array = delta->asArray();
+        if (array && array->count() == 3 && array->get(2)->asInt() == kSequenceCode
+                  && array->get(0)->asArray()) {
+            for (Array::iterator i(array->get(0)->asArray()); i; ++i)
+                _decoder->writeValue(i.value());
+        } else {
+            _decoder->writeValue(delta);
+        }
+    }
+
+
+    // Applies a sequence of deltas, starting at `index`, in turn. Only the part of the value
+    // they apply to has to be encoded in between.
+    void JSONDelta::_applySequence(const Value *old, const Array *deltas, uint32_t index) {
+        const Value *delta = deltas->get(index);
+        if (index + 1 == deltas->count()) {
+            _apply(old, delta);
+        } else if (isDeltaDeletion(delta)) {
+            throwIf(!old, InvalidData, "Invalid deletion in delta");
+            _applySequence(nullptr, deltas, index + 1);
+        } else {
+            SharedKeys *sk = old ? old->sharedKeys() : nullptr;
+            Encoder enc;
+            enc.setSharedKeys(sk);
+            JSONDelta(enc)._apply(old, delta);
+            alloc_slice intermediate = enc.finish();
+            Scope scope(intermediate, sk);
+            _applySequence(Value::fromTrustedData(intermediate), deltas, index + 1);
+        }
+    }
+
+
+#pragma mark - STRING DELTAS:
+
+
+    // A range of bytes in the old string that's replaced by a range of bytes in the new string.
+    struct StringHunk {
+        size_t oldPos, oldLen, nuuPos, nuuLen;
+        size_t oldEnd() const       {return oldPos + oldLen;}
+        size_t nuuEnd() const       {return nuuPos + nuuLen;}
+    };
+
+
+    // Writes the text of a string diff into a fixed-size buffer.
+    class StringDeltaWriter {
+    public:
+        StringDeltaWriter(char *buf, size_t capacity)
+        :_start(buf), _next(buf), _end(buf + capacity)
+        { }
+
+        size_t size() const                             {return _next - _start;}
+
+        // Writes an operation; returns false if the buffer is full.
+        bool write(size_t len, char op, slice insertion = nullslice) {
+            char num[kMaxIntStringSize];
+            size_t numLen = WriteUInt(len, num);
+            if (numLen + 1 + insertion.size + (op == '+') > size_t(_end - _next))
+                return false;
+            memcpy(_next, num, numLen);
+            _next += numLen;
+            *_next++ = op;
+            if (op == '+') {
+                memcpy(_next, insertion.buf, insertion.size);
+                _next += insertion.size;
+                *_next++ = '|';
+            }
+            return true;
+        }
+
+    private:
+        char *_start, *_next, *_end;
+    };
+
+
+    static size_t numDigits(size_t n) {
+        size_t digits = 1;
+        for (; n >= 10; n /= 10)
+            ++digits;
+        return digits;
+    }
+
+
+    // Finds the ranges of bytes that differ between two strings, by trimming their common prefix
+    // and suffix and running Myers' diff over the rest. Returns false if they differ by more than
+    // `maxEdits` bytes inserted + deleted.
+    static bool diffStrings(slice oldStr, slice nuuStr, long maxEdits, vector<StringHunk> &hunks) {
+        auto a = (const uint8_t*)oldStr.buf, b = (const uint8_t*)nuuStr.buf;
+        size_t minSize = min(oldStr.size, nuuStr.size), prefix = 0, suffix = 0;
+        while (prefix < minSize && a[prefix] == b[prefix])
+            ++prefix;
+        while (suffix < minSize - prefix
+                    && a[oldStr.size-1-suffix] == b[nuuStr.size-1-suffix])
+            ++suffix;
+
+        vector<EditOp> script;
+        if (!diffSequences(a + prefix, long(oldStr.size - prefix - suffix),
+                           b + prefix, long(nuuStr.size - prefix - suffix),
+                           maxEdits, script))
+            return false;
+
+        // Collect each run of deletions & insertions between matches into a hunk:
+        size_t o = prefix, n = prefix;
+        for (size_t i = 0; i < script.size(); ) {
+            if (script[i] == kKeep) {
+                ++o; ++n; ++i;
+                continue;
             }
-            correction += patch->length1 - patch->length2;
+            StringHunk hunk = {o, 0, n, 0};
+            for (; i < script.size() && script[i] != kKeep; ++i)
+                (script[i] == kDelete) ? ++hunk.oldLen : ++hunk.nuuLen;
+            o = hunk.oldEnd();
+            n = hunk.nuuEnd();
+            hunks.push_back(hunk);
         }
-        if (oldStr.size > lastOldPos) {
-            // Write a final matching-bytes count:
-            diff << (oldStr.size-lastOldPos) << '=';
+        return true;
+    }
+
+
+    // Adjusts the hunks so none of them starts or ends in the middle of a UTF-8 multibyte
+    // character, and merges hunks separated by matches so short that describing them would take
+    // more space than just inserting them.
+    static void cleanUpHunks(slice oldStr, slice nuuStr, vector<StringHunk> &hunks) {
+        auto a = (const uint8_t*)oldStr.buf, b = (const uint8_t*)nuuStr.buf;
+        // Is there a character boundary at these positions (which are in an unchanged range)?
+        auto isBoundary = [&](size_t o, size_t n) {
+            return !(o < oldStr.size && isUTF8Continuation(a[o]))
+                && !(n < nuuStr.size && isUTF8Continuation(b[n]));
+        };
+
+        size_t count = 0;       // number of cleaned-up hunks, stored at the start of `hunks`
+        for (size_t i = 0; i < hunks.size(); ++i) {
+            StringHunk hunk = hunks[i];
+            StringHunk *prev = count > 0 ? &hunks[count-1] : nullptr;
+            size_t lowerBound = prev ? prev->oldEnd() : 0;
+            while (hunk.oldPos > lowerBound && !isBoundary(hunk.oldPos, hunk.nuuPos)) {
+                --hunk.oldPos; ++hunk.oldLen;
+                --hunk.nuuPos; ++hunk.nuuLen;
+            }
+            if (prev) {
+                size_t gap = hunk.oldPos - prev->oldEnd();
+                size_t separateCost = numDigits(gap) + 1;
+                if (hunk.oldLen > 0)
+                    separateCost += numDigits(hunk.oldLen) + 1;
+                if (hunk.nuuLen > 0)
+                    separateCost += numDigits(hunk.nuuLen) + 2;
+                if (gap <= separateCost) {
+                    // Merge into the previous hunk, along with the matching bytes between them:
+                    prev->oldLen = hunk.oldEnd() - prev->oldPos;
+                    prev->nuuLen = hunk.nuuEnd() - prev->nuuPos;
+                    hunk = *prev;
+                    --count;
+                }
+            }
+            size_t upperBound = (i + 1 < hunks.size()) ? hunks[i+1].oldPos : oldStr.size;
+            while (hunk.oldEnd() < upperBound && !isBoundary(hunk.oldEnd(), hunk.nuuEnd())) {
+                ++hunk.oldLen;
+                ++hunk.nuuLen;
+            }
+            hunks[count++] = hunk;
         }
-        return diff.str();
+        hunks.resize(count);
     }
 
 
-    /*static*/ string JSONDelta::applyStringDelta(slice oldStr, slice diff) {
-#if 0
-        // Support for JsonDiffPatch-format string diffs:
-        if (diff[0] == '@') {
+    /*static*/ size_t JSONDelta::createStringDelta(slice oldStr, slice nuuStr, char *outDiff) {
+        if (nuuStr.size < gMinStringDiffLength
+                || (gCompatibleDeltas && oldStr.size > gMinStringDiffLength))
+            return 0;
+        // A diff is only worth using if it's shorter than the new string:
+        if (nuuStr.size <= 6)
+            return 0;
+        const size_t maxSize = nuuStr.size - 6;
+
+        if (gCompatibleDeltas) {
             diff_match_patch<string> dmp;
-            return dmp.patch_apply(dmp.patch_fromText(string(diff)), string(oldStr)).first;
-        }
-#endif
-
-        stringstream in{string(diff)};
-        in.exceptions(stringstream::failbit | stringstream::badbit);
-        stringstream nuu;
-        unsigned pos = 0;
-        while (in.peek() >= 0) {
-            char op;
-            unsigned len;
-            in >> len;
-            in >> op;
-            switch (op) {
+            dmp.Diff_Timeout = gTextDiffTimeout;
+            string patch = dmp.patch_toText(dmp.patch_make(string(oldStr), string(nuuStr)));
+            if (patch.size() >= maxSize)
+                return 0;
+            memcpy(outDiff, patch.data(), patch.size());
+            return patch.size();
+        }
+
+        vector<StringHunk> hunks;
+        if (gMaxTextDiffEdits == 0 || !diffStrings(oldStr, nuuStr, gMaxTextDiffEdits, hunks))
+            return 0;
+        cleanUpHunks(oldStr, nuuStr, hunks);
+
+        StringDeltaWriter diff(outDiff, maxSize - 1);
+        size_t lastOldPos = 0;
+        for (auto &hunk : hunks) {
+            // Write the number of matching bytes since the last hunk, then the deleted byte count
+            // and the inserted bytes:
+            if (hunk.oldPos > lastOldPos && !diff.write(hunk.oldPos - lastOldPos, '='))
+                return 0;
+            if (hunk.oldLen > 0 && !diff.write(hunk.oldLen, '-'))
+                return 0;
+            if (hunk.nuuLen > 0 && !diff.write(hunk.nuuLen, '+', nuuStr(hunk.nuuPos,
+                                                                          hunk.nuuLen)))
+                return 0;
+            lastOldPos = hunk.oldEnd();
+        }
+        // Write a final matching-bytes count:
+        if (oldStr.size > lastOldPos && !diff.write(oldStr.size - lastOldPos, '='))
+            return 0;
+        return diff.size();
+    }
+
+
+    // Reads the next operation from a string diff, advancing `diff` past it. Returns the
+    // operation's character, and sets `len` to its count and `insertion` to any inserted bytes.
+    static char readStringDeltaOp(slice &diff, size_t &len, slice &insertion) {
+        auto next = (const uint8_t*)diff.buf, end = (const uint8_t*)diff.end();
+        throwIf(!isDigit(*next), InvalidData, "Invalid length in text delta");
+        len = 0;
+        do {
+            throwIf(len >= UINT32_MAX / 10, InvalidData, "Invalid length in text delta");
+            len = 10 * len + (*next++ - '0');
+        } while (next < end && isDigit(*next));
+        throwIf(next == end, InvalidData, "Missing op in text delta");
+        char op = *next++;
+        if (op == '+') {
+            throwIf(len >= size_t(end - next) || next[len] != '|',
+                    InvalidData, "Missing insertion delimiter in text delta");
+            insertion = slice(next, len);
+            next += len + 1;
+        }
+        diff.setStart(next);
+        return op;
+    }
+
+
+    /*static*/ void JSONDelta::applyStringDelta(slice oldStr, slice diff, Encoder &enc) {
+        // First validate the diff and find the length of the new string:
+        size_t pos = 0, nuuSize = 0, len;
+        slice insertion;
+        for (slice in = diff; in.size > 0; ) {
+            char op = readStringDeltaOp(in, len, insertion);
+            if (op == '=' || op == '-') {
+                throwIf(len > oldStr.size - pos, InvalidData, "Invalid length in text delta");
+                pos += len;
+            } else {
+                throwIf(op != '+', InvalidData, "Unknown op in text delta");
+            }
+            if (op != '-')
+                nuuSize += len;
+        }
+        throwIf(pos != oldStr.size, InvalidData, "Length mismatch in text delta");
+
+        // Then build the new string right in the encoder's output:
+        char *nuuStr = enc.beginString(nuuSize), *dst = nuuStr;
+        pos = 0;
+        for (slice in = diff; in.size > 0; ) {
+            switch (readStringDeltaOp(in, len, insertion)) {
                 case '=':
-                    throwIf(pos + len > oldStr.size, InvalidData, "Invalid length in text delta");
-                    nuu.write((const char*)&oldStr[pos], len);
+                    memcpy(dst, &oldStr[pos], len);
+                    dst += len;
                     pos += len;
                     break;
                 case '-':
                     pos += len;
                     break;
-                case '+': {
-                    TempArray(insertion, char, len);
-                    in.read(insertion, len);
-                    nuu.write(insertion, len);
-                    in >> op;
-                    throwIf(op != '|', InvalidData, "Missing insertion delimiter in text delta");
-                    break;
-                }
                 default:
-                    FleeceException::_throw(InvalidData, "Unknown op in text delta");
+                    memcpy(dst, insertion.buf, len);
+                    dst += len;
+                    break;
             }
         }
-        throwIf(pos != oldStr.size, InvalidData, "Length mismatch in text delta");
-        return nuu.str();
+        enc.finishString(nuuStr, nuuSize);
     }
 
 
-    // Given a byte range (`pos`, `length`) in the slice `str`, if either end of the range falls
-    // in the middle of a UTF-8 multibyte character, push it _outwards_ to include the entire char.
-    static void snapToUTF8Character(long &pos, size_t &length, slice str) {
-        while (isUTF8Continuation(str[pos])) {
-            --pos;
-            throwIf(pos < 0, InvalidData, "Invalid UTF-8 at start of a string");
-            ++length;
+    // Writes a string diff with the same effect as applying `diff1` and then `diff2`.
+    /*static*/ void JSONDelta::composeStringDeltas(slice diff1, slice diff2, Encoder &enc) {
+        // The string produced by diff1, as a series of pieces of the old string or insertions:
+        struct Piece {
+            size_t oldPos;          // position in the old string, if `insertion` is null
+            size_t len;
+            slice insertion;
+        };
+        vector<Piece> pieces;
+        size_t oldSize = 0, len;
+        slice insertion;
+        for (slice in = diff1; in.size > 0; ) {
+            switch (readStringDeltaOp(in, len, insertion)) {
+                case '=':   pieces.push_back({oldSize, len, nullslice}); oldSize += len; break;
+                case '-':   oldSize += len; break;
+                case '+':   pieces.push_back({0, len, insertion}); break;
+                default:    FleeceException::_throw(InvalidData, "Unknown op in text delta");
+            }
         }
-        while (pos+length < str.size && isUTF8Continuation(str[pos+length])) {
-            ++length;
+
+        // Now run diff2 over those pieces, writing the ops that it keeps or inserts. Ranges of
+        // the old string are coalesced, and anything between them is written as a deletion
+        // followed by an insertion:
+        string result;
+        size_t oldPos = 0, copyLen = 0;
+        string inserted;
+        auto flush = [&](size_t nextOldPos) {
+            char num[kMaxIntStringSize];
+            if (copyLen > 0) {
+                result.append(num, WriteUInt(copyLen, num)).append(1, '=');
+                oldPos += copyLen;
+                copyLen = 0;
+            }
+            if (nextOldPos > oldPos)
+                result.append(num, WriteUInt(nextOldPos - oldPos, num)).append(1, '-');
+            oldPos = nextOldPos;
+            if (!inserted.empty()) {
+                result.append(num, WriteUInt(inserted.size(), num)).append(1, '+');
+                result.append(inserted).append(1, '|');
+                inserted.clear();
+            }
+        };
+        auto writeCopy = [&](size_t pos, size_t n) {
+            if (pos != oldPos + copyLen || !inserted.empty())
+                flush(pos);
+            copyLen += n;
+        };
+
+        size_t piece = 0, offset = 0;   // current position in `pieces`
+        auto consume = [&](size_t n, bool keep) {
+            while (n > 0) {
+                throwIf(piece >= pieces.size(), InvalidData, "Length mismatch in text delta");
+                Piece &p = pieces[piece];
+                size_t k = min(n, p.len - offset);
+                if (keep) {
+                    if (p.insertion)
+                        inserted.append((const char*)p.insertion.buf + offset, k);
+                    else
+                        writeCopy(p.oldPos + offset, k);
+                }
+                offset += k;
+                n -= k;
+                if (offset == p.len) {
+                    ++piece;
+                    offset = 0;
+                }
+            }
+        };
+        for (slice in = diff2; in.size > 0; ) {
+            switch (readStringDeltaOp(in, len, insertion)) {
+                case '=':   consume(len, true); break;
+                case '-':   consume(len, false); break;
+                case '+':   inserted.append((const char*)insertion.buf, insertion.size); break;
+                default:    FleeceException::_throw(InvalidData, "Unknown op in text delta");
+            }
         }
+        throwIf(piece < pieces.size(), InvalidData, "Length mismatch in text delta");
+        flush(oldSize);
+        enc.writeString(result);
     }
 
 } }
@@ -6,7 +6,9 @@
 
 #pragma once
 #include "FleeceImpl.hh"
+#include "function_ref.hh"
 #include <string>
+#include <vector>
 
 namespace fleece { namespace impl {
     class JSONEncoder;
@@ -36,29 +38,104 @@ namespace fleece { namespace impl {
             If the delta is malformed or can't be applied to `old`, throws a FleeceException. */
         static void apply(const Value *old, slice jsonDelta, bool isJSON5, Encoder&);
 
+
+        /** Combines two consecutive JSON deltas, one from A to B and one from B to C, into a
+            single JSON delta from A to C. Neither A nor B is needed. Changes to different parts
+            of the value are merged, a later replacement overrides earlier changes, and
+            consecutive string or array diffs are merged into one; where the changes can't be
+            merged (such as an array whose tail is replaced and which is then diffed) the result
+            applies them in turn to just that part of A.
+            Composing deltas in the original format gives a delta in that format: the newer
+            array-diff and sequence forms (`[ops,0,4]`, `[deltas,0,5]`) appear in the result only
+            if an input uses them, or in the rare case of a dict delta whose keys look like array
+            indexes and which can't be merged otherwise; such a result can't be applied by
+            implementations older than those forms.
+            If either delta is malformed, throws a FleeceException. */
+        static alloc_slice compose(slice jsonDelta1, slice jsonDelta2, bool isJSON5 =false);
+
+        /** Applies a chain of JSON deltas to the value `old`, with the same result as applying
+            each delta in turn to the result of the one before, and returns the final value as a
+            Fleece document. The deltas are first composed into one, so `old` is only traversed
+            (and the result only encoded) once.
+            If a delta is malformed or can't be applied, throws a FleeceException. */
+        static alloc_slice applyChain(const Value *old, const std::vector<slice> &jsonDeltas,
+                                      bool isJSON5 =false);
+
+        /** Applies a chain of JSON deltas to the value `old` like the other `applyChain` method,
+            but writes the final value to the Fleece encoder. */
+        static void applyChain(const Value *old, const std::vector<slice> &jsonDeltas,
+                               bool isJSON5, Encoder&);
+
         /** Minimum byte length of strings that will be considered for diffing (default 60) */
         static size_t gMinStringDiffLength;
 
-        /** Maximum time (in seconds) that the string-diff algorithm is allowed to run
-            (default 0.25) */
+        /** Maximum number of byte insertions + deletions that the string-diff algorithm will
+            look for (default 500.) If two strings differ by more than that, or if this is 0, the
+            delta just contains the new string. This bounds the time and memory a diff takes. */
+        static unsigned gMaxTextDiffEdits;
+
+        /** Maximum time (in seconds) that the string-diff algorithm is allowed to run when
+            creating JsonDiffPatch-compatible deltas (default 0.25) */
         static float gTextDiffTimeout;
 
+        /** Maximum number of item insertions + deletions that the array-diff algorithm will
+            look for. If two arrays differ by more than that, or if this is 0, the array delta
+            just describes the changes at each index.
+            The default is 0, because array-diff deltas (`[ops, 0, 4]`) can't be applied by
+            older implementations; set this (to e.g. 100) only if every reader supports them. */
+        static unsigned gMaxArrayDiffEdits;
+
     private:
+        friend class FleeceDelta;
         struct pathItem;
 
+        // One step of the plan for turning one array into another (see planArrayDiff.)
+        struct ArrayEdit {
+            enum Op : uint8_t {
+                kKeep,      // Keep the next `count` old items
+                kRemove,    // Skip the next `count` old items
+                kInsert,    // Insert new item `nuuIndex`
+                kCopy,      // Insert old item `oldIndex` (which moved)
+                kPatch,     // Change the next old item (`oldIndex`) into new item `nuuIndex`
+            };
+            Op op;
+            uint32_t oldIndex, nuuIndex, count;
+        };
+        static bool planArrayDiff(const Array* NONNULL old, const Array* NONNULL nuu,
+                                  unsigned maxEdits, bool positionalFallback,
+                                  std::vector<ArrayEdit> &plan);
+
+        // Finds the keys whose values differ between two dicts, calling `changed` for each with
+        // the old and new values (either of which is null if the key was added or removed.)
+        // Shared by both delta formats.
+        using DictDiffCallback = function_ref<void(slice key, const Value *old,
+                                                   const Value *nuu)>;
+        static void diffDicts(const Dict* NONNULL old, const Dict* NONNULL nuu,
+                              DictDiffCallback changed);
+
         JSONDelta(JSONEncoder&);
         bool _write(const Value *old, const Value *nuu, pathItem *path);
+        bool writeArrayDiff(const Array* NONNULL old, const Array* NONNULL nuu, pathItem *path);
 
         JSONDelta(Encoder&);
         void _apply(const Value *old, const Value* NONNULL delta);
         void _applyArray(const Value* old, const Array* NONNULL delta);
+        void _applyArrayDiff(const Value* old, const Array* ops);
         void _patchArray(const Array* NONNULL old, const Dict* NONNULL delta);
         void _patchDict(const Dict* NONNULL old, const Dict* NONNULL delta);
+        void _applySequence(const Value *old, const Array* NONNULL deltas, uint32_t index);
+        void _compose(const Value* NONNULL delta1, const Value* NONNULL delta2);
+        bool _composeArrayUpdates(const Dict* NONNULL delta1, const Dict* NONNULL delta2);
+        bool _composeArrayDiffs(const Value* NONNULL delta1, const Value* NONNULL delta2);
+        void writeSequenceItems(const Value* NONNULL delta);
 
         void writePath(pathItem*);
         static bool isDeltaDeletion(const Value *delta);
-        static std::string createStringDelta(slice oldStr, slice nuuStr);
-        static std::string applyStringDelta(slice oldStr, slice diff);
+        static bool isDeltaReplacement(const Value *delta);
+        static alloc_slice parseDelta(slice jsonDelta, bool isJSON5, SharedKeys*);
+        static void composeStringDeltas(slice diff1, slice diff2, Encoder&);
+        static size_t createStringDelta(slice oldStr, slice nuuStr, char *outDiff);
+        static void applyStringDelta(slice oldStr, slice diff, Encoder&);
 
         JSONEncoder* _encoder;
         Encoder* _decoder;
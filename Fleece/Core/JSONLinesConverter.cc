@@ -0,0 +1,211 @@
+//
+// JSONLinesConverter.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "JSONLinesConverter.hh"
+#include "Array.hh"
+#include "JSONConverter.hh"
+#include "Encoder.hh"
+#include "FleeceException.hh"
+#include "Parallel.hh"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <string.h>
+#include "betterassert.hh"
+
+namespace fleece { namespace impl {
+    using namespace std;
+
+    // Number of lines a worker thread claims at a time.
+    static constexpr size_t kLinesPerBatch = 64;
+
+
+    JSONLinesConverter::JSONLinesConverter(SharedKeys *sharedKeys, unsigned maxThreads)
+    :_sharedKeys(sharedKeys)
+    ,_maxThreads(maxThreads ? maxThreads : max(thread::hardware_concurrency(), 1u))
+    { }
+
+
+    // Splits the input at newlines. (A trailing '\r' will be ignored by the JSON parser.)
+    vector<slice> JSONLinesConverter::splitLines(slice input) {
+        vector<slice> lines;
+        auto end = (const char*)input.end();
+        for (auto line = (const char*)input.buf; line < end; ) {
+            auto eol = (const char*)memchr(line, '\n', end - line);
+            if (!eol)
+                eol = end;
+            lines.emplace_back(line, eol);
+            line = eol + 1;
+        }
+        return lines;
+    }
+
+
+    static bool isBlank(slice line) {
+        for (size_t i = 0; i < line.size; ++i)
+            if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+                return false;
+        return true;
+    }
+
+
+    // Converts the lines on the worker threads, in batches of kLinesPerBatch. Each worker reuses
+    // its own Encoder, calling `beginBatch` with it and the batch number before a batch, then
+    // writing each non-blank line to it and calling `lineDone` with the line's index, then
+    // calling `endBatch`. Throws if any line is invalid.
+    void JSONLinesConverter::convertLines(const vector<slice> &lines, BatchFunc beginBatch,
+                                          BatchFunc lineDone, BatchFunc endBatch)
+    {
+        atomic<size_t> badLine {SIZE_MAX};      // Index of the first invalid line found
+        mutex errorMutex;
+        ErrorCode errorCode {NoError};
+        string errorMessage;
+
+        // Each worker thread reuses its own Encoder and JSONConverter:
+        struct Worker {
+            Encoder enc;
+            JSONConverter converter {enc};
+        };
+        vector<unique_ptr<Worker>> workers(_maxThreads);
+
+        size_t nBatches = (lines.size() + kLinesPerBatch - 1) / kLinesPerBatch;
+        ForEachInParallel(nBatches, _maxThreads, [&](size_t batch, unsigned workerIndex) {
+            size_t begin = batch * kLinesPerBatch;
+            if (begin > badLine)
+                return false;       // Later lines don't matter once an earlier one is bad
+            auto &worker = workers[workerIndex];
+            if (!worker) {
+                worker.reset(new Worker);
+                worker->enc.setSharedKeys(_sharedKeys);
+            }
+            Encoder &enc = worker->enc;
+            size_t end = min(begin + kLinesPerBatch, lines.size());
+            ErrorCode code;
+            string message;
+            size_t i = begin;
+            try {
+                beginBatch(enc, batch);
+                for (; i < end; ++i) {
+                    if (isBlank(lines[i]))
+                        continue;
+                    if (!worker->converter.encodeJSON(lines[i]))
+                        break;
+                    lineDone(enc, i);
+                }
+                if (i == end) {
+                    endBatch(enc, batch);
+                    return true;
+                }
+                code = worker->converter.errorCode();
+                message = worker->converter.errorMessage();
+            } catch (const FleeceException &x) {
+                code = x.code;
+                message = x.what();
+            } catch (...) {
+                code = InternalError;
+                message = "Unexpected C++ exception";
+            }
+            enc.reset();
+            lock_guard<mutex> lock(errorMutex);
+            if (i < badLine) {
+                badLine = i;
+                errorCode = code;
+                errorMessage = message;
+            }
+            return true;
+        });
+
+        if (badLine != SIZE_MAX)
+            FleeceException::_throw(errorCode, "Invalid JSON on line %zu: %s",
+                                    size_t(badLine) + 1, errorMessage.c_str());
+    }
+
+
+    vector<Retained<Doc>> JSONLinesConverter::convertToDocs(slice input) {
+        vector<slice> lines = splitLines(input);
+        vector<Retained<Doc>> docs(lines.size());
+        convertLines(lines,
+                     [](Encoder&, size_t) { },
+                     [&](Encoder &enc, size_t line) {
+                         docs[line] = enc.finishDoc();
+                         enc.reset();
+                     },
+                     [](Encoder&, size_t) { });
+
+        // Remove the empty entries left by blank lines:
+        docs.erase(remove_if(docs.begin(), docs.end(),
+                             [](const Retained<Doc> &doc) {return !doc;}),
+                   docs.end());
+        return docs;
+    }
+
+
+    alloc_slice JSONLinesConverter::convertToArray(slice input) {
+        // Each batch of lines is encoded as an array by a worker thread:
+        vector<slice> lines = splitLines(input);
+        vector<alloc_slice> batches((lines.size() + kLinesPerBatch - 1) / kLinesPerBatch);
+        convertLines(lines,
+                     [](Encoder &enc, size_t) {enc.beginArray();},
+                     [](Encoder&, size_t) { },
+                     [&](Encoder &enc, size_t batch) {
+                         enc.endArray();
+                         batches[batch] = enc.finish();
+                         enc.reset();
+                     });
+
+        // Fleece pointers are relative, so the batches' data can simply be concatenated. Then
+        // the array of all the lines is encoded as a delta appended to that, whose items are
+        // pointers back to the batches' items, instead of copies of them:
+        size_t baseSize = 0;
+        for (auto &batch : batches)
+            baseSize += batch.size;
+        alloc_slice base(baseSize);
+        vector<const Array*> batchArrays;
+        batchArrays.reserve(batches.size());
+        size_t nLines = 0;
+        auto dst = (uint8_t*)base.buf;
+        for (auto &batch : batches) {
+            assert((batch.size & 1) == 0);      // so the next batch's Values are even-aligned
+            memcpy(dst, batch.buf, batch.size);
+            auto array = Value::fromTrustedData(slice(dst, batch.size))->asArray();
+            nLines += array->count();
+            batchArrays.push_back(array);
+            dst += batch.size;
+            batch = nullslice;
+        }
+
+        Encoder enc;
+        enc.setBase(base);
+        enc.beginArray(nLines);
+        for (auto array : batchArrays) {
+            for (Array::iterator i(array); i; ++i)
+                enc.writeValue(i.value());
+        }
+        enc.endArray();
+        alloc_slice array = enc.finish();
+
+        alloc_slice result(base.size + array.size);
+        memcpy((void*)result.buf, base.buf, base.size);
+        memcpy((uint8_t*)result.buf + base.size, array.buf, array.size);
+        return result;
+    }
+
+} }
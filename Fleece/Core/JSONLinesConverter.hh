@@ -0,0 +1,57 @@
+//
+// JSONLinesConverter.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Doc.hh"
+#include "SharedKeys.hh"
+#include "fleece/slice.hh"
+#include "function_ref.hh"
+#include <vector>
+
+namespace fleece { namespace impl {
+    class Encoder;
+
+    /** Converts "JSON Lines" (aka NDJSON) data -- one JSON value per line -- to Fleece, using
+        a pool of threads that each reuse their own Encoder and JSONConverter. Blank lines are
+        ignored. If any line is invalid, a FleeceException is thrown whose message gives the
+        (1-based) line number of the first invalid line. */
+    class JSONLinesConverter {
+    public:
+        /** @param sharedKeys  SharedKeys to use for all the records, or nullptr.
+            @param maxThreads  Max number of threads to use, or 0 to use one per CPU core. */
+        explicit JSONLinesConverter(SharedKeys *sharedKeys =nullptr,
+                                    unsigned maxThreads =0);
+
+        /** Converts each line to its own Doc. */
+        std::vector<Retained<Doc>> convertToDocs(slice jsonLines);
+
+        /** Converts the lines to a single Fleece array, with one item per line. */
+        alloc_slice convertToArray(slice jsonLines);
+
+    private:
+        using BatchFunc = function_ref<void(Encoder&, size_t index)>;
+
+        static std::vector<slice> splitLines(slice jsonLines);
+        void convertLines(const std::vector<slice> &lines,
+                          BatchFunc beginBatch, BatchFunc lineDone, BatchFunc endBatch);
+
+        Retained<SharedKeys> _sharedKeys;
+        unsigned _maxThreads;
+    };
+
+} }
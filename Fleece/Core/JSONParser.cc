@@ -0,0 +1,721 @@
+//
+// JSONParser.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "JSONParser.hh"
+#include "JSONConverter.hh"
+#include "Encoder.hh"
+#include "NumConversion.hh"
+#include "PlatformCompat.hh"
+#include "SIMD.hh"
+#include "jsonsl.h"
+#include <algorithm>
+#include <string.h>
+
+namespace fleece { namespace impl {
+
+    constexpr size_t JSONParser::kMaxDepth;
+
+    // Max number of structural positions to collect before walking them.
+    static constexpr size_t kIndexBatchSize = 4096;
+
+
+#pragma mark - STAGE 1: STRUCTURAL INDEX
+
+
+    // Bitmasks of the interesting characters in a 64-byte block; bit n is byte n.
+    struct blockMasks {
+        uint64_t quote, backslash, op, ws;
+    };
+
+#if FL_SIMD_AVX2
+
+    static inline blockMasks classify(const uint8_t *block) noexcept {
+        uint64_t masks[4] = {0, 0, 0, 0};
+        for (int k = 0; k < 2; ++k) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(block + 32 * k));
+            auto eq = [v](char c) {return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));};
+            // ORing 0x20 maps '[' and ']' to '{' and '}':
+            __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+            __m256i op = _mm256_or_si256(
+                            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+                                            _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+                            _mm256_or_si256(eq(':'), eq(',')));
+            __m256i ws = _mm256_or_si256(_mm256_or_si256(eq(' '), eq('\t')),
+                                         _mm256_or_si256(eq('\n'), eq('\r')));
+            unsigned shift = 32 * k;
+            masks[0] |= uint64_t(uint32_t(_mm256_movemask_epi8(eq('"')))) << shift;
+            masks[1] |= uint64_t(uint32_t(_mm256_movemask_epi8(eq('\\')))) << shift;
+            masks[2] |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << shift;
+            masks[3] |= uint64_t(uint32_t(_mm256_movemask_epi8(ws))) << shift;
+        }
+        return {masks[0], masks[1], masks[2], masks[3]};
+    }
+
+#elif FL_SIMD_SSE2
+
+    static inline blockMasks classify(const uint8_t *block) noexcept {
+        uint64_t masks[4] = {0, 0, 0, 0};
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(block + 16 * k));
+            auto eq = [v](char c) {return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));};
+            // ORing 0x20 maps '[' and ']' to '{' and '}':
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+                                                   _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+                                      _mm_or_si128(eq(':'), eq(',')));
+            __m128i ws = _mm_or_si128(_mm_or_si128(eq(' '), eq('\t')),
+                                      _mm_or_si128(eq('\n'), eq('\r')));
+            unsigned shift = 16 * k;
+            masks[0] |= uint64_t(_mm_movemask_epi8(eq('"'))) << shift;
+            masks[1] |= uint64_t(_mm_movemask_epi8(eq('\\'))) << shift;
+            masks[2] |= uint64_t(_mm_movemask_epi8(op)) << shift;
+            masks[3] |= uint64_t(_mm_movemask_epi8(ws)) << shift;
+        }
+        return {masks[0], masks[1], masks[2], masks[3]};
+    }
+
+#elif FL_SIMD_NEON && defined(__aarch64__)
+
+    // Equivalent of x86 movemask for four vectors of 0x00/0xFF bytes.
+    static inline uint64_t movemask64(uint8x16_t a, uint8x16_t b,
+                                      uint8x16_t c, uint8x16_t d) noexcept {
+        static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                          1, 2, 4, 8, 16, 32, 64, 128};
+        const uint8x16_t bits = vld1q_u8(kBits);
+        uint8x16_t sum0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+        uint8x16_t sum1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+        sum0 = vpaddq_u8(sum0, sum1);
+        sum0 = vpaddq_u8(sum0, sum0);
+        return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+    }
+
+    static inline blockMasks classify(const uint8_t *block) noexcept {
+        uint8x16_t quote[4], backslash[4], op[4], ws[4];
+        for (int k = 0; k < 4; ++k) {
+            uint8x16_t v = vld1q_u8(block + 16 * k);
+            auto eq = [v](uint8_t c) {return vceqq_u8(v, vdupq_n_u8(c));};
+            // ORing 0x20 maps '[' and ']' to '{' and '}':
+            uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+            quote[k] = eq('"');
+            backslash[k] = eq('\\');
+            op[k] = vorrq_u8(vorrq_u8(vceqq_u8(lower, vdupq_n_u8('{')),
+                                      vceqq_u8(lower, vdupq_n_u8('}'))),
+                             vorrq_u8(eq(':'), eq(',')));
+            ws[k] = vorrq_u8(vorrq_u8(eq(' '), eq('\t')), vorrq_u8(eq('\n'), eq('\r')));
+        }
+        return {movemask64(quote[0], quote[1], quote[2], quote[3]),
+                movemask64(backslash[0], backslash[1], backslash[2], backslash[3]),
+                movemask64(op[0], op[1], op[2], op[3]),
+                movemask64(ws[0], ws[1], ws[2], ws[3])};
+    }
+
+#else
+
+    enum : uint8_t {kQuoteClass = 1, kBackslashClass = 2, kOpClass = 4, kWSClass = 8};
+
+    static const struct charClasses {
+        uint8_t classOf[256];
+        charClasses() : classOf() {
+            classOf[uint8_t('"')] = kQuoteClass;
+            classOf[uint8_t('\\')] = kBackslashClass;
+            for (char c : {'{', '}', '[', ']', ':', ','})
+                classOf[uint8_t(c)] = kOpClass;
+            for (char c : {' ', '\t', '\n', '\r'})
+                classOf[uint8_t(c)] = kWSClass;
+        }
+    } kCharClasses;
+
+    static inline blockMasks classify(const uint8_t *block) noexcept {
+        blockMasks m = {0, 0, 0, 0};
+        for (unsigned i = 0; i < 64; ++i) {
+            uint8_t cls = kCharClasses.classOf[block[i]];
+            if (_usuallyFalse(cls != 0)) {
+                uint64_t bit = 1ull << i;
+                if (cls & kQuoteClass)      m.quote |= bit;
+                if (cls & kBackslashClass)  m.backslash |= bit;
+                if (cls & kOpClass)         m.op |= bit;
+                if (cls & kWSClass)         m.ws |= bit;
+            }
+        }
+        return m;
+    }
+
+#endif
+
+    // Each bit of the result is the XOR of that bit and all lower bits of the input.
+    static inline uint64_t prefixXor(uint64_t x) noexcept {
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+    }
+
+
+    uint32_t* JSONParser::StructuralScanner::scanBlock(const uint8_t *block,
+                                                      uint32_t blockPos,
+                                                      uint32_t *out) noexcept
+    {
+        blockMasks m = classify(block);
+
+        // Find the characters escaped by backslashes. These are rare, so a loop is fine:
+        uint64_t escaped = 0;
+        if (_usuallyFalse(m.backslash | _escapeCarry)) {
+            escaped = _escapeCarry;
+            uint64_t backslash = m.backslash & ~_escapeCarry;
+            _escapeCarry = 0;
+            while (backslash) {
+                unsigned i = countTrailingZeros64(backslash);
+                if (i == 63) {
+                    _escapeCarry = 1;
+                    break;
+                }
+                escaped |= 2ull << i;
+                backslash &= ~(3ull << i);      // the next char can't be an escape
+            }
+        }
+
+        // Quotes toggle the in-string state. `inString` includes opening quotes but not
+        // closing ones:
+        uint64_t quote = m.quote & ~escaped;
+        uint64_t inString = prefixXor(quote) ^ _inString;
+        _inString = uint64_t(int64_t(inString) >> 63);
+
+        // Scalars (numbers and literals) are runs of anything else; only their starts count:
+        uint64_t scalar = ~(m.op | m.ws | quote | inString);
+        uint64_t scalarStart = scalar & ~((scalar << 1) | _scalarCarry);
+        _scalarCarry = scalar >> 63;
+
+        uint64_t structural = (m.op & ~inString) | quote | scalarStart;
+        while (structural) {
+            *out++ = blockPos + countTrailingZeros64(structural);
+            structural &= structural - 1;
+        }
+        return out;
+    }
+
+
+#pragma mark - STAGE 2: PARSING
+
+
+    JSONParser::JSONParser(Encoder &encoder) noexcept
+    :_encoder(encoder)
+    { }
+
+
+    void JSONParser::reset() {
+        _scanner.reset();
+        _stack.clear();
+        _buffer.clear();
+        _input = _inputEnd = nullptr;
+        _inputOffset = _scanned = _pendingCount = 0;
+        _pos = 0;
+        _state = kValue;
+    }
+
+
+    int JSONParser::parse(slice json) {
+        reset();
+        setInput(json);
+        if (int err = run(true))
+            return err;
+        return checkComplete();
+    }
+
+
+    int JSONParser::feed(slice chunk) {
+        // Input left over from the last call is completed with bytes from this chunk, a block
+        // at a time, only until it's used up (which is usually after one block):
+        while (!_buffer.empty() && chunk.size > 0) {
+            size_t n = std::min(chunk.size, 64 - (_buffer.size() - _scanned));
+            _buffer.append((const char*)chunk.buf, n);
+            chunk.moveStart(n);
+            setInput(slice(_buffer));
+            if (int err = run(false))
+                return err;
+            keepUnconsumed();
+        }
+        // Then the rest of the chunk is parsed in place:
+        if (chunk.size > 0) {
+            setInput(chunk);
+            if (int err = run(false))
+                return err;
+            keepUnconsumed();
+        }
+        return 0;
+    }
+
+
+    // After a non-final `run`, saves the input it couldn't consume in `_buffer`: the incomplete
+    // token (if any) and the bytes that don't fill a block.
+    void JSONParser::keepUnconsumed() {
+        size_t keep = _pendingCount ? _index[0] : _scanned;
+        if (_pendingCount)
+            _index[0] = 0;
+        _scanned -= keep;
+        _inputOffset += keep;
+        if (_input == (const uint8_t*)_buffer.data())
+            _buffer.erase(0, keep);
+        else
+            _buffer.assign((const char*)_input + keep, _inputEnd - _input - keep);
+        _input = _inputEnd = nullptr;
+    }
+
+
+    int JSONParser::finish() {
+        setInput(slice(_buffer));
+        if (int err = run(true))
+            return err;
+        return checkComplete();
+    }
+
+
+    void JSONParser::setInput(slice input) {
+        throwIf(input.size > UINT32_MAX, JSONError, "JSON data too large");
+        _input = (const uint8_t*)input.buf;
+        _inputEnd = (const uint8_t*)input.end();
+    }
+
+
+    // Scans and parses the input from `_scanned` onwards. If `final` is false, more input may
+    // follow, so a partial block at the end is left unscanned, and a token that might continue
+    // past the end is left in the index for next time.
+    int JSONParser::run(bool final) {
+        if (_index.empty())
+            _index.resize(kIndexBatchSize + 64 + 1);
+        uint32_t *indexStart = _index.data(), *indexEnd = indexStart + _pendingCount;
+        const uint32_t *indexLimit = indexStart + kIndexBatchSize;
+        size_t pos = _scanned, size = _inputEnd - _input;
+        while (true) {
+            // Stage 1: Index a stretch of the input:
+            for (; pos + 64 <= size && indexEnd < indexLimit; pos += 64)
+                indexEnd = _scanner.scanBlock(&_input[pos], uint32_t(pos), indexEnd);
+            if (final && pos < size && indexEnd < indexLimit) {
+                uint8_t block[64];
+                memset(block, ' ', sizeof(block));
+                memcpy(block, &_input[pos], size - pos);
+                indexEnd = _scanner.scanBlock(block, uint32_t(pos), indexEnd);
+                pos = size;
+            }
+            bool atEnd = (size - pos < (final ? 1 : 64));
+
+            // Stage 2: Parse the tokens found. Any token whose end isn't known yet is left in
+            // the index for the next round:
+            const uint32_t *stoppedAt;
+            if (int err = walk(indexStart, indexEnd, final && atEnd, stoppedAt))
+                return err;
+            indexEnd = std::copy(stoppedAt, (const uint32_t*)indexEnd, indexStart);
+            if (atEnd)
+                break;
+        }
+        _scanned = pos;
+        _pendingCount = indexEnd - indexStart;
+        return 0;
+    }
+
+
+    int JSONParser::checkComplete() {
+        if (_usuallyFalse(_state != kDone))
+            return error(JSONConverter::kErrTruncatedJSON, _inputEnd);
+        return 0;
+    }
+
+
+    int JSONParser::walk(const uint32_t *i, const uint32_t *end, bool final,
+                         const uint32_t* &stoppedAt)
+    {
+        for (; i < end; ++i) {
+            _pos = _inputOffset + *i;
+            const uint8_t *token = &_input[*i];
+            int err;
+            switch (*token) {
+                case '{':
+                case '[':
+                    err = openCollection(*token == '{');
+                    break;
+                case '}':
+                case ']':
+                    err = closeCollection(*token == '}');
+                    break;
+                case ':':
+                    if (_usuallyFalse(_state != kColon))
+                        return error(JSONSL_ERROR_STRAY_TOKEN, token);
+                    _state = kValue;
+                    err = 0;
+                    break;
+                case ',':
+                    if (_usuallyFalse(_state != kCommaOrEnd))
+                        return error(JSONSL_ERROR_STRAY_TOKEN, token);
+                    _state = _stack.back() ? kKey : kValue;
+                    err = 0;
+                    break;
+                case '"':
+                    // The next index entry is the closing quote:
+                    if (_usuallyFalse(i + 1 == end)) {
+                        if (final)
+                            return error(JSONConverter::kErrTruncatedJSON, _inputEnd);
+                        stoppedAt = i;
+                        return 0;
+                    }
+                    ++i;
+                    err = parseString(token + 1, &_input[*i]);
+                    break;
+                default: {
+                    // A number or literal extends to the next index entry:
+                    const uint8_t *tokenEnd;
+                    if (i + 1 < end)
+                        tokenEnd = &_input[i[1]];
+                    else if (final)
+                        tokenEnd = _inputEnd;
+                    else {
+                        stoppedAt = i;
+                        return 0;
+                    }
+                    err = parseScalar(token, tokenEnd);
+                    break;
+                }
+            }
+            if (_usuallyFalse(err != 0))
+                return err;
+        }
+        stoppedAt = end;
+        return 0;
+    }
+
+
+    // Returns an error code if a value isn't allowed next, else 0.
+    int JSONParser::checkValueAllowed() const noexcept {
+        switch (_state) {
+            case kValue:
+            case kFirstValue:   return 0;
+            case kKey:
+            case kFirstKey:     return JSONSL_ERROR_HKEY_EXPECTED;
+            case kDone:         return JSONSL_ERROR_GARBAGE_TRAILING;
+            default:            return JSONSL_ERROR_MISSING_TOKEN;
+        }
+    }
+
+
+    int JSONParser::openCollection(bool isDict) {
+        if (int err = checkValueAllowed())
+            return error(err, _pos);
+        if (_usuallyFalse(_stack.size() >= kMaxDepth))
+            return error(JSONSL_ERROR_LEVELS_EXCEEDED, _pos);
+        _stack.push_back(isDict);
+        if (isDict) {
+            _encoder.beginDictionary();
+            _state = kFirstKey;
+        } else {
+            _encoder.beginArray();
+            _state = kFirstValue;
+        }
+        return 0;
+    }
+
+
+    int JSONParser::closeCollection(bool isDict) {
+        switch (_state) {
+            case kCommaOrEnd:
+            case kFirstValue:
+            case kFirstKey:
+                break;
+            case kValue:
+                if (_stack.empty())
+                    return error(JSONSL_ERROR_STRAY_TOKEN, _pos);
+                return error(_stack.back() ? JSONSL_ERROR_VALUE_EXPECTED
+                                           : JSONSL_ERROR_TRAILING_COMMA, _pos);
+            case kKey:
+                return error(JSONSL_ERROR_TRAILING_COMMA, _pos);
+            case kDone:
+                return error(JSONSL_ERROR_GARBAGE_TRAILING, _pos);
+            default:
+                return error(JSONSL_ERROR_MISSING_TOKEN, _pos);
+        }
+        if (_usuallyFalse(_stack.back() != isDict))
+            return error(JSONSL_ERROR_BRACKET_MISMATCH, _pos);
+        _stack.pop_back();
+        if (isDict)
+            _encoder.endDictionary();
+        else
+            _encoder.endArray();
+        valueDone();
+        return 0;
+    }
+
+
+#pragma mark - STRINGS:
+
+
+    // `start` and `end` are the bounds of the string's contents, not including the quotes.
+    int JSONParser::parseString(const uint8_t *start, const uint8_t *end) {
+        bool isKey = (_state == kKey || _state == kFirstKey);
+        if (!isKey) {
+            if (int err = checkValueAllowed())
+                return error(err, start - 1);
+        }
+        slice str(start, end);
+        // Strings without escapes can be written straight from the input:
+        auto backslash = (const uint8_t*)memchr(start, '\\', end - start);
+        if (_usuallyFalse(backslash != nullptr)) {
+            // Unescaping never makes a string longer, so `end - start` bytes is always enough.
+            size_t maxSize = end - start;
+            if (!isKey && maxSize > internal::kMaxSharedStringSize) {
+                // A long string won't be deduplicated, so unescape it right into the output:
+                char *dst = _encoder.beginString(maxSize);
+                size_t size;
+                if (int err = unescape(start, end, backslash, dst, size)) {
+                    _encoder.cancelString();
+                    return err;
+                }
+                _encoder.finishString(dst, size);
+                valueDone();
+                return 0;
+            }
+            if (_unescaped.size() < maxSize)
+                _unescaped.resize(maxSize);
+            size_t size;
+            if (int err = unescape(start, end, backslash, &_unescaped[0], size))
+                return err;
+            str = slice(_unescaped.data(), size);
+        }
+        if (isKey) {
+            _encoder.writeKey(str);
+            _state = kColon;
+        } else {
+            _encoder.writeString(str);
+            valueDone();
+        }
+        return 0;
+    }
+
+
+    static inline int hexDigitValue(uint8_t c) noexcept {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        c |= 0x20;
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        return -1;
+    }
+
+    // Reads the 4 hex digits of a "\u" escape.
+    static int readHex4(const uint8_t *p, const uint8_t *end, uint32_t &result) noexcept {
+        if (_usuallyFalse(end - p < 4))
+            return JSONSL_ERROR_UESCAPE_TOOSHORT;
+        result = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = hexDigitValue(p[i]);
+            if (_usuallyFalse(digit < 0))
+                return JSONSL_ERROR_PERCENT_BADHEX;
+            result = (result << 4) | digit;
+        }
+        return 0;
+    }
+
+    // Writes the UTF-8 encoding of `cp` to `buf`, returning the number of bytes written.
+    static size_t putUTF8(char *buf, uint32_t cp) {
+        size_t n;
+        if (cp < 0x80) {
+            buf[0] = char(cp);
+            n = 1;
+        } else if (cp < 0x800) {
+            buf[0] = char(0xC0 | (cp >> 6));
+            buf[1] = char(0x80 | (cp & 0x3F));
+            n = 2;
+        } else if (cp < 0x10000) {
+            buf[0] = char(0xE0 | (cp >> 12));
+            buf[1] = char(0x80 | ((cp >> 6) & 0x3F));
+            buf[2] = char(0x80 | (cp & 0x3F));
+            n = 3;
+        } else {
+            buf[0] = char(0xF0 | (cp >> 18));
+            buf[1] = char(0x80 | ((cp >> 12) & 0x3F));
+            buf[2] = char(0x80 | ((cp >> 6) & 0x3F));
+            buf[3] = char(0x80 | (cp & 0x3F));
+            n = 4;
+        }
+        return n;
+    }
+
+
+    // Unescapes the string into `dst`, which must have room for `end - start` bytes, copying
+    // the runs between escapes in bulk. `backslash` points to the first backslash.
+    // On success, sets `outSize` to the unescaped length.
+    int JSONParser::unescape(const uint8_t *start, const uint8_t *end, const uint8_t *backslash,
+                             char *dst, size_t &outSize)
+    {
+        char *out = dst;
+        const uint8_t *p = start;
+        do {
+            memcpy(out, p, backslash - p);
+            out += backslash - p;
+            p = backslash + 1;      // (a backslash can't be last, since it'd escape the quote)
+            char c;
+            switch (*p++) {
+                case '"':
+                case '\\':
+                case '/':   c = char(p[-1]); break;
+                case 'b':   c = '\b'; break;
+                case 'f':   c = '\f'; break;
+                case 'n':   c = '\n'; break;
+                case 'r':   c = '\r'; break;
+                case 't':   c = '\t'; break;
+                case 'u': {
+                    uint32_t cp, low;
+                    if (int err = readHex4(p, end, cp))
+                        return error(err, backslash);
+                    p += 4;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        // High surrogate; must be followed by an escaped low surrogate:
+                        if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                            return error(JSONSL_ERROR_INVALID_CODEPOINT, backslash);
+                        if (int err = readHex4(p + 2, end, low))
+                            return error(err, p);
+                        if (low < 0xDC00 || low >= 0xE000)
+                            return error(JSONSL_ERROR_INVALID_CODEPOINT, p);
+                        p += 6;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp < 0xE000) {
+                        return error(JSONSL_ERROR_INVALID_CODEPOINT, backslash);
+                    }
+                    out += putUTF8(out, cp);
+                    continue;
+                }
+                default:
+                    return error(JSONSL_ERROR_ESCAPE_INVALID, backslash);
+            }
+            *out++ = c;
+        } while ((backslash = (const uint8_t*)memchr(p, '\\', end - p)) != nullptr);
+        memcpy(out, p, end - p);
+        outSize = (out - dst) + (end - p);
+        return 0;
+    }
+
+
+#pragma mark - NUMBERS & LITERALS:
+
+
+    static inline bool isWhitespace(uint8_t c) noexcept {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    static inline bool matchLiteral(const uint8_t *start, const uint8_t *end,
+                                    const char *literal, size_t len) noexcept {
+        return size_t(end - start) >= len && memcmp(start, literal, len) == 0
+                                          && (size_t(end - start) == len || isWhitespace(start[len]));
+    }
+
+
+    // `end` is the start of the next token, or the end of the input; it may be preceded by
+    // whitespace.
+    int JSONParser::parseScalar(const uint8_t *start, const uint8_t *end) {
+        if (int err = checkValueAllowed())
+            return error(err, start);
+        switch (*start) {
+            case 't':
+                if (_usuallyFalse(!matchLiteral(start, end, "true", 4)))
+                    return error(JSONSL_ERROR_SPECIAL_EXPECTED, start);
+                _encoder.writeBool(true);
+                break;
+            case 'f':
+                if (_usuallyFalse(!matchLiteral(start, end, "false", 5)))
+                    return error(JSONSL_ERROR_SPECIAL_EXPECTED, start);
+                _encoder.writeBool(false);
+                break;
+            case 'n':
+                if (_usuallyFalse(!matchLiteral(start, end, "null", 4)))
+                    return error(JSONSL_ERROR_SPECIAL_EXPECTED, start);
+                _encoder.writeNull();
+                break;
+            case '-':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                if (int err = parseNumber(start, end))
+                    return err;
+                break;
+            default:
+                return error(JSONSL_ERROR_SPECIAL_EXPECTED, start);
+        }
+        valueDone();
+        return 0;
+    }
+
+
+    static inline bool isDigit(uint8_t c) noexcept {
+        return c >= '0' && c <= '9';
+    }
+
+
+    // Validates and converts a number in a single pass: integers are accumulated as they're
+    // scanned, and only numbers with a fraction or exponent go through ParseDouble.
+    int JSONParser::parseNumber(const uint8_t *start, const uint8_t *end) {
+        const uint8_t *p = start;
+        bool negative = (*p == '-');
+        if (negative)
+            ++p;
+        if (_usuallyFalse(p == end || !isDigit(*p)))
+            return error(JSONSL_ERROR_INVALID_NUMBER, start);
+
+        uint64_t n = 0;
+        bool isFloat = false;
+        if (*p == '0') {
+            ++p;
+        } else {
+            do {
+                unsigned digit = *p - '0';
+                if (_usuallyFalse(n > (UINT64_MAX - digit) / 10))
+                    isFloat = true;             // Too big for an integer
+                n = n * 10 + digit;
+                ++p;
+            } while (p < end && isDigit(*p));
+        }
+        if (p < end && *p == '.') {
+            isFloat = true;
+            ++p;
+            if (_usuallyFalse(p == end || !isDigit(*p)))
+                return error(JSONSL_ERROR_INVALID_NUMBER, start);
+            do { ++p; } while (p < end && isDigit(*p));
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            isFloat = true;
+            ++p;
+            if (p < end && (*p == '+' || *p == '-'))
+                ++p;
+            if (_usuallyFalse(p == end || !isDigit(*p)))
+                return error(JSONSL_ERROR_INVALID_NUMBER, start);
+            do { ++p; } while (p < end && isDigit(*p));
+        }
+        if (_usuallyFalse(p < end && !isWhitespace(*p)))
+            return error(JSONSL_ERROR_INVALID_NUMBER, start);
+
+        if (_usuallyFalse(isFloat)) {
+            _encoder.writeDouble(ParseDouble((const char*)start, p - start));
+        } else if (negative) {
+            if (_usuallyFalse(n > uint64_t(INT64_MAX) + 1))
+                _encoder.writeDouble(-double(n));
+            else
+                _encoder.writeInt(int64_t(0 - n));
+        } else {
+            _encoder.writeUInt(n);
+        }
+        return 0;
+    }
+
+} }
@@ -0,0 +1,128 @@
+//
+// JSONParser.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "fleece/slice.hh"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace fleece { namespace impl {
+    class Encoder;
+
+    /** A fast JSON parser that writes the values it parses to an Encoder. Used by JSONConverter.
+
+        It works in two stages, a bit like simdjson: first it scans a stretch of input with SIMD
+        instructions to build an index of the positions of structural characters (brackets,
+        braces, colons, commas, quotes, and the starts of numbers and literals), ignoring
+        anything inside strings. Then it walks that index, using it to find the extent of each
+        token without re-scanning the bytes.
+
+        Errors are reported using the same `jsonsl_error_t` codes as the jsonsl parser. */
+    class JSONParser {
+    public:
+        /** The maximum number of nested arrays/objects. Deeper input fails with
+            JSONSL_ERROR_LEVELS_EXCEEDED, since Fleece data that deep can't be validated or
+            traversed safely. (The same limit the jsonsl parser was given.) */
+        static constexpr size_t kMaxDepth = 50;
+
+        explicit JSONParser(Encoder &encoder) noexcept;
+
+        /** Parses a complete JSON value, writing it to the encoder.
+            @return  0 on success, else a `jsonsl_error_t` code, or
+                     JSONConverter::kErrTruncatedJSON if the input ends prematurely. */
+        int parse(slice json);
+
+        /** Parses the next chunk of a JSON value that's arriving incrementally. A chunk may end
+            anywhere, even in the middle of a string or number; whatever can't be parsed yet (an
+            incomplete token, and bytes that don't fill a 64-byte block) is copied and saved
+            until the next call, which appends just enough of its chunk to that to finish it and
+            then parses the rest of the chunk in place. Call `finish` after the last chunk.
+            @return  0 on success, else a `jsonsl_error_t` code. */
+        int feed(slice chunk);
+
+        /** Finishes parsing after the last call to `feed`.
+            @return  0 on success, else a `jsonsl_error_t` code, or
+                     JSONConverter::kErrTruncatedJSON if the input ended prematurely. */
+        int finish();
+
+        /** The byte offset in the input at which an error occurred, or where the parser was
+            when the encoder threw an exception. */
+        size_t errorPos() const                 {return _pos;}
+
+        /** Resets the parser, as though you'd constructed a new one. */
+        void reset();
+
+    private:
+        // Stage 1: finds the structural characters in the input.
+        class StructuralScanner {
+        public:
+            void reset()                        {_inString = _escapeCarry = _scalarCarry = 0;}
+            // Scans a 64-byte block, appends the structural positions to `out`, returns new end.
+            uint32_t* scanBlock(const uint8_t *block, uint32_t blockPos, uint32_t *out) noexcept;
+        private:
+            uint64_t _inString {0};             // All 1s if the last block ended inside a string
+            uint64_t _escapeCarry {0};          // 1 if the next block's 1st byte is escaped
+            uint64_t _scalarCarry {0};          // 1 if the last block ended inside a scalar
+        };
+
+        // What the parser expects next:
+        enum State : uint8_t {
+            kValue,             // A value (at top level, or after ':' or ',' in an array)
+            kFirstValue,        // A value or ']' (just after '[')
+            kKey,               // A key (after ',' in an object)
+            kFirstKey,          // A key or '}' (just after '{')
+            kColon,             // A ':' (after a key)
+            kCommaOrEnd,        // A ',' or closing bracket (after a value in a collection)
+            kDone,              // Nothing (after the top-level value)
+        };
+
+        void setInput(slice);
+        int run(bool final);
+        void keepUnconsumed();
+        int checkComplete();
+        int walk(const uint32_t *index, const uint32_t *indexEnd, bool final,
+                 const uint32_t* &stoppedAt);
+        int checkValueAllowed() const noexcept;
+        int openCollection(bool isDict);
+        int closeCollection(bool isDict);
+        void valueDone()            {_state = _stack.empty() ? kDone : kCommaOrEnd;}
+        int parseString(const uint8_t *start, const uint8_t *end);
+        int unescape(const uint8_t *start, const uint8_t *end, const uint8_t *backslash,
+                     char *dst, size_t &outSize);
+        int parseScalar(const uint8_t *start, const uint8_t *end);
+        int parseNumber(const uint8_t *start, const uint8_t *end);
+        int error(int code, size_t pos)         {_pos = pos; return code;}
+        int error(int code, const uint8_t *at)  {return error(code, _inputOffset + (at - _input));}
+
+        Encoder&                _encoder;
+        StructuralScanner       _scanner;
+        std::vector<uint32_t>   _index;         // Positions of structural characters
+        std::vector<bool>       _stack;         // Open collections (true = object)
+        std::string             _unescaped;     // Scratch buffer for unescaping; only grows
+        std::string             _buffer;        // Unconsumed input saved between `feed` calls
+        const uint8_t*          _input {nullptr};   // Start of the input
+        const uint8_t*          _inputEnd {nullptr};
+        size_t                  _inputOffset {0};   // Offset of `_input` in the whole stream
+        size_t                  _scanned {0};       // Number of bytes of `_input` indexed
+        size_t                  _pendingCount {0};  // Index entries left over from last run
+        size_t                  _pos {0};           // Offset of the current token
+        State                   _state {kValue};    // What's expected next
+    };
+
+} }
@@ -19,7 +19,9 @@
 #include "Path.hh"
 #include "SharedKeys.hh"
 #include "FleeceException.hh"
+#include "NumConversion.hh"
 #include "PlatformCompat.hh"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -29,10 +31,15 @@ namespace fleece { namespace impl {
 
     void Path::addComponents(slice components) {
         forEachComponent(components, _path.empty(), [&](char token, slice component, int32_t index) {
-            if (token == '.')
-                _path.emplace_back(component);
-            else
-                _path.emplace_back(index);
+            switch (token) {
+                case '.':   _path.emplace_back(component); break;
+                case '[':   _path.emplace_back(index); break;
+                // The other constructor can throw, so the element is created before adding it:
+                case '*':   _path.push_back(Element(Element::kWildcard, component)); break;
+                case '~':   _path.push_back(Element(Element::kDescendants, component)); break;
+                case ':':   _path.push_back(Element(Element::kSlice, component)); break;
+                case '?':   _path.push_back(Element(Element::kFilter, component)); break;
+            }
             return true;
         });
     }
@@ -62,6 +69,14 @@ namespace fleece { namespace impl {
     }
 
 
+    bool Path::isSingular() const {
+        for (auto &element : _path)
+            if (!element.isSingular())
+                return false;
+        return true;
+    }
+
+
 #pragma mark - ENCODING:
 
 
@@ -75,11 +90,33 @@ namespace fleece { namespace impl {
     void Path::writeTo(std::ostream &out) const {
         bool first = true;
         for (auto &element : _path) {
-            if (element.isKey())
-                writeProperty(out, element.key().string(), first);
-            else
-                writeIndex(out, element.index());
-            first = false;
+            slice param = element._keyBuf;
+            switch (element.type()) {
+                case Element::kProperty:
+                    writeProperty(out, element.key().string(), first);
+                    break;
+                case Element::kIndex:
+                    writeIndex(out, element.index());
+                    break;
+                case Element::kWildcard:
+                    out << "[*]";
+                    break;
+                case Element::kDescendants:
+                    out << "..";
+                    break;
+                case Element::kSlice:
+                    out << '[';
+                    out.write((const char*)param.buf, param.size);
+                    out << ']';
+                    break;
+                case Element::kFilter:
+                    out << "[?(";
+                    out.write((const char*)param.buf, param.size);
+                    out << ")]";
+                    break;
+            }
+            // A property following ".." doesn't get another '.' prefix:
+            first = (element.type() == Element::kDescendants);
         }
     }
 
@@ -91,6 +128,10 @@ namespace fleece { namespace impl {
         } else {
             out << '.';
         }
+        if (key == "*"_sl) {
+            out << "\\*";             // else it would be read as a wildcard
+            return;
+        }
         const uint8_t *toQuote;
         while (nullptr != (toQuote = key.findAnyByteOf(".[\\"_sl))) {
             out.write((const char *)key.buf, toQuote - (const uint8_t*)key.buf);
@@ -102,18 +143,24 @@ namespace fleece { namespace impl {
 
 
     void Path::writeIndex(std::ostream &out, int index) {
-        out << '[' << index << ']';
+        char str[kMaxIntStringSize + 2];
+        str[0] = '[';
+        size_t length = 1 + WriteInt(index, &str[1]);
+        str[length++] = ']';
+        out.write(str, length);
     }
 
 
 #pragma mark - EVALUATION:
 
 
-    const Value* Path::eval(const Value *root) const noexcept {
+    const Value* Path::eval(const Value *root) const {
         const Value *item = root;
         if (_usuallyFalse(!item))
             return nullptr;
         for (auto &e : _path) {
+            if (_usuallyFalse(!e.isSingular()))
+                return iterator(*this, root).value();
             item = e.eval(item);
             if (!item)
                 break;
@@ -126,10 +173,17 @@ namespace fleece { namespace impl {
         const Value *item = root;
         if (_usuallyFalse(!item))
             return nullptr;
+        bool singular = true;
         forEachComponent(specifier, true, [&](char token, slice component, int32_t index) {
+            if (_usuallyFalse(token != '.' && token != '[')) {
+                singular = false;
+                return false;
+            }
             item = Element::eval(token, component, index, item);
             return (item != nullptr);
         });
+        if (_usuallyFalse(!singular))
+            return Path(specifier).eval(root);
         return item;
     }
 
@@ -174,7 +228,33 @@ namespace fleece { namespace impl {
 #pragma mark - PARSING:
 
 
-    // Parses a path expression, calling the callback for each property or array index.
+    // Returns a pointer to the ')' that closes a filter expression "?(...", skipping over any
+    // nested parentheses and quoted strings.
+    static const uint8_t* findFilterEnd(slice in) {
+        int depth = 0;
+        uint8_t quote = 0;
+        for (auto c = (const uint8_t*)in.buf + 1; c < in.end(); ++c) {
+            if (quote) {
+                if (*c == '\\')
+                    ++c;
+                else if (*c == quote)
+                    quote = 0;
+            } else if (*c == '\'' || *c == '"') {
+                quote = *c;
+            } else if (*c == '(') {
+                ++depth;
+            } else if (*c == ')' && --depth == 0) {
+                return c;
+            }
+        }
+        FleeceException::_throw(PathSyntaxError, "Missing ')' after filter");
+    }
+
+
+    // Parses a path expression, calling the callback for each component. The token passed to
+    // the callback is '.' for a property, '[' for an array index, '*' for a wildcard, '~' for
+    // a recursive descent (".."), ':' for an array slice and '?' for a filter; the last two
+    // pass the text of the slice or filter expression as the parameter.
     void Path::forEachComponent(slice in, bool atStart, eachComponentCallback callback) {
         throwIf(in.size == 0, PathSyntaxError, "Empty path");
         throwIf(in[in.size-1] == '\\', PathSyntaxError, "'\\' at end of string");
@@ -211,6 +291,18 @@ namespace fleece { namespace impl {
             alloc_slice unescaped;
             int32_t index = 0;
 
+            if (token == '.' && in.hasPrefix('.')) {
+                // ".." is followed by a property name, "*" or a bracketed component:
+                if (_usuallyFalse(!callback('~', nullslice, 0)))
+                    return;
+                in.moveStart(1);
+                throwIf(in.size == 0 || in[0] == '.', PathSyntaxError, "Missing name after '..'");
+                if (in[0] == '[') {
+                    token = '[';
+                    in.moveStart(1);
+                }
+            }
+
             if (token == '.') {
                 // Find end of property name:
                 next = in.findAnyByteOf(".[\\"_sl);
@@ -235,24 +327,41 @@ namespace fleece { namespace impl {
                     }
                     param = slice(unescaped.buf, dst);
                 }
+                if (param == "*"_sl && !unescaped)
+                    token = '*';
 
             } else if (token == '[') {
-                // Find end of array index:
-                next = in.findByteOrEnd(']');
-                if (!next)
-                    FleeceException::_throw(PathSyntaxError, "Missing ']'");
-                param = slice(in.buf, next++);
-                // Parse array index:
-                slice n = param;
-                int64_t i = n.readSignedDecimal();
-                throwIf(param.size == 0 || n.size > 0 || i > INT32_MAX || i < INT32_MIN,
-                        PathSyntaxError, "Invalid array index");
-                index = (int32_t)i;
+                if (in.hasPrefix("?("_sl)) {
+                    // Filter expression, which may itself contain brackets:
+                    next = findFilterEnd(in);
+                    param = slice(&in[2], next);
+                    throwIf(next + 1 >= in.end() || next[1] != ']', PathSyntaxError, "Missing ']'");
+                    next += 2;
+                    token = '?';
+                } else {
+                    // Find end of array index:
+                    next = in.findByteOrEnd(']');
+                    if (!next)
+                        FleeceException::_throw(PathSyntaxError, "Missing ']'");
+                    param = slice(in.buf, next++);
+                    if (param == "*"_sl) {
+                        token = '*';
+                    } else if (param.findByte(':')) {
+                        token = ':';
+                    } else {
+                        // Parse array index:
+                        slice n = param;
+                        int64_t i = n.readSignedDecimal();
+                        throwIf(param.size == 0 || n.size > 0 || i > INT32_MAX || i < INT32_MIN,
+                                PathSyntaxError, "Invalid array index");
+                        index = (int32_t)i;
+                    }
+                }
             } else {
                 FleeceException::_throw(PathSyntaxError, "Invalid path component");
             }
 
-            if (param.size > 0) {
+            if (param.size > 0 || token != '.') {
                 // Invoke the callback:
                 if (_usuallyFalse(!callback(token, param, index)))
                     return;
@@ -269,6 +378,145 @@ namespace fleece { namespace impl {
     }
 
 
+#pragma mark - FILTER:
+
+
+    // A compiled filter expression: "@.sub.path op literal", or just "@.sub.path".
+    struct Path::Element::Filter {
+        enum Op : uint8_t {kExists, kEQ, kNE, kLT, kLE, kGT, kGE};
+
+        explicit Filter(slice expr);
+        Filter(const Filter&);
+        bool matches(const Value *item NONNULL) const;
+
+        Path        path;               // Relative to the item being tested
+        Op          op {kExists};
+        valueType   literalType {kNull};
+        double      number {0};
+        alloc_slice string;
+        bool        boolean {false};
+    };
+
+
+    static void skipSpaces(slice &in) {
+        in.readBytesInSet(" \t"_sl);
+    }
+
+
+    Path::Element::Filter::Filter(slice in) {
+        skipSpaces(in);
+        throwIf(in.readByte() != '@', PathSyntaxError, "Filter must start with '@'");
+
+        // The sub-path ends at a space or at the operator:
+        auto end = in.findAnyByteOf(" \t=!<>"_sl);
+        slice subPath(in.buf, end ? end : (const uint8_t*)in.end());
+        if (subPath.size > 0) {
+            path.addComponents(subPath);
+            throwIf(!path.isSingular(), PathSyntaxError,
+                    "Filter path can only have properties and array indexes");
+        }
+        in.setStart(subPath.end());
+        skipSpaces(in);
+        if (in.size == 0)
+            return;
+
+        // Operator:
+        uint8_t c = in.readByte();
+        bool orEqual = in.hasPrefix('=');
+        if (orEqual)
+            in.moveStart(1);
+        switch (c) {
+            case '=':   throwIf(!orEqual, PathSyntaxError, "Use '==' in filter");
+                        op = kEQ; break;
+            case '!':   throwIf(!orEqual, PathSyntaxError, "Invalid operator in filter");
+                        op = kNE; break;
+            case '<':   op = orEqual ? kLE : kLT; break;
+            case '>':   op = orEqual ? kGE : kGT; break;
+            default:    FleeceException::_throw(PathSyntaxError, "Invalid operator in filter");
+        }
+        skipSpaces(in);
+
+        // Literal:
+        c = in.peekByte();
+        if (c == '"' || c == '\'') {
+            in.moveStart(1);
+            string.reset(in.size);
+            auto dst = (uint8_t*)string.buf;
+            while (true) {
+                throwIf(in.size == 0, PathSyntaxError, "Unterminated string in filter");
+                uint8_t ch = in.readByte();
+                if (ch == c)
+                    break;
+                if (ch == '\\' && in.size > 0)
+                    ch = in.readByte();
+                *dst++ = ch;
+            }
+            string.shorten(dst - (uint8_t*)string.buf);
+            literalType = kString;
+        } else if (in.hasPrefix("true"_sl) || in.hasPrefix("false"_sl)) {
+            boolean = (c == 't');
+            in.moveStart(boolean ? 4 : 5);
+            literalType = kBoolean;
+        } else if (in.hasPrefix("null"_sl)) {
+            in.moveStart(4);
+            literalType = kNull;
+        } else {
+            slice num = in.readBytesInSet("0123456789+-.eE"_sl);
+            throwIf(num.size == 0, PathSyntaxError, "Invalid literal in filter");
+            number = ParseDouble((const char*)num.buf, num.size);
+            literalType = kNumber;
+        }
+        skipSpaces(in);
+        throwIf(in.size > 0, PathSyntaxError, "Unexpected characters at end of filter");
+    }
+
+
+    Path::Element::Filter::Filter(const Filter &other)
+    :op(other.op)
+    ,literalType(other.literalType)
+    ,number(other.number)
+    ,string(other.string)
+    ,boolean(other.boolean)
+    {
+        path += other.path;
+    }
+
+
+    bool Path::Element::Filter::matches(const Value *item) const {
+        const Value *value = path.empty() ? item : path.eval(item);
+        if (op == kExists)
+            return value != nullptr;
+        // Values of different types are never equal, nor ordered:
+        if (!value || value->type() != literalType)
+            return op == kNE;
+        int cmp = 0;
+        switch (literalType) {
+            case kNumber: {
+                double n = value->asDouble();
+                cmp = (n > number) - (n < number);
+                break;
+            }
+            case kString:
+                cmp = value->asString().compare(string);
+                break;
+            case kBoolean:
+                if (value->asBool() != boolean)
+                    return op == kNE;
+                break;
+            default:
+                break;
+        }
+        switch (op) {
+            case kEQ:   return cmp == 0;
+            case kNE:   return cmp != 0;
+            case kLT:   return cmp < 0;
+            case kLE:   return cmp <= 0;
+            case kGT:   return cmp > 0;
+            default:    return cmp >= 0;
+        }
+    }
+
+
 #pragma mark - ELEMENT CLASS:
 
 
@@ -278,23 +526,69 @@ namespace fleece { namespace impl {
     { }
 
 
+    Path::Element::Element(int32_t arrayIndex)
+    :_type(kIndex)
+    ,_index(arrayIndex)
+    { }
+
+
+    Path::Element::Element(Type type, slice param)
+    :_keyBuf(param)
+    ,_type(type)
+    {
+        if (type == kSlice) {
+            // Parse "start:end" or "start:end:step", any of which may be omitted:
+            int64_t bounds[3] = {0, INT32_MAX, 1};
+            slice in = param;
+            for (int i = 0; i < 3; ++i) {
+                if (in.size > 0 && in.peekByte() != ':') {
+                    size_t size = in.size;
+                    int64_t n = in.readSignedDecimal();
+                    throwIf(in.size == size || n > INT32_MAX || n < INT32_MIN,
+                            PathSyntaxError, "Invalid array slice");
+                    bounds[i] = n;
+                }
+                if (in.size == 0)
+                    break;
+                throwIf(i == 2 || in.readByte() != ':', PathSyntaxError, "Invalid array slice");
+            }
+            throwIf(bounds[2] <= 0, PathSyntaxError, "Array slice step must be positive");
+            _index = (int32_t)bounds[0];
+            _end = (int32_t)bounds[1];
+            _step = (int32_t)bounds[2];
+        } else if (type == kFilter) {
+            _filter.reset(new Filter(param));
+        }
+    }
+
+
     Path::Element::Element(const Element &other)
     :_keyBuf(other._keyBuf)
+    ,_type(other._type)
     ,_index(other._index)
+    ,_end(other._end)
+    ,_step(other._step)
     {
         if (other._key)
             _key.reset(new Dict::key(_keyBuf));
+        if (other._filter)
+            _filter.reset(new Filter(*other._filter));
     }
 
 
+    Path::Element::~Element() =default;
+
+
     const Value* Path::Element::eval(const Value *item) const noexcept {
-        if (_key) {
+        if (_type == kProperty) {
             auto d = item->asDict();
             if (_usuallyFalse(!d))
                 return nullptr;
             return d->get(*_key);
-        } else {
+        } else if (_type == kIndex) {
             return getFromArray(item, _index);
+        } else {
+            return nullptr;
         }
     }
 
@@ -324,4 +618,148 @@ namespace fleece { namespace impl {
         return a->get((uint32_t)index);
     }
 
+
+
+#pragma mark - ITERATOR:
+
+
+    // Iterates over the items of an array or the values of a dict.
+    struct Path::iterator::Children {
+        explicit Children(const Value *container) noexcept
+        :_array(Value::asArray(container))
+        ,_dict(Value::asDict(container))
+        { }
+
+        const Value* next() noexcept {
+            if (_array)
+                return _array.read();
+            if (_dict) {
+                auto value = _dict.value();
+                ++_dict;
+                return value;
+            }
+            return nullptr;
+        }
+
+    private:
+        Array::iterator _array;
+        Dict::iterator _dict;
+    };
+
+
+    // The state of matching one element of the path against one input value.
+    struct Path::iterator::Frame {
+        Frame(const Element &elem, size_t depth_, const Value *input_ NONNULL) noexcept
+        :element(&elem)
+        ,depth(depth_)
+        ,input(input_)
+        ,children(elem.type() == Element::kWildcard || elem.type() == Element::kFilter
+                    ? input_ : nullptr)
+        {
+            if (elem.type() == Element::kSlice) {
+                auto a = input->asArray();
+                int64_t count = a ? a->count() : 0;
+                _pos = normalize(elem._index, count);
+                _end = normalize(elem._end, count);
+            }
+        }
+
+        // Returns the element's next match, or nullptr when there are no more.
+        const Value* next() {
+            switch (element->type()) {
+                case Element::kProperty:
+                case Element::kIndex:
+                    if (_pos++ > 0)
+                        return nullptr;
+                    return element->eval(input);
+                case Element::kWildcard:
+                    return children.next();
+                case Element::kFilter:
+                    while (auto value = children.next()) {
+                        if (element->_filter->matches(value))
+                            return value;
+                    }
+                    return nullptr;
+                case Element::kSlice: {
+                    if (_pos >= _end)
+                        return nullptr;
+                    auto value = ((const Array*)input)->get(uint32_t(_pos));
+                    _pos += element->_step;
+                    return value;
+                }
+                case Element::kDescendants:
+                    // Pre-order traversal, starting with the input itself:
+                    const Value *value;
+                    if (_pos++ == 0) {
+                        value = input;
+                    } else {
+                        do {
+                            if (descent.empty())
+                                return nullptr;
+                            value = descent.back().next();
+                            if (!value)
+                                descent.pop_back();
+                        } while (!value);
+                    }
+                    auto type = value->type();
+                    if (type == kArray || type == kDict)
+                        descent.emplace_back(value);
+                    return value;
+            }
+            return nullptr;
+        }
+
+        const Element* element;
+        size_t depth;                   // Index of the element in the path
+        const Value* input;
+
+    private:
+        static int64_t normalize(int64_t index, int64_t count) {
+            if (index < 0)
+                index += count;
+            return std::min(std::max(index, int64_t(0)), count);
+        }
+
+        Children children;              // Used by wildcards and filters
+        std::vector<Children> descent;  // Stack of containers being descended into, by ".."
+        int64_t _pos {0}, _end {0};
+    };
+
+
+    Path::iterator::iterator(const Path &path, const Value *root)
+    :_path(path)
+    {
+        if (!root)
+            return;
+        if (path.empty()) {
+            _value = root;
+            return;
+        }
+        _stack.emplace_back(path[0], 0, root);
+        next();
+    }
+
+
+    Path::iterator::~iterator() =default;
+
+
+    void Path::iterator::next() {
+        // Depth-first search: each frame produces matches of its element, which are fed to a
+        // new frame for the next element, until the last element produces a match.
+        while (!_stack.empty()) {
+            auto value = _stack.back().next();
+            if (!value) {
+                _stack.pop_back();
+                continue;
+            }
+            size_t depth = _stack.back().depth + 1;
+            if (depth == _path.size()) {
+                _value = value;
+                return;
+            }
+            _stack.emplace_back(_path[depth], depth, value);
+        }
+        _value = nullptr;
+    }
+
 } }
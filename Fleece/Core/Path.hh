@@ -24,6 +24,7 @@
 #include <memory>
 #include <string>
 #include <functional>
+#include <vector>
 
 namespace fleece { namespace impl {
     class SharedKeys;
@@ -35,10 +36,23 @@ namespace fleece { namespace impl {
         indexes in brackets. (Negative indexes count from the end of the array.)
         A leading JSONPath-like "$." is allowed but ignored.
         A '\' can be used to escape a special character ('.', '[' or '$') at the start of a
-        property name (but not yet in the middle of a name.) */
+        property name (but not yet in the middle of a name.)
+
+        A path can also use these JSONPath features, which make it match any number of values:
+        - "[*]" or ".*" matches every item of an array or every value of a dict;
+        - ".." matches the value itself and all of its descendants, so "..name" matches every
+          "name" property at any depth;
+        - "[a:b]" or "[a:b:step]" matches a slice of an array, like a Python slice: either bound
+          may be omitted or negative, but the step must be positive;
+        - "[?(@.sub.path op literal)]" matches the items of an array (or values of a dict) for
+          which the filter is true. `op` is one of "==", "!=", "<", "<=", ">", ">=", and the
+          literal is a number, a quoted string, `true`, `false` or `null`. "[?(@.sub.path)]"
+          just checks that the sub-path exists. The sub-path may be empty, i.e. just "@".
+        The matches of such a path are found by a Path::iterator; `eval` returns the first. */
     class Path {
     public:
         class Element;
+        class iterator;
 
         //// Construction from a string: (throws FleeceException with code PathSyntaxError)
 
@@ -62,12 +76,19 @@ namespace fleece { namespace impl {
         bool empty() const                              {return _path.empty();}
         size_t size() const                             {return _path.size();}
 
+        /** True if the path has only properties and array indexes, so it can match at most
+            one value. */
+        bool isSingular() const;
+
         const Element& operator[] (size_t i) const      {return _path[i];}
         Element& operator[] (size_t i)                  {return _path[i];}
 
         //// Evaluation:
 
-        const Value* eval(const Value *root NONNULL) const noexcept;
+        /** Returns the value the path matches; or if it can match several, the first one.
+            Non-singular paths are searched with a heap-allocated stack, so this can throw
+            std::bad_alloc. */
+        const Value* eval(const Value *root NONNULL) const;
 
         /** One-shot evaluation; faster if you're only doing it once */
         static const Value* eval(slice specifier,
@@ -95,26 +116,77 @@ namespace fleece { namespace impl {
         static void writeIndex(std::ostream&, int arrayIndex);
 
 
-        /** An element of a Path, representing either a named property or an array index. */
+        /** An element of a Path: a named property, an array index, or one of the JSONPath
+            features that can match more than one value. */
         class Element {
         public:
+            enum Type : uint8_t {
+                kProperty,          // ".name"
+                kIndex,             // "[n]"
+                kWildcard,          // "[*]" or ".*"
+                kDescendants,       // ".."
+                kSlice,             // "[a:b:step]"
+                kFilter,            // "[?(...)]"
+            };
+
             Element(slice property);
-            Element(int32_t arrayIndex)             :_index(arrayIndex) { }
+            Element(int32_t arrayIndex);
+            Element(Type, slice param);             // for the other types; throws PathSyntaxError
             Element(const Element &e);
-            bool isKey() const                      {return _key != nullptr;}
+            ~Element();
+
+            Type type() const                       {return _type;}
+            bool isKey() const                      {return _type == kProperty;}
+            bool isSingular() const                 {return _type <= kIndex;}
             Dict::key& key() const                  {return *_key;}
             slice keyStr() const                    {return _key ? _key->string() : slice();}
             int32_t index() const                   {return _index;}
 
+            /** Evaluates a property or array index. Other types of element can match more than
+                one value, so this returns nullptr for them; use a Path::iterator instead. */
             const Value* eval(const Value* NONNULL) const noexcept;
             static const Value* eval(char token, slice property, int32_t index,
                                      const Value *item NONNULL) noexcept;
         private:
+            struct Filter;
+            friend class Path;
+
             static const Value* getFromArray(const Value* NONNULL, int32_t index) noexcept;
 
-            alloc_slice _keyBuf;
+            alloc_slice _keyBuf;                    // Property name, or text of slice or filter
             std::unique_ptr<Dict::key> _key {nullptr};
-            int32_t _index {0};
+            std::unique_ptr<Filter> _filter;
+            Type _type {kProperty};
+            int32_t _index {0};                     // Array index, or start of slice
+            int32_t _end {0}, _step {1};            // End and step of slice
+        };
+
+
+        /** Iterates over the values a Path matches, in document order. The data is walked
+            lazily with a stack of positions, one per path element, so no intermediate results
+            are collected. A singular path matches at most one value, the one `eval` returns.
+            The Path must not be changed or freed while it's being iterated. */
+        class iterator {
+        public:
+            iterator(const Path&, const Value *root);
+            ~iterator();
+
+            explicit operator bool() const          {return _value != nullptr;}
+            iterator& operator++ ()                 {next(); return *this;}
+
+            /** The current match, or NULL if the iteration is finished. */
+            const Value* value() const              {return _value;}
+
+            /** Advances to the next match. */
+            void next();
+
+        private:
+            struct Children;
+            struct Frame;
+
+            const Path& _path;
+            std::vector<Frame> _stack;
+            const Value* _value {nullptr};
         };
 
     private:
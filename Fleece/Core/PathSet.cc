@@ -0,0 +1,172 @@
+//
+// PathSet.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "PathSet.hh"
+#include "Encoder.hh"
+#include "FleeceException.hh"
+#include "TempArray.hh"
+#include <algorithm>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace fleece { namespace impl {
+
+    // A node of the tree of paths. Its children are the properties and array indexes that
+    // paths continue to from here.
+    struct PathSet::Node {
+        vector<alloc_slice> keyNames;               // Property names, in sorted order
+        vector<unique_ptr<Node>> keyChildren;       // Child of each property
+        vector<pair<int32_t, unique_ptr<Node>>> indexChildren;  // Array indexes & their children
+        vector<unsigned> results;                   // Indexes of the paths that end here
+
+        Node() { }
+
+        ~Node() {
+            freeKeys();
+        }
+
+        Node* childForKey(slice name) {
+            auto i = lower_bound(keyNames.begin(), keyNames.end(), name,
+                                 [](const alloc_slice &a, slice b) {return a.compare(b) < 0;});
+            auto n = i - keyNames.begin();
+            if (i == keyNames.end() || *i != name) {
+                freeKeys();
+                keyNames.emplace(i, name);
+                keyChildren.emplace(keyChildren.begin() + n, new Node);
+            }
+            return keyChildren[n].get();
+        }
+
+        Node* childForIndex(int32_t index) {
+            for (auto &child : indexChildren)
+                if (child.first == index)
+                    return child.second.get();
+            indexChildren.emplace_back(index, unique_ptr<Node>(new Node));
+            return indexChildren.back().second.get();
+        }
+
+        unsigned eval(const Value *item, const Value* values[]) {
+            unsigned nFound = 0;
+            for (auto r : results) {
+                values[r] = item;
+                ++nFound;
+            }
+
+            if (!keyNames.empty()) {
+                if (auto dict = item->asDict()) {
+                    size_t nKeys = keyNames.size();
+                    if (nKeys == 1) {
+                        if (auto value = dict->get(getKeys()[0]))
+                            nFound += keyChildren[0]->eval(value, values);
+                    } else {
+                        TempArray(found, const Value*, nKeys);
+                        if (dict->getMany(getKeys(), nKeys, found) > 0) {
+                            for (size_t i = 0; i < nKeys; ++i) {
+                                if (found[i])
+                                    nFound += keyChildren[i]->eval(found[i], values);
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (!indexChildren.empty()) {
+                if (auto array = item->asArray()) {
+                    uint32_t count = array->count();
+                    for (auto &child : indexChildren) {
+                        int64_t index = child.first;
+                        if (index < 0)
+                            index += count;
+                        if (index >= 0 && index < count)
+                            nFound += child.second->eval(array->get(uint32_t(index)), values);
+                    }
+                }
+            }
+            return nFound;
+        }
+
+    private:
+        // Dict::keys can't be copied or moved, so the array of them for Dict::getMany is
+        // constructed in place, when first needed after the set of properties changes.
+        Dict::key* getKeys() {
+            if (!_keys) {
+                _keys = (Dict::key*) ::operator new(keyNames.size() * sizeof(Dict::key));
+                for (size_t i = 0; i < keyNames.size(); ++i)
+                    new (&_keys[i]) Dict::key(keyNames[i]);
+            }
+            return _keys;
+        }
+
+        void freeKeys() {
+            if (_keys) {
+                for (size_t i = 0; i < keyNames.size(); ++i)
+                    _keys[i].~key();
+                ::operator delete(_keys);
+                _keys = nullptr;
+            }
+        }
+
+        Dict::key* _keys {nullptr};
+    };
+
+
+    PathSet::PathSet()
+    :_root(new Node)
+    { }
+
+
+    PathSet::~PathSet() =default;
+
+
+    unsigned PathSet::add(const Path &path) {
+        Node *node = _root.get();
+        throwIf(!path.isSingular(), PathSyntaxError,
+                "PathSet paths can only have properties and array indexes");
+        for (auto &element : path.path()) {
+            if (element.isKey())
+                node = node->childForKey(element.keyStr());
+            else
+                node = node->childForIndex(element.index());
+        }
+        node->results.push_back(_count);
+        return _count++;
+    }
+
+
+    unsigned PathSet::eval(const Value *root, const Value* values[]) const {
+        fill(&values[0], &values[_count], nullptr);
+        return _root->eval(root, values);
+    }
+
+
+    void PathSet::writeTo(Encoder &enc, const Value *root) const {
+        TempArray(values, const Value*, _count);
+        eval(root, values);
+        enc.beginArray(_count);
+        for (unsigned i = 0; i < _count; ++i) {
+            if (values[i])
+                enc.writeValue(values[i]);
+            else
+                enc.writeNull();
+        }
+        enc.endArray();
+    }
+
+} }
@@ -0,0 +1,66 @@
+//
+// PathSet.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Path.hh"
+#include <memory>
+
+namespace fleece { namespace impl {
+    class Encoder;
+
+    /** A set of Paths that are evaluated together, as a projection of a value. The paths are
+        compiled into a tree of their common prefixes, so evaluating them makes a single descent
+        from the root: each dict along the way is searched once for all the properties the paths
+        need from it (using Dict::getMany), instead of once per path.
+        Warning: Like a Path, a PathSet caches information about the keys it looks up, so an
+        instance should be used only on a single thread, and only with documents that share the
+        same SharedKeys. */
+    class PathSet {
+    public:
+        PathSet();
+        ~PathSet();
+
+        /** Adds a path, returning its index, i.e. the position of its value in the results.
+            The path must be singular (see Path::isSingular), else PathSyntaxError is thrown. */
+        unsigned add(const Path&);
+
+        /** Adds a path given as a string, returning its index.
+            Throws a FleeceException with code PathSyntaxError if it's invalid. */
+        unsigned add(slice specifier)               {return add(Path(specifier));}
+
+        /** The number of paths. */
+        unsigned count() const                      {return _count;}
+
+        /** Evaluates all the paths against `root`, storing the value each one resolves to, or
+            nullptr if it doesn't exist, in the corresponding item of `values`, which must have
+            room for `count()` items. (The first call may allocate, so this can throw.)
+            @return  The number of paths that were found. */
+        unsigned eval(const Value *root NONNULL, const Value* values[]) const;
+
+        /** Evaluates all the paths against `root`, and writes their values to the encoder as an
+            array, in the order the paths were added. Paths that don't exist are written as null. */
+        void writeTo(Encoder&, const Value *root NONNULL) const;
+
+    private:
+        struct Node;
+
+        std::unique_ptr<Node> _root;
+        unsigned _count {0};
+    };
+
+} }
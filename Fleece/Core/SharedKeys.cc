@@ -19,6 +19,7 @@
 #include "SharedKeys.hh"
 #include "FleeceImpl.hh"
 #include "FleeceException.hh"
+#include <algorithm>
 
 
 #define LOCK(MUTEX)     lock_guard<mutex> _lock(MUTEX)
@@ -140,6 +141,36 @@ namespace fleece { namespace impl {
     }
 
 
+    // Max number of key sets whose order sortedKeyOrder remembers.
+    static constexpr size_t kMaxCachedKeyOrders = 1024;
+
+    SharedKeys::KeyOrder SharedKeys::sortedKeyOrder(const uint16_t *keys, size_t count) const {
+        slice keyData(keys, count * sizeof(uint16_t));
+        uint32_t hash = keyData.hash();
+        LOCK(_mutex);
+        auto i = _keyOrders.find(hash);
+        if (i != _keyOrders.end() && i->second.keys.size() == count
+                                  && keyData == slice(i->second.keys.data(), keyData.size))
+            return i->second.order;
+
+        for (size_t k = 0; k < count; ++k)
+            if (keys[k] >= _count)
+                return nullptr;
+        auto order = make_shared<vector<uint16_t>>(count);
+        for (size_t k = 0; k < count; ++k)
+            (*order)[k] = uint16_t(k);
+        sort(order->begin(), order->end(), [&](uint16_t a, uint16_t b) {
+            return slice(_byKey[keys[a]]) < slice(_byKey[keys[b]]);
+        });
+
+        if (i == _keyOrders.end() && _keyOrders.size() >= kMaxCachedKeyOrders)
+            _keyOrders.clear();
+        // (A different key list with the same hash is just replaced.)
+        _keyOrders[hash] = {vector<uint16_t>(keys, keys + count), order};
+        return order;
+    }
+
+
     SharedKeys::PlatformString SharedKeys::platformStringForKey(int key) const {
         throwIf(key < 0, InvalidData, "key must be non-negative");
         LOCK(_mutex);
@@ -178,6 +209,7 @@ namespace fleece { namespace impl {
         for (auto key = toCount; key < _count; ++key)
             _byKey[key] = nullslice;
         _count = toCount;
+        _keyOrders.clear();         // Key numbers may be reused for different strings
 
         // StringTable doesn't support removing, so rebuild it:
         _table.clear();
@@ -20,7 +20,10 @@
 #include "RefCounted.hh"
 #include "StringTable.hh"
 #include <array>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -97,6 +100,15 @@ namespace fleece { namespace impl {
         /** A vector whose indices are encoded keys and values are the strings. */
         std::vector<alloc_slice> byKey() const;
 
+        /** An ordering of a list of encoded keys; see \ref sortedKeyOrder. */
+        using KeyOrder = std::shared_ptr<const std::vector<uint16_t>>;
+
+        /** Given a list of encoded keys, returns the indices of the list's items in ascending
+            order of their decoded strings, i.e. the order canonical JSON writes them in.
+            The result is cached, so dicts with the same set of keys share the work.
+            Returns nullptr if any of the keys is unknown. */
+        KeyOrder sortedKeyOrder(const uint16_t *keys NONNULL, size_t count) const;
+
         /** Reverts the mapping to an earlier state by removing the mappings with keys greater than
             or equal to the new count. (I.e. it truncates the byKey vector.) */
         void revertToCount(size_t count);
@@ -137,6 +149,12 @@ namespace fleece { namespace impl {
         size_t _count {0};
         std::array<alloc_slice, kMaxCount> _byKey;      // Reverse mapping, int->slice
         mutable std::vector<PlatformString> _platformStringsByKey; // Reverse mapping, int->platform key
+        struct CachedKeyOrder {
+            std::vector<uint16_t> keys;
+            KeyOrder order;
+        };
+        mutable std::unordered_map<uint32_t, CachedKeyOrder> _keyOrders; // sortedKeyOrder cache,
+                                                                         // by hash of the keys
     };
 
 
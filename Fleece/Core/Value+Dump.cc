@@ -47,6 +47,8 @@ namespace fleece { namespace impl {
                 break;
             case kArrayTag: {
                 out << "Array[" << asArray()->count() << "]";
+                if (isTypedArray())
+                    out << " (typed)";
                 break;
             }
             case kDictTag: {
@@ -110,6 +112,10 @@ namespace fleece { namespace impl {
         writeDumpBrief(out, base, (size > 2));
         switch (tag()) {
             case kArrayTag: {
+                if (isTypedArray()) {
+                    out << "\n";       // items aren't Values, so don't dump them
+                    break;
+                }
                 out << ":\n";
                 for (auto i = asArray()->begin(); i; ++i) {
                     size += i.rawValue()->dump(out, isWideArray(), 1, base);
@@ -142,6 +148,8 @@ namespace fleece { namespace impl {
         byAddress[(size_t)this] = this;
         switch (type()) {
             case kArray:
+                if (isTypedArray())
+                    break;
                 for (auto iter = asArray()->begin(); iter; ++iter) {
                     if (iter.rawValue()->isPointer())
                         iter.value()->mapAddresses(byAddress);
@@ -26,10 +26,12 @@
 #include "Endian.hh"
 #include "FleeceException.hh"
 #include "varint.hh"
+#include "NumConversion.hh"
 #include "PlatformCompat.hh"
 #include "JSONEncoder.hh"
 #include "ParseDate.hh"
 #include <math.h>
+#include <algorithm>
 #include "betterassert.hh"
 
 
@@ -122,7 +124,7 @@ namespace fleece { namespace impl {
                 return _decLittle64(n);
             }
             case kFloatTag:
-                return (int64_t)asDouble();
+                return SaturatingInt64(asDouble());
             default:
                 return 0;
         }
@@ -171,10 +173,8 @@ namespace fleece { namespace impl {
             case kShortIntTag:
             case kIntTag: {
                 int64_t i = asInt();
-                if (isUnsigned())
-                    sprintf(str, "%llu", (unsigned long long)i);
-                else
-                    sprintf(str, "%lld", (long long)i);
+                size_t length = isUnsigned() ? WriteUInt(uint64_t(i), str) : WriteInt(i, str);
+                str[length] = '\0';
                 break;
             }
             case kSpecialTag: {
@@ -260,9 +260,35 @@ namespace fleece { namespace impl {
     }
 
 
+    template <int VER>
+    void Value::writeJSON(const std::function<void(slice)> &output, bool canonical) const {
+        JSONEncoder encoder(output);
+        if (VER >= 5)
+            encoder.setJSON5(true);
+        encoder.setCanonical(canonical);
+        encoder.writeValue(this);
+        encoder.finish();
+    }
+
+
+    template <int VER>
+    void Value::writeJSON(FILE *file, bool canonical) const {
+        JSONEncoder encoder(file);
+        if (VER >= 5)
+            encoder.setJSON5(true);
+        encoder.setCanonical(canonical);
+        encoder.writeValue(this);
+        encoder.finish();
+    }
+
+
     // Explicitly instantiate both needed versions of the templates:
     template alloc_slice Value::toJSON<1>(bool canonical) const;
     template alloc_slice Value::toJSON<5>(bool canonical) const;
+    template void Value::writeJSON<1>(const std::function<void(slice)>&, bool) const;
+    template void Value::writeJSON<5>(const std::function<void(slice)>&, bool) const;
+    template void Value::writeJSON<1>(FILE*, bool) const;
+    template void Value::writeJSON<5>(FILE*, bool) const;
 
 
     std::string Value::toJSONString() const {
@@ -270,9 +296,15 @@ namespace fleece { namespace impl {
     }
 
 
-    bool Value::isEqual(const Value *v) const {
-        if (!v || _byte[0] != v->_byte[0])
+    bool Value::isEqual(const Value *v, bool hashDicts) const {
+        if (!v)
             return false;
+        if (_byte[0] != v->_byte[0]) {
+            // A collection's first byte also holds its width and the high bits of its count,
+            // so equal collections encoded by different encoders can differ there:
+            if (tag() < kArrayTag || tag() != v->tag())
+                return false;
+        }
         if (_usuallyFalse(this == v))
             return true;
         switch (tag()) {
@@ -290,23 +322,144 @@ namespace fleece { namespace impl {
             case kBinaryTag:
                 return getStringBytes() == v->getStringBytes();
             case kArrayTag: {
-                Array::iterator i((const Array*)this);
-                Array::iterator j((const Array*)v);
+                Array::decodingIterator i((const Array*)this);
+                Array::decodingIterator j((const Array*)v);
                 if (i.count() != j.count())
                     return false;
-                for (; i; ++i, ++j)
-                    if (!i.value()->isEqual(j.value()))
+                while (i)
+                    if (!i.read()->isEqual(j.read(), hashDicts))
                         return false;
                 return true;
             }
             case kDictTag:
-                return ((const Dict*)this)->isEqualToDict((const Dict*)v);
+                return ((const Dict*)this)->isEqualToDict((const Dict*)v, hashDicts);
             default:
                 return false;
         }
     }
 
 
+#pragma mark - CONTENT HASH:
+
+
+    // Incrementally hashes 128-bit blocks, using the block mixing and finalization steps of
+    // MurmurHash3_x64_128 <https://github.com/aappleby/smhasher/wiki/MurmurHash3>.
+    class ContentHasher {
+    public:
+        void add(uint64_t k1, uint64_t k2) {
+            k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; _h1 ^= k1;
+            _h1 = rotl(_h1, 27); _h1 += _h2; _h1 = _h1 * 5 + 0x52dce729;
+            k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; _h2 ^= k2;
+            _h2 = rotl(_h2, 31); _h2 += _h1; _h2 = _h2 * 5 + 0x38495ab5;
+            ++_nBlocks;
+        }
+
+        void addBytes(char type, slice bytes) {
+            add(type, bytes.size);
+            auto cur = (const uint8_t*)bytes.buf, end = (const uint8_t*)bytes.end();
+            for (; cur + 16 <= end; cur += 16) {
+                uint64_t k[2];
+                memcpy(k, cur, 16);
+                add(k[0], k[1]);
+            }
+            if (cur < end) {
+                uint64_t k[2] = {0, 0};
+                memcpy(k, cur, end - cur);
+                add(k[0], k[1]);
+            }
+        }
+
+        void addValue(const Value *v) {
+            switch (v->type()) {
+                case kNull:
+                    add(v->isUndefined() ? 'u' : 'n', 0);
+                    break;
+                case kBoolean:
+                    add('b', v->asBool());
+                    break;
+                case kNumber:
+                    if (v->isInteger()) {
+                        add('i', (uint64_t)v->asInt());
+                    } else {
+                        double d = v->asDouble();
+                        if (d == 0.0)
+                            d = 0.0;        // canonicalize -0.0, since it's equal to 0.0
+                        uint64_t bits;
+                        memcpy(&bits, &d, sizeof(bits));
+                        add('d', bits);
+                    }
+                    break;
+                case kString:
+                    addBytes('s', v->asString());
+                    break;
+                case kData:
+                    addBytes('B', v->asData());
+                    break;
+                case kArray: {
+                    Array::decodingIterator i((const Array*)v);
+                    add('a', i.count());
+                    while (i)
+                        addValue(i.read());
+                    break;
+                }
+                case kDict: {
+                    // Key order depends on the encoding (shared keys sort before strings), so
+                    // hash each key/value pair separately and combine them commutatively:
+                    ContentHash sum = {0, 0};
+                    uint64_t count = 0;
+                    for (Dict::iterator i((const Dict*)v); i; ++i, ++count) {
+                        ContentHasher item;
+                        item.addBytes('k', i.keyString());
+                        item.addValue(i.value());
+                        ContentHash itemHash = item.finish();
+                        sum.lo += itemHash.lo;
+                        sum.hi += itemHash.hi;
+                    }
+                    add('D', count);
+                    add(sum.lo, sum.hi);
+                    break;
+                }
+            }
+        }
+
+        ContentHash finish() const {
+            uint64_t h1 = _h1 ^ (_nBlocks * 16), h2 = _h2 ^ (_nBlocks * 16);
+            h1 += h2;
+            h2 += h1;
+            h1 = fmix64(h1);
+            h2 = fmix64(h2);
+            h1 += h2;
+            h2 += h1;
+            return {h1, h2};
+        }
+
+    private:
+        static inline uint64_t rotl(uint64_t x, int r)     {return (x << r) | (x >> (64 - r));}
+
+        static inline uint64_t fmix64(uint64_t k) {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdull;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ull;
+            k ^= k >> 33;
+            return k;
+        }
+
+        static constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+        static constexpr uint64_t c2 = 0x4cf5ad432745937full;
+
+        uint64_t _h1 {0}, _h2 {0};
+        uint64_t _nBlocks {0};
+    };
+
+
+    ContentHash Value::contentHash() const {
+        ContentHasher hasher;
+        hasher.addValue(this);
+        return hasher.finish();
+    }
+
+
 #pragma mark - VALIDATION:
 
     
@@ -345,7 +498,11 @@ namespace fleece { namespace impl {
 
     bool Value::validate(const void *dataStart, const void *dataEnd) const noexcept {
         auto t = tag();
-        if (t == kArrayTag || t == kDictTag) {
+        if (_usuallyFalse(isTypedArray())) {
+            // Typed array: check that the header is valid and the items fit:
+            size_t size = ((const Array*)this)->typedArrayDataSize();
+            return size > 0 && offsetby(this, size) <= dataEnd;
+        } else if (t == kArrayTag || t == kDictTag) {
             Array::impl array(this);
             if (_usuallyTrue(array._count > 0)) {
                 // For validation purposes a Dict is just an array with twice as many items:
@@ -387,7 +544,10 @@ namespace fleece { namespace impl {
             case kStringTag:
             case kBinaryTag:    return (uint8_t*)getStringBytes().end() - (uint8_t*)this;
             case kArrayTag:
-            case kDictTag:      return (uint8_t*)Array::impl(this)._first - (uint8_t*)this;
+            case kDictTag:      if (_usuallyFalse(isTypedArray()))
+                                    return std::max(((const Array*)this)->typedArrayDataSize(),
+                                                    size_t(kWide));
+                                return (uint8_t*)Array::impl(this)._first - (uint8_t*)this;
             case kPointerTagFirst:
             default:            return 2;   // size might actually be 4; depends on context
         }
@@ -21,7 +21,9 @@
 #include "FleeceException.hh"
 #include "fleece/slice.hh"
 #include "Endian.hh"
+#include <functional>
 #include <stdint.h>
+#include <stdio.h>
 #include <map>
 #ifdef __OBJC__
 #import <Foundation/NSMapTable.h>
@@ -63,6 +65,15 @@ namespace fleece { namespace impl {
     };
 
 
+    /** A 128-bit hash of a Value's contents. (See Value::contentHash.) Not cryptographic! */
+    struct ContentHash {
+        uint64_t lo, hi;
+
+        bool operator== (const ContentHash &h) const  {return lo == h.lo && hi == h.hi;}
+        bool operator!= (const ContentHash &h) const  {return !(*this == h);}
+    };
+
+
     /* An encoded data value */
     class Value {
     public:
@@ -81,7 +92,13 @@ namespace fleece { namespace impl {
         valueType type() const noexcept;
 
         /** Compares two Values for equality. */
-        bool isEqual(const Value*) const;
+        bool isEqual(const Value *v) const                  {return isEqual(v, true);}
+
+        /** Computes a hash of this Value's contents, in one pass over it. Values that are equal
+            according to isEqual have equal hashes, regardless of how they're encoded: narrow or
+            wide, with or without SharedKeys, or with Dicts inheriting from parents.
+            (To memoize the hash of a document's root, use Doc::contentHash.) */
+        ContentHash contentHash() const;
 
         //////// Scalar types:
 
@@ -163,9 +180,30 @@ namespace fleece { namespace impl {
         template <int VER =1>
         alloc_slice toJSON(bool canonical =false) const;
 
+        /** Writes a JSON representation to a callback, a chunk at a time as it's generated,
+            instead of building it all in memory first.
+            If you call it as writeJSON<5>(...), writes JSON5, which leaves most keys unquoted. */
+        template <int VER =1>
+        void writeJSON(const std::function<void(slice)> &output, bool canonical =false) const;
+
+        /** Writes a JSON representation to a file, a chunk at a time as it's generated. */
+        template <int VER =1>
+        void writeJSON(FILE* NONNULL, bool canonical =false) const;
+
         /** Returns a JSON string representation of a Value. */
         std::string toJSONString() const;
 
+
+        //////// Visiting:
+
+        /** Walks this value and everything it contains, depth-first and without recursion,
+            calling the visitor's callbacks for each value, collection and dict key.
+            The visitor is usually a subclass of ValueVisitor; this template is defined in
+            ValueVisitor.hh, which must be included to call it.
+            @return  False if a callback stopped the visit, else true. */
+        template <class VISITOR>
+        bool visit(VISITOR &visitor) const;
+
         /** Writes a full dump of the values in the data, including offsets and hex. */
         static bool dump(slice data, std::ostream&);
 
@@ -206,6 +244,9 @@ namespace fleece { namespace impl {
         { }
 
         static const Value* findRoot(slice) noexcept;
+        // If `hashDicts` is true, Dicts with different SharedKeys compare content hashes first;
+        // Dicts nested inside one that did so skip this, since its hash covered them.
+        bool isEqual(const Value*, bool hashDicts) const;
         bool validate(const void* dataStart, const void *dataEnd) const noexcept;
 
         internal::tags tag() const noexcept   {return (internal::tags)(_byte[0] >> 4);}
@@ -222,6 +263,9 @@ namespace fleece { namespace impl {
         bool isWideArray() const noexcept     {return (_byte[0] & 0x08) != 0;}
         uint32_t countValue() const noexcept  {return (((uint32_t)_byte[0] << 8) | _byte[1]) & 0x07FF;}
         bool countIsZero() const noexcept     {return _byte[1] == 0 && (_byte[0] & 0x7) == 0;}
+        bool isTypedArray() const noexcept    {return _byte[0] == 0x6F && _byte[1] == 0xFF
+                                                   && memcmp(&_byte[2], &internal::kTypedArrayHeader[2],
+                                                             internal::kTypedArrayHeaderSize - 2) == 0;}
 
         // pointers:
 
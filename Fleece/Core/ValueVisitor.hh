@@ -0,0 +1,159 @@
+//
+// ValueVisitor.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "Array.hh"
+#include "Dict.hh"
+#include "SmallVector.hh"
+
+namespace fleece { namespace impl {
+
+    /** What Value::visit should do after a visitor callback returns. */
+    enum VisitAction : uint8_t {
+        kVisitContinue,         ///< Keep going
+        kVisitSkipChildren,     ///< Skip the items of the collection just begun, or the value
+                                ///<   of the key just visited
+        kVisitStop,             ///< Stop visiting; Value::visit returns false
+    };
+
+
+    /** Base class of visitors for Value::visit. Its callbacks do nothing; a subclass declares
+        the ones it's interested in, hiding these. They aren't virtual: `visit` is a template,
+        so the calls are bound at compile time and can be inlined.
+
+        Every beginArray/beginDict call is matched by an endArray/endDict call (unless the
+        visit is stopped), even if it returned kVisitSkipChildren.
+
+        Dict keys are passed as the Dict::iterator positioned at them, so a visitor that needs
+        the key's string calls its `keyString()`; keys aren't otherwise decoded. */
+    class ValueVisitor {
+    public:
+        /** Called for every value that isn't an array or dict. */
+        VisitAction value(const Value* NONNULL)                 {return kVisitContinue;}
+
+        VisitAction beginArray(const Array* NONNULL)            {return kVisitContinue;}
+        VisitAction endArray(const Array* NONNULL)              {return kVisitContinue;}
+
+        VisitAction beginDict(const Dict* NONNULL)              {return kVisitContinue;}
+        /** Called before each value in a dict, with the iterator positioned at its key. */
+        VisitAction key(const Dict::iterator&)                  {return kVisitContinue;}
+        VisitAction endDict(const Dict* NONNULL)                {return kVisitContinue;}
+
+        /** If this returns true, dicts are visited as they're stored: the items of a dict's
+            parent aren't merged in, and its "parent" key is visited like any other. */
+        static constexpr bool rawDicts()                        {return false;}
+    };
+
+
+    namespace internal {
+        // A collection being visited. (Constructing an iterator with a null collection is
+        // cheap, so each frame simply has both kinds.) A typed array's items are decoded into
+        // the frame; that's safe because a scalar is visited before any frame is pushed.
+        struct VisitFrame {
+            VisitFrame(const Array *a) noexcept          :array(a), arrayIter(a), dictIter(nullptr) { }
+            VisitFrame(const Dict *d, Dict::iterator &&i) noexcept
+                                                         :dict(d), arrayIter(Array::kEmpty), dictIter(std::move(i)) { }
+
+            const Array*                    array {nullptr};
+            const Dict*                     dict {nullptr};
+            Array::decodingIterator         arrayIter;
+            Dict::iterator                  dictIter;
+        };
+
+        // Frames stored inline in a Value::visit call; deeper nesting spills to the heap.
+        static constexpr size_t kVisitInlineDepth = 16;
+    }
+
+
+    template <class VISITOR>
+    bool Value::visit(VISITOR &visitor) const {
+        smallVector<internal::VisitFrame, internal::kVisitInlineDepth> stack;
+        const Value *value = this;
+        while (true) {
+            // Visit `value`:
+            VisitAction action;
+            switch (value->tag()) {
+                case internal::kArrayTag: {
+                    auto array = (const Array*)value;
+                    action = visitor.beginArray(array);
+                    if (_usuallyFalse(action == kVisitStop))
+                        return false;
+                    if (action == kVisitSkipChildren) {
+                        if (_usuallyFalse(visitor.endArray(array) == kVisitStop))
+                            return false;
+                    } else {
+                        stack.emplace_back(array);
+                    }
+                    break;
+                }
+                case internal::kDictTag: {
+                    auto dict = (const Dict*)value;
+                    action = visitor.beginDict(dict);
+                    if (_usuallyFalse(action == kVisitStop))
+                        return false;
+                    if (action == kVisitSkipChildren) {
+                        if (_usuallyFalse(visitor.endDict(dict) == kVisitStop))
+                            return false;
+                    } else if (VISITOR::rawDicts()) {
+                        stack.emplace_back(dict, Dict::iterator(dict, true));
+                    } else {
+                        stack.emplace_back(dict, Dict::iterator(dict));
+                    }
+                    break;
+                }
+                default:
+                    if (_usuallyFalse(visitor.value(value) == kVisitStop))
+                        return false;
+                    break;
+            }
+
+            // Find the next value, ending any collections that are finished:
+            value = nullptr;
+            while (!value) {
+                if (stack.empty())
+                    return true;
+                auto &frame = stack.back();
+                if (frame.array) {
+                    if (frame.arrayIter) {
+                        value = frame.arrayIter.read();
+                    } else {
+                        auto array = frame.array;
+                        stack.pop_back();
+                        if (_usuallyFalse(visitor.endArray(array) == kVisitStop))
+                            return false;
+                    }
+                } else {
+                    if (frame.dictIter) {
+                        action = visitor.key(frame.dictIter);
+                        if (_usuallyFalse(action == kVisitStop))
+                            return false;
+                        if (action != kVisitSkipChildren)
+                            value = frame.dictIter.value();
+                        ++frame.dictIter;
+                    } else {
+                        auto dict = frame.dict;
+                        stack.pop_back();
+                        if (_usuallyFalse(visitor.endDict(dict) == kVisitStop))
+                            return false;
+                    }
+                }
+            }
+        }
+    }
+
+} }
@@ -219,14 +219,8 @@ namespace fleece { namespace impl { namespace internal {
     }
 
 
-    bool HeapDict::tooManyAncestors() const {
-        auto grampaw = _source->getParent();
-        return grampaw && grampaw->getParent();
-    }
-
-
     void HeapDict::writeTo(Encoder &enc) {
-        if (enc.valueIsInBase(_source) && _map.size() + 1 < count() && !tooManyAncestors()) {
+        if (_source && enc.shouldInheritFrom(_source, _map.size(), count())) {
             // Write just the changed keys, with _source as parent:
             enc.beginDictionary(_source, _map.size());
             for (auto &i : _map) {
@@ -112,7 +112,6 @@ namespace fleece { namespace impl { namespace internal {
         ValueSlot* _findValueFor(key_t keyToFind) const noexcept;
         ValueSlot& _makeValueFor(key_t key);
         HeapCollection* getMutable(slice key, tags ifType);
-        bool tooManyAncestors() const;
 
         uint32_t _count {0};                        // Dict's actual count
         RetainedConst<Dict> _source;                // Original Dict I shadow, if any
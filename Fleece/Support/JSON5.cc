@@ -17,20 +17,63 @@
 //
 
 #include "JSON5.hh"
-#include <sstream>
+#include "Encoder.hh"
+#include "JSONEncoder.hh"
+#include "NumConversion.hh"
+#include <iostream>
+#include <iterator>
+#include <stdio.h>
 
 using namespace std;
 
 
 namespace fleece {
+    using namespace fleece::impl;
 
     static inline bool isnewline(int c) {return (c == '\n' || c == '\r');}
+    static inline bool isdigit_(char c) {return c >= '0' && c <= '9';}
 
 
+    // Number output. The JSON encoder gets the (normalized) number text as-is, so that its
+    // formatting is preserved; the Fleece encoder gets the parsed number.
+
+    static void writeNumber(JSONEncoder &enc, const string &text, bool) {
+        enc.writeJSON(slice(text));
+    }
+
+    static void writeNumber(Encoder &enc, const string &text, bool isInteger) {
+        if (isInteger) {
+            bool negative = (text[0] == '-');
+            uint64_t n = 0;
+            bool overflow = false;
+            for (size_t i = negative; i < text.size(); ++i) {
+                unsigned digit = text[i] - '0';
+                if (n > (UINT64_MAX - digit) / 10) {
+                    overflow = true;
+                    break;
+                }
+                n = 10 * n + digit;
+            }
+            if (!overflow) {
+                if (!negative)
+                    return enc.writeUInt(n);
+                else if (n <= uint64_t(INT64_MAX) + 1)
+                    return enc.writeInt(int64_t(0 - n));
+            }
+        }
+        enc.writeDouble(ParseDouble(text.data(), text.size()));
+    }
+
+
+    /** Parses JSON5 from a slice, writing the values to an ENCODER, which is either a Fleece
+        Encoder or a JSONEncoder (they have the same writer API.) */
+    template <class ENCODER>
     class json5converter {
     public:
-        json5converter(istream &in, ostream &out)
-        :_in(in)
+        json5converter(slice in, ENCODER &out)
+        :_start((const char*)in.buf)
+        ,_cur(_start)
+        ,_end(_start + in.size)
         ,_out(out)
         { }
 
@@ -43,17 +86,20 @@ namespace fleece {
 
     private:
 
-        // Parses a JSON5 value, writing JSON to the output.
+        // Parses a JSON5 value, writing it to the output.
         void parseValue() {
             switch(peekToken()) {
                 case 'n':
                     parseConstant("null");
+                    _out.writeNull();
                     break;
                 case 't':
                     parseConstant("true");
+                    _out.writeBool(true);
                     break;
                 case 'f':
                     parseConstant("false");
+                    _out.writeBool(false);
                     break;
                 case '-':
                 case '+':
@@ -64,7 +110,7 @@ namespace fleece {
                     break;
                 case '"':
                 case '\'':
-                    parseString();
+                    _out.writeString(parseString());
                     break;
                 case '[':
                     parseSequence(false);
@@ -77,94 +123,198 @@ namespace fleece {
             }
         }
 
-        // Reads (and writes) a specific sequence of characters, failing if it doesn't match
+        // Reads a specific sequence of characters, failing if it doesn't match
         // or if the next character is alphanumeric.
         void parseConstant(const char *ident) {
             auto cp = ident;
             while (*cp && get() == *cp)
                 ++cp;
             char c = peek();
-            if (*cp || isalnum(c) || c == '$' || c == '_')
+            if (*cp || isalnum((unsigned char)c) || c == '$' || c == '_')
                 fail("unknown identifier");
-            _out << ident;
         }
 
-        // Reads a number, writing JSON to the output.
+        // Reads a number, writing it to the output. The number's text is normalized to JSON
+        // syntax in `_number`: a leading '+' is dropped, and a leading or trailing decimal
+        // point gets a '0' next to it.
         void parseNumber() {
             // TODO: Handle hex numbers
             // TODO: Handle Infinity and NaN
+            _number.clear();
             char c = get();
-            if (c == '.')
-                _out << "0.";
+            if (c == '-')
+                _number += c;
             else if (c != '+')
-                _out << c;
-
-            while (true) {
-                // Remember, we don't have to validate that this is a correct JSON number;
-                // we just have to pass valid numbers through.
+                --_cur;
+            bool isInteger = true;
+            bool hasIntDigits = readDigits();
+            if (!hasIntDigits) {
+                if (peek() != '.')
+                    fail("invalid number");
+                _number += '0';
+            }
+            if (peek() == '.') {
+                _number += get();
+                isInteger = false;
+                if (!readDigits()) {
+                    if (!hasIntDigits)
+                        fail("invalid number");
+                    _number += '0';
+                }
+            }
+            c = peek();
+            if (c == 'e' || c == 'E') {
+                _number += get();
+                isInteger = false;
                 c = peek();
-                if (isdigit(c) || c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+')
-                    _out << get();
-                else
-                    break;
+                if (c == '-' || c == '+')
+                    _number += get();
+                if (!readDigits())
+                    fail("invalid number");
             }
+            writeNumber(_out, _number, isInteger);
         }
-        
-        // Reads a string, writing JSON to the output.
-        void parseString() {
-            _out << '"';
+
+        // Appends any decimal digits at the cursor to `_number`; returns false if there are none.
+        bool readDigits() {
+            auto start = _cur;
+            while (_cur < _end && isdigit_(*_cur))
+                ++_cur;
+            _number.append(start, _cur);
+            return _cur > start;
+        }
+
+        // Reads a string, returning its unescaped contents. If it contains no escapes, the
+        // result points into the input; otherwise it points into `_scratch`.
+        slice parseString() {
             const char quote = get();
+            auto start = _cur;
+            while (true) {
+                if (_cur >= _end)
+                    fail("Unexpected end of JSON5");
+                char c = *_cur;
+                if (c == quote)
+                    return slice(start, _cur++);
+                else if (c == '\\')
+                    break;
+                ++_cur;
+            }
+
+            _scratch.assign(start, _cur);
             char c;
             while (quote != (c = get())) {
-                if (c == '"') {
-                    _out << "\\\"";                 // Escape double-quote in single-quoted string
-                } else if (c == '\\') {
-                    char esc = get();
-                    if (!isnewline(esc)) {          // ignore backslash + newline
-                        if (esc != '\'')
-                            _out << '\\';           // Don't write a single-quote as an escape
-                        _out << esc;
+                if (c != '\\') {
+                    _scratch += c;
+                    continue;
+                }
+                char esc = get();
+                switch (esc) {
+                    case 'b':   _scratch += '\b'; break;
+                    case 'f':   _scratch += '\f'; break;
+                    case 'n':   _scratch += '\n'; break;
+                    case 'r':   _scratch += '\r'; break;
+                    case 't':   _scratch += '\t'; break;
+                    case 'v':   _scratch += '\v'; break;
+                    case '0':
+                        if (isdigit_(peek()))
+                            fail("invalid escape sequence");
+                        _scratch += '\0';
+                        break;
+                    case 'x':
+                        putUTF8(readHex(2));
+                        break;
+                    case 'u': {
+                        uint32_t cp = readHex(4);
+                        if (cp >= 0xD800 && cp < 0xDC00) {
+                            // High surrogate; must be followed by an escaped low surrogate:
+                            if (get() != '\\' || get() != 'u')
+                                fail("invalid Unicode escape");
+                            uint32_t low = readHex(4);
+                            if (low < 0xDC00 || low >= 0xE000)
+                                fail("invalid Unicode escape");
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (cp >= 0xDC00 && cp < 0xE000) {
+                            fail("invalid Unicode escape");
+                        }
+                        putUTF8(cp);
+                        break;
                     }
-                    // We don't need to detect Unicode escapes; just pass them through.
-                } else {
-                    _out << c;
+                    case '\r':
+                        if (peek() == '\n')         // ignore backslash + CRLF
+                            get();
+                        break;
+                    case '\n':
+                        break;                      // ignore backslash + newline
+                    default:
+                        _scratch += esc;            // any other character escapes itself
+                        break;
                 }
             }
-            _out << '"';
+            return slice(_scratch);
+        }
+
+        // Reads `n` hex digits.
+        uint32_t readHex(int n) {
+            uint32_t result = 0;
+            for (int i = 0; i < n; ++i) {
+                char c = get();
+                int digit;
+                if (isdigit_(c))
+                    digit = c - '0';
+                else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                    digit = (c | 0x20) - 'a' + 10;
+                else
+                    fail("invalid hex digit in escape sequence");
+                result = (result << 4) | digit;
+            }
+            return result;
+        }
+
+        // Appends the UTF-8 encoding of a code point to `_scratch`.
+        void putUTF8(uint32_t cp) {
+            if (cp < 0x80) {
+                _scratch += char(cp);
+            } else if (cp < 0x800) {
+                _scratch += char(0xC0 | (cp >> 6));
+                _scratch += char(0x80 | (cp & 0x3F));
+            } else if (cp < 0x10000) {
+                _scratch += char(0xE0 | (cp >> 12));
+                _scratch += char(0x80 | ((cp >> 6) & 0x3F));
+                _scratch += char(0x80 | (cp & 0x3F));
+            } else {
+                _scratch += char(0xF0 | (cp >> 18));
+                _scratch += char(0x80 | ((cp >> 12) & 0x3F));
+                _scratch += char(0x80 | ((cp >> 6) & 0x3F));
+                _scratch += char(0x80 | (cp & 0x3F));
+            }
         }
 
-        // Reads an array or object, writing JSON to the output.
+        // Reads an array or object, writing it to the output.
         void parseSequence(bool isObject) {
-            _out << get();  // open bracket/brace
+            get();  // open bracket/brace
+            if (isObject)
+                _out.beginDictionary();
+            else
+                _out.beginArray();
             const char closeBracket = (isObject ? '}' : ']');
-            bool first = true;
             char c;
             while (closeBracket != (c = peekToken())) {
-                if (first)
-                    first = false;
-                else
-                    _out << ",";
-
                 if (isObject) {
                     // Key:
                     if (c == '"' || c == '\'') {
-                        parseString();
-                    } else if (isalpha(c) || c == '_' || c == '$') {
-                        _out << '"' << get();
-                        while (true) {
-                            c = peek();
-                            if (isalnum(c) || c == '_')
-                                _out << get();
-                            else
-                                break;
-                        }
-                        _out << '"';
+                        _out.writeKey(parseString());
+                    } else if (isalpha((unsigned char)c) || c == '_' || c == '$') {
+                        auto start = _cur++;
+                        while (_cur < _end && (isalnum((unsigned char)*_cur) || *_cur == '_'
+                                                                             || *_cur == '$'))
+                            ++_cur;
+                        _out.writeKey(slice(start, _cur));
                     } else {
                         fail("Invalid key");
                     }
                     if (peekToken() != ':')
                         fail("Expected ':' after key");
-                    _out << get();
+                    get();
                 }
 
                 // Value, or array item:
@@ -175,7 +325,11 @@ namespace fleece {
                 else if (peekToken() != closeBracket)
                     fail("unexpected token after array/object item");
             }
-            _out << get(); // copy close bracket/brace
+            get(); // close bracket/brace
+            if (isObject)
+                _out.endDictionary();
+            else
+                _out.endArray();
         }
 
         // Returns the next non-whitespace, non-comment character from the input.
@@ -185,8 +339,8 @@ namespace fleece {
                 char c = peek();
                 if (c == 0) {
                     return c; // EOF
-                } else if (isspace(c)) {
-                    get(); // skip whitespace
+                } else if (isspace((unsigned char)c)) {
+                    ++_cur; // skip whitespace
                 } else if (c == '/') {
                     skipComment();
                 } else {
@@ -195,17 +349,14 @@ namespace fleece {
             }
         }
 
-        // Reads a comment from the input. Writes nothing to the output.
+        // Reads a comment from the input.
         void skipComment() {
             char c;
             get(); // consume initial '/'
             switch (get()) {
                 case '/':
-                    do {
-                        c = peek();
-                        if (c)
-                            get();
-                    } while (c != 0 && !isnewline(c));
+                    while (_cur < _end && !isnewline(*_cur))
+                        ++_cur;
                     break;
                 case '*': {
                     bool star;
@@ -223,29 +374,30 @@ namespace fleece {
 
         // Returns the next character from the input without consuming it, or 0 at EOF.
         char peek() {
-            int c = _in.peek();
-            return (c < 0) ? 0 : (char)c;
+            return (_cur < _end) ? *_cur : 0;
         }
 
         // Reads the next character from the input. Fails if input is at EOF.
         char get() {
-            int c = _in.get();
-            if (_in.eof())
+            if (_usuallyFalse(_cur >= _end))
                 fail("Unexpected end of JSON5");
-            ++_pos;
-            return (char)c;
+            return *_cur++;
         }
 
         // Throws an exception.
-        void fail(const char *error) {
-            stringstream message;
-            message << error << " (at :" << _pos << ")";
-            throw json5_error(message.str(), _pos);
+        [[noreturn]] void fail(const char *error) {
+            size_t pos = _cur - _start;
+            char message[200];
+            snprintf(message, sizeof(message), "%s (at :%zu)", error, pos);
+            throw json5_error(message, pos);
         }
 
-        istream &_in;
-        ostream &_out;
-        string::size_type _pos {0};
+        const char* const _start;
+        const char* _cur;
+        const char* const _end;
+        ENCODER &_out;
+        string _number;     // Scratch buffer for number text
+        string _scratch;    // Scratch buffer for unescaped strings
     };
 
 
@@ -255,14 +407,24 @@ namespace fleece {
     { }
 
 
-    void ConvertJSON5(istream &in, ostream &out) {
-        json5converter(in, out).parse();
+    void ConvertJSON5(slice json5, Encoder &enc) {
+        json5converter<Encoder>(json5, enc).parse();
+    }
+
+    void ConvertJSON5(slice json5, JSONEncoder &enc) {
+        json5converter<JSONEncoder>(json5, enc).parse();
     }
 
-    std::string ConvertJSON5(const std::string &json5) {
-        stringstream in(json5), out;
-        ConvertJSON5(in, out);
-        return out.str();
+    std::string ConvertJSON5(slice json5) {
+        JSONEncoder enc(json5.size);
+        ConvertJSON5(json5, enc);
+        return enc.finish().asString();
+    }
+
+    void ConvertJSON5(istream &in, ostream &out) {
+        string json5((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        string json = ConvertJSON5(slice(json5));
+        out.write(json.data(), json.size());
     }
 
 }
@@ -17,25 +17,38 @@
 //
 
 #pragma once
+#include "fleece/slice.hh"
 #include <iostream>
 #include <stdexcept>
 #include <string>
 
 namespace fleece {
+    namespace impl {
+        class Encoder;
+        class JSONEncoder;
+    }
 
-    /// Reads valid JSON5 from a stream and writes the equivalent JSON to another stream.
-    /// Given _invalid_ JSON5, it either throws a \ref json5_error or produces invalid JSON.
-    /// (It detects structural errors, but does not detect invalid UTF-8 or check the innards
-    /// of strings or numbers.)
+    /// Parses JSON5 and writes the equivalent value directly to a Fleece encoder, without
+    /// generating intermediate JSON. Throws a \ref json5_error if the input is invalid.
+    /// (It does not detect invalid UTF-8.)
     /// For more info visit https://json5.org
-    void ConvertJSON5(std::istream &in, std::ostream &out);
+    void ConvertJSON5(slice json5, impl::Encoder&);
 
-    /// Converts a valid JSON5 string to an equivalent JSON string.
-    /// Given _invalid_ JSON5, it either throws a \ref json5_error or returns invalid JSON.
-    /// (It detects structural errors, but does not detect invalid UTF-8 or check the innards
-    /// of strings or numbers.)
-    /// For more info visit https://json5.org
-    std::string ConvertJSON5(const std::string &in);
+    /// Parses JSON5 and writes the equivalent JSON to a JSONEncoder.
+    /// Throws a \ref json5_error if the input is invalid.
+    void ConvertJSON5(slice json5, impl::JSONEncoder&);
+
+    /// Converts a JSON5 string to an equivalent JSON string.
+    /// Throws a \ref json5_error if the input is invalid.
+    std::string ConvertJSON5(slice json5);
+
+    static inline std::string ConvertJSON5(const std::string &json5) {
+        return ConvertJSON5(slice(json5));
+    }
+
+    /// Reads JSON5 from a stream and writes the equivalent JSON to another stream.
+    /// (This reads the entire input stream into memory before converting it.)
+    void ConvertJSON5(std::istream &in, std::ostream &out);
 
     /// Parse error thrown by \ref ConvertJSON5. Includes the approximate position in the input.
     class json5_error : public std::runtime_error {
@@ -19,48 +19,108 @@
 #include "JSONEncoder.hh"
 #include "FleeceImpl.hh"
 #include "SmallVector.hh"
+#include "ValueVisitor.hh"
 #include "ParseDate.hh"
+#include "Parallel.hh"
+#include "SIMD.hh"
 #include <algorithm>
+#include <memory>
+#include <thread>
 #include "betterassert.hh"
 
 namespace fleece { namespace impl {
 
+    static inline bool needsEscape(uint8_t ch) {
+        return ch == '"' || ch == '\\' || ch < 32 || ch == 127;
+    }
+
+    // Returns a pointer to the first byte in [p, end) that has to be escaped, or `end` if none.
+    // Scans 16 or 32 bytes at a time where SIMD is available, then finishes with a scalar loop.
+    static inline const uint8_t* findEscape(const uint8_t *p, const uint8_t *end) {
+#if FL_SIMD_AVX2
+        if (end - p >= 32) {
+            const __m256i quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\'),
+                          del = _mm256_set1_epi8(127), maxControl = _mm256_set1_epi8(31);
+            do {
+                __m256i v = _mm256_loadu_si256((const __m256i*)p);
+                __m256i m = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, del),
+                                    // (unsigned v <= 31) iff max(v, 31) == 31
+                                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, maxControl), maxControl)));
+                uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+                if (bits)
+                    return p + countTrailingZeros(bits);
+                p += 32;
+            } while (end - p >= 32);
+        }
+#endif
+#if FL_SIMD_SSE2
+        if (end - p >= 16) {
+            const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'),
+                          del = _mm_set1_epi8(127), maxControl = _mm_set1_epi8(31);
+            do {
+                __m128i v = _mm_loadu_si128((const __m128i*)p);
+                __m128i m = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, del),
+                                 _mm_cmpeq_epi8(_mm_max_epu8(v, maxControl), maxControl)));
+                uint32_t bits = (uint32_t)_mm_movemask_epi8(m);
+                if (bits)
+                    return p + countTrailingZeros(bits);
+                p += 16;
+            } while (end - p >= 16);
+        }
+#elif FL_SIMD_NEON
+        if (end - p >= 16) {
+            const uint8x16_t quote = vdupq_n_u8('"'), backslash = vdupq_n_u8('\\'),
+                             del = vdupq_n_u8(127), space = vdupq_n_u8(32);
+            do {
+                uint8x16_t v = vld1q_u8(p);
+                uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)),
+                                        vorrq_u8(vceqq_u8(v, del), vcltq_u8(v, space)));
+                // Narrow the byte mask to 4 bits per byte:
+                uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+                uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+                if (bits)
+                    return p + countTrailingZeros64(bits) / 4;
+                p += 16;
+            } while (end - p >= 16);
+        }
+#endif
+        while (p < end && !needsEscape(*p))
+            ++p;
+        return p;
+    }
+
     void JSONEncoder::writeString(slice str) {
+        static const char kHexDigits[17] = "0123456789abcdef";
         comma();
         _out << '"';
-        auto start = (const uint8_t*)str.buf;
+        auto p = (const uint8_t*)str.buf;
         auto end = (const uint8_t*)str.end();
-        for (auto p = start; p < end; p++) {
-            uint8_t ch = *p;
-            if (ch == '"' || ch == '\\' || ch < 32 || ch == 127) {
-                // Write characters from start up to p-1:
-                _out.write({start, p});
-                start = p + 1;
-                switch (ch) {
-                    case '"':
-                    case '\\':
-                        _out << '\\';
-                        --start; // ch will be written in next pass
-                        break;
-                    case '\r':
-                        _out.write("\\r"_sl);
-                        break;
-                    case '\n':
-                        _out.write("\\n"_sl);
-                        break;
-                    case '\t':
-                        _out.write("\\t"_sl);
-                        break;
-                    default: {
-                        char buf[7];
-                        _out.write(buf, sprintf(buf, "\\u%04x", (unsigned)ch));
-                        break;
-                    }
+        while (true) {
+            // Write the run of characters that don't need escaping:
+            auto next = findEscape(p, end);
+            if (next > p)
+                _out.write(p, next - p);
+            if (next == end)
+                break;
+            uint8_t ch = *next;
+            p = next + 1;
+            switch (ch) {
+                case '"':   _out.write("\\\""_sl); break;
+                case '\\':  _out.write("\\\\"_sl); break;
+                case '\r':  _out.write("\\r"_sl); break;
+                case '\n':  _out.write("\\n"_sl); break;
+                case '\t':  _out.write("\\t"_sl); break;
+                default: {
+                    char buf[6] = {'\\', 'u', '0', '0', kHexDigits[ch >> 4], kHexDigits[ch & 0x0F]};
+                    _out.write(buf, sizeof(buf));
+                    break;
                 }
             }
         }
-        if (end > start)
-            _out.write({start, end});
         _out << '"';
     }
 
@@ -94,45 +154,144 @@ namespace fleece { namespace impl {
     }
 
 
-    void JSONEncoder::writeDict(const Dict *dict) {
-        beginDictionary();
-        if (_canonical) {
-            // In canonical mode, ensure the keys are written in sorted order:
-            struct kv {
-                slice key;
-                const Value *value;
-                bool operator< (const kv &other) const {return key < other.key;}
-            };
-            smallVector<kv, 4> items;
-            items.reserve(dict->count());
-            for (auto iter = dict->begin(); iter; ++iter)
-                items.push_back({iter.keyString(), iter.value()});
-            std::sort(items.begin(), items.end());
-            for (auto &item : items) {
-                writeKey(item.key);
-                writeValue(item.value);
+    // Writes a Value by visiting it, instead of recursing into nested collections.
+    struct JSONEncoder::ValueWriter : public ValueVisitor {
+        explicit ValueWriter(JSONEncoder &enc)      :_enc(enc) { }
+
+        VisitAction value(const Value *v)           {_enc.writeScalar(v); return kVisitContinue;}
+        VisitAction beginArray(const Array*)        {_enc.beginArray(); return kVisitContinue;}
+        VisitAction endArray(const Array*)          {_enc.endArray(); return kVisitContinue;}
+
+        VisitAction beginDict(const Dict *dict) {
+            _enc.beginDictionary();
+            if (_enc._canonical) {
+                // The keys have to be sorted first, so write the items separately:
+                _enc.writeCanonicalDictItems(dict);
+                return kVisitSkipChildren;
             }
-        } else {
-            for (auto iter = dict->begin(); iter; ++iter) {
-                slice keyStr = iter.keyString();
-                if (keyStr) {
-                    writeKey(keyStr);
-                } else {
-                    // non-string keys are possible...
-                    comma();
-                    _first = true;
-                    writeValue(iter.key());
-                    _out << ':';
-                    _first = true;
-                }
-                writeValue(iter.value());
+            return kVisitContinue;
+        }
+
+        VisitAction key(const Dict::iterator &iter) {
+            _enc.writeDictKey(iter.keyString(), iter.key());
+            return kVisitContinue;
+        }
+
+        VisitAction endDict(const Dict*)            {_enc.endDictionary(); return kVisitContinue;}
+
+    private:
+        JSONEncoder &_enc;
+    };
+
+
+    // A small direct-mapped cache of SharedKeys::sortedKeyOrder results. Each encoder (such as
+    // each worker of writeValueParallel) has its own, so it seldom has to lock the SharedKeys.
+    struct JSONEncoder::KeyOrderCache {
+        static constexpr size_t kSize = 16;
+
+        SharedKeys::KeyOrder sortedKeyOrder(SharedKeys *sk, const uint16_t *keys, size_t count) {
+            slice keyData(keys, count * sizeof(uint16_t));
+            entry &e = _entries[keyData.hash() % kSize];
+            if (e.sharedKeys == sk && e.keys.size() == count
+                                   && keyData == slice(e.keys.data(), keyData.size))
+                return e.order;
+            auto order = sk->sortedKeyOrder(keys, count);
+            if (order) {
+                e.sharedKeys = sk;
+                e.keys.assign(keys, keys + count);
+                e.order = order;
+            }
+            return order;
+        }
+
+    private:
+        struct entry {
+            Retained<SharedKeys> sharedKeys;
+            std::vector<uint16_t> keys;
+            SharedKeys::KeyOrder order;
+        };
+        entry _entries[kSize];
+    };
+
+
+    // In canonical mode, ensure the keys are written in sorted order.
+    void JSONEncoder::writeCanonicalDictItems(const Dict *dict) {
+        struct kv {
+            slice key;
+            const Value *value;
+            bool operator< (const kv &other) const {return key < other.key;}
+        };
+        // Dicts store shared (integer) keys first, then string keys in sorted order. So only
+        // the integer keys need sorting, and that order is cached by the SharedKeys:
+        smallVector<kv, 16> stringItems;
+        smallVector<uint16_t, 16> intKeys;
+        smallVector<const Value*, 16> intValues;
+        for (auto iter = dict->begin(); iter; ++iter) {
+            const Value *key = iter.key();
+            if (key->isInteger()) {
+                intKeys.push_back(uint16_t(key->asInt()));
+                intValues.push_back(iter.value());
+            } else {
+                stringItems.push_back({key->asString(), iter.value()});
             }
         }
-        endDictionary();
+        if (!std::is_sorted(stringItems.begin(), stringItems.end()))
+            std::sort(stringItems.begin(), stringItems.end());      // (mutable dicts, maybe)
+
+        smallVector<kv, 16> intItems;
+        if (!intKeys.empty()) {
+            SharedKeys *sk = dict->sharedKeys();
+            SharedKeys::KeyOrder order;
+            if (sk) {
+                if (!_keyOrderCache)
+                    _keyOrderCache = std::make_shared<KeyOrderCache>();
+                order = _keyOrderCache->sortedKeyOrder(sk, &intKeys[0], intKeys.size());
+            }
+            intItems.reserve(intKeys.size());
+            if (order) {
+                for (uint16_t i : *order)
+                    intItems.push_back({sk->decode(intKeys[i]), intValues[i]});
+            } else {
+                // Unknown keys; fall back to decoding and sorting:
+                for (auto iter = dict->begin(); iter; ++iter)
+                    if (iter.key()->isInteger())
+                        intItems.push_back({iter.keyString(), iter.value()});
+                std::sort(intItems.begin(), intItems.end());
+            }
+        }
+
+        // Merge the two sorted lists:
+        auto s = stringItems.begin(), sEnd = stringItems.end();
+        auto i = intItems.begin(), iEnd = intItems.end();
+        while (s != sEnd || i != iEnd) {
+            const kv &item = (i == iEnd || (s != sEnd && *s < *i)) ? *s++ : *i++;
+            writeKey(item.key);
+            writeValue(item.value);
+        }
+    }
+
+
+    void JSONEncoder::writeDictKey(slice keyStr, const Value *key) {
+        if (keyStr) {
+            writeKey(keyStr);
+        } else {
+            // non-string keys are possible...
+            comma();
+            _first = true;
+            writeValue(key);
+            _out << ':';
+            _first = true;
+        }
     }
 
 
     void JSONEncoder::writeValue(const Value *v) {
+        ValueWriter writer(*this);
+        v->visit(writer);
+    }
+
+
+    void JSONEncoder::writeScalar(const Value *v) {
         switch (v->type()) {
             case kNull:
                 if (v->isUndefined()) {
@@ -164,18 +323,104 @@ namespace fleece { namespace impl {
             case kData:
                 writeData(v->asData());
                 break;
-            case kArray:
-                beginArray();
-                for (auto iter = v->asArray()->begin(); iter; ++iter)
-                    writeValue(iter.value());
-                endArray();
-                break;
-            case kDict:
-                writeDict(v->asDict());
-                break;
             default:
                 FleeceException::_throw(UnknownValue, "illegal typecode in Value; corrupt data?");
         }
     }
 
+#pragma mark - PARALLEL ENCODING:
+
+
+    // Collections with fewer items than this aren't split up.
+    static constexpr size_t kMinParallelItems = 256;
+    // Max number of items encoded as one unit of work.
+    static constexpr size_t kMaxItemsPerRange = 1024;
+    // How many levels of small collections to look inside for a large one to split.
+    static constexpr int kMaxParallelDepth = 3;
+
+
+    void JSONEncoder::writeValueParallel(const Value *v, unsigned maxThreads) {
+        if (maxThreads == 0)
+            maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        writeValueParallel(v, maxThreads, kMaxParallelDepth);
+    }
+
+
+    void JSONEncoder::writeValueParallel(const Value *v, unsigned maxThreads, int depth) {
+        auto type = v->type();
+        if (maxThreads <= 1 || depth <= 0 || (type != kArray && type != kDict)
+                || (type == kArray && ((const Array*)v)->isTyped())) {  // (items aren't Values)
+            writeValue(v);
+            return;
+        }
+
+        // Collect the items, in the order writeValue would write them:
+        struct entry {
+            slice keyStr;
+            const Value *key, *value;
+            bool operator< (const entry &other) const {return keyStr < other.keyStr;}
+        };
+        std::vector<entry> items;
+        if (type == kArray) {
+            auto array = (const Array*)v;
+            items.reserve(array->count());
+            for (Array::iterator iter(array); iter; ++iter)
+                items.push_back({nullslice, nullptr, iter.value()});
+        } else {
+            auto dict = (const Dict*)v;
+            items.reserve(dict->count());
+            for (auto iter = dict->begin(); iter; ++iter)
+                items.push_back({iter.keyString(), iter.key(), iter.value()});
+            if (_canonical)
+                std::sort(items.begin(), items.end());
+        }
+        bool isDict = (type == kDict);
+        isDict ? beginDictionary() : beginArray();
+
+        if (items.size() < kMinParallelItems) {
+            // Too small to be worth splitting, but one of its items might be:
+            for (auto &item : items) {
+                if (isDict)
+                    writeDictKey(item.keyStr, item.key);
+                writeValueParallel(item.value, maxThreads, depth - 1);
+            }
+            isDict ? endDictionary() : endArray();
+            return;
+        }
+
+        // Split the items into ranges; each thread claims one range at a time, encodes it with
+        // its own JSONEncoder, and stores the resulting JSON fragment:
+        size_t nRanges = std::max(size_t(maxThreads) * 4,
+                                  (items.size() + kMaxItemsPerRange - 1) / kMaxItemsPerRange);
+        nRanges = std::min(nRanges, items.size());
+        std::vector<alloc_slice> fragments(nRanges);
+        std::vector<std::unique_ptr<JSONEncoder>> encoders(maxThreads);
+        ForEachInParallel(nRanges, maxThreads, [&](size_t r, unsigned worker) {
+            auto &encPtr = encoders[worker];
+            if (!encPtr) {
+                encPtr.reset(new JSONEncoder);
+                encPtr->setJSON5(_json5);
+                encPtr->setCanonical(_canonical);
+            }
+            JSONEncoder &enc = *encPtr;
+            size_t begin = items.size() * r / nRanges;
+            size_t end   = items.size() * (r + 1) / nRanges;
+            for (size_t i = begin; i < end; ++i) {
+                if (isDict)
+                    enc.writeDictKey(items[i].keyStr, items[i].key);
+                enc.writeValue(items[i].value);
+            }
+            fragments[r] = enc.finish();
+            enc.reset();
+            return true;
+        });
+
+        // Splice the fragments together, comma-separated:
+        for (auto &fragment : fragments) {
+            comma();
+            _out << fragment;
+        }
+        isDict ? endDictionary() : endArray();
+    }
+
 } }
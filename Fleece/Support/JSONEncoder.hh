@@ -22,6 +22,7 @@
 #include "Value.hh"
 #include "FleeceException.hh"
 #include "NumConversion.hh"
+#include <memory>
 #include <stdio.h>
 
 
@@ -34,6 +35,21 @@ namespace fleece { namespace impl {
         :_out(reserveOutputSize)
         { }
 
+        /** Constructs an encoder that streams its output to a file as it goes, instead of
+            accumulating it in memory. Call finish() at the end to flush the remainder. */
+        explicit JSONEncoder(FILE* NONNULL outputFile)
+        :_out(Writer::OutputCallback([=](slice chunk) {
+            if (fwrite(chunk.buf, 1, chunk.size, outputFile) < chunk.size)
+                FleeceException::_throwErrno("Can't write JSON to file");
+        }))
+        { }
+
+        /** Constructs an encoder that streams its output to a callback in chunks, instead of
+            accumulating it in memory. Call finish() at the end to flush the remainder. */
+        explicit JSONEncoder(Writer::OutputCallback callback)
+        :_out(std::move(callback))
+        { }
+
         /** In JSON5 mode, dictionary keys that are JavaScript identifiers will be unquoted. */
         void setJSON5(bool j5)                  {_json5 = j5;}
         void setCanonical(bool canonical)       {_canonical = canonical;}
@@ -41,7 +57,7 @@ namespace fleece { namespace impl {
         bool isEmpty() const                    {return _out.length() == 0;}
         size_t bytesWritten() const             {return _out.length();}
 
-        /** Returns the encoded data. */
+        /** Returns the encoded data. (If streaming, just flushes the output and returns null.) */
         alloc_slice finish()                    {return _out.finish();}
 
         /** Resets the encoder so it can be used again. */
@@ -52,8 +68,10 @@ namespace fleece { namespace impl {
         void writeNull()                        {comma(); _out << slice("null");}
         void writeBool(bool b)                  {comma(); _out.write(b ? "true"_sl : "false"_sl);}
 
-        void writeInt(int64_t i)                {_writeInt("%lld", i);}
-        void writeUInt(uint64_t i)              {_writeInt("%llu", i);}
+        void writeInt(int64_t i)                {comma(); char str[kMaxIntStringSize];
+                                                 _out.write(str, WriteInt(i, str));}
+        void writeUInt(uint64_t i)              {comma(); char str[kMaxIntStringSize];
+                                                 _out.write(str, WriteUInt(i, str));}
         void writeFloat(float f)                {_writeFloat(f);}
         void writeDouble(double d)              {_writeFloat(d);}
 
@@ -65,6 +83,14 @@ namespace fleece { namespace impl {
                                                           _out << '"';}
         void writeValue(const Value *v);
 
+        /** Writes a Value just like writeValue, but encodes a large array or dictionary on
+            multiple threads: its items are split into ranges, each range is encoded by its own
+            JSONEncoder on a worker thread, and the results are spliced together with commas.
+            If the Value is a small collection, its items are checked for large collections
+            (down to a few levels deep.) The output is identical to writeValue's.
+            @param maxThreads  Max number of threads to use, or 0 to use one per CPU core. */
+        void writeValueParallel(const Value *v NONNULL, unsigned maxThreads =0);
+
         void writeJSON(slice json)              {comma(); _out << json;}
         void writeRaw(slice raw)                {_out << raw;}
 
@@ -110,7 +136,13 @@ namespace fleece { namespace impl {
         }
 
     private:
-        void writeDict(const Dict*);
+        struct ValueWriter;
+        struct KeyOrderCache;
+
+        void writeScalar(const Value*);
+        void writeCanonicalDictItems(const Dict*);
+        void writeDictKey(slice keyStr, const Value *key);
+        void writeValueParallel(const Value*, unsigned maxThreads, int depth);
         
         void comma() {
             if (_first)
@@ -119,13 +151,6 @@ namespace fleece { namespace impl {
                 _out << ',';
         }
 
-        template <class T>
-        void _writeInt(const char *fmt, T t) {
-            comma();
-            char str[32];
-            _out.write(str, sprintf(str, fmt, t));
-        }
-
         template <class T>
         void _writeFloat(T t) {
             comma();
@@ -134,6 +159,7 @@ namespace fleece { namespace impl {
         }
 
         Writer _out;
+        std::shared_ptr<KeyOrderCache> _keyOrderCache;  // Used by writeCanonicalDictItems
         bool _json5 {false};
         bool _canonical {false};
         bool _first {true};
@@ -7,6 +7,7 @@
 #pragma once
 #include "PlatformCompat.hh"
 #include <stddef.h>
+#include <stdint.h>
 
 namespace fleece {
 
@@ -14,6 +15,22 @@ namespace fleece {
     /// (I.e. non-numeric characters after the digits are not treated as an error.)
     double ParseDouble(const char *str NONNULL) noexcept;
 
+    /// Parse the first `length` bytes of `str` as a floating-point number. The string doesn't
+    /// need to be NUL-terminated.
+    double ParseDouble(const char *str NONNULL, size_t length);
+
+    /// Convert a floating-point number to an integer, truncating toward zero. Unlike a plain
+    /// cast, out-of-range values saturate to INT64_MIN or INT64_MAX, and NaN converts to 0.
+    static inline int64_t SaturatingInt64(double n) noexcept {
+        if (n != n)
+            return 0;
+        if (n >= 9223372036854775808.0)         // 2^63
+            return INT64_MAX;
+        if (n < -9223372036854775808.0)
+            return INT64_MIN;
+        return (int64_t)n;
+    }
+
     /// Format a 64-bit-floating point number to a string.
     size_t WriteFloat(double n, char *dst, size_t capacity);
 
@@ -23,4 +40,16 @@ namespace fleece {
     /// Alternative syntax for formatting a 64-bit-floating point number to a string.
     static inline size_t WriteDouble(double n, char *dst, size_t c)  {return WriteFloat(n, dst, c);}
 
+    /// Max number of characters written by WriteInt or WriteUInt.
+    static constexpr size_t kMaxIntStringSize = 20;
+
+    /// Format a signed integer in decimal, returning the number of characters written.
+    /// `dst` must have room for kMaxIntStringSize characters; no NUL terminator is written.
+    /// Unlike `sprintf`, this is not affected by the current locale.
+    size_t WriteInt(int64_t n, char *dst NONNULL);
+
+    /// Format an unsigned integer in decimal, returning the number of characters written.
+    /// `dst` must have room for kMaxIntStringSize characters; no NUL terminator is written.
+    size_t WriteUInt(uint64_t n, char *dst NONNULL);
+
 }
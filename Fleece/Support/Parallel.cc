@@ -0,0 +1,75 @@
+//
+// Parallel.cc
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "Parallel.hh"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fleece {
+    using namespace std;
+
+
+    void ForEachInParallel(size_t nTasks, unsigned maxThreads,
+                           function_ref<bool(size_t,unsigned)> task)
+    {
+        if (maxThreads == 0)
+            maxThreads = max(thread::hardware_concurrency(), 1u);
+
+        atomic<size_t> nextTask {0};
+        atomic<bool> stopped {false};
+        mutex errorMutex;
+        exception_ptr error;
+
+        auto work = [&](unsigned worker) {
+            size_t i;
+            while (!stopped && (i = nextTask++) < nTasks) {
+                try {
+                    if (!task(i, worker))
+                        stopped = true;
+                } catch (...) {
+                    lock_guard<mutex> lock(errorMutex);
+                    if (!error)
+                        error = current_exception();
+                    stopped = true;
+                }
+            }
+        };
+
+        // Start the worker threads, then make this thread one of the workers too:
+        unsigned nThreads = (unsigned)min(size_t(maxThreads), nTasks);
+        vector<thread> threads;
+        for (unsigned t = 1; t < nThreads; ++t) {
+            try {
+                threads.emplace_back(work, t);
+            } catch (const system_error&) {
+                break;      // Can't start more threads; make do with what we have
+            }
+        }
+        work(0);
+        for (auto &t : threads)
+            t.join();
+        if (error)
+            rethrow_exception(error);
+    }
+
+}
@@ -0,0 +1,38 @@
+//
+// Parallel.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <utility>
+#include "function_ref.hh"
+
+namespace fleece {
+
+    /** Calls `task(index, worker)` once for each index in [0, nTasks), on a pool of up to
+        `maxThreads` threads (or one per CPU core if it's 0), including the calling thread.
+        Each thread claims the next unclaimed index, in increasing order, until there are none
+        left. `worker` identifies the calling thread, from 0 to maxThreads-1, so a task can
+        reuse per-thread state such as an Encoder.
+        If `task` returns false, or throws, no more indexes are claimed; tasks already running
+        finish first. An exception thrown by a task is then rethrown to the caller.
+        If threads can't be started, the tasks run on as many threads as could be. */
+    void ForEachInParallel(size_t nTasks, unsigned maxThreads,
+                           function_ref<bool(size_t index, unsigned worker)> task);
+
+}
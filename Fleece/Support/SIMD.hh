@@ -0,0 +1,89 @@
+//
+// SIMD.hh
+//
+// Copyright (c) 2019 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+
+/*  Compile-time detection of the vector instruction sets Fleece can use.
+    Only the baseline ISA that the compiler is targeting is used; there is no runtime dispatch.
+    Define FL_DISABLE_SIMD to 1 to force the scalar code paths (useful for testing.)
+
+    FL_SIMD_SSE2   x86 / x86-64 with SSE2 (16-byte vectors)
+    FL_SIMD_AVX2   x86-64 compiled with -mavx2 (32-byte vectors)
+    FL_SIMD_NEON   little-endian ARM with NEON (16-byte vectors) */
+
+#ifndef FL_DISABLE_SIMD
+    #define FL_DISABLE_SIMD 0
+#endif
+
+#if !FL_DISABLE_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define FL_SIMD_SSE2 1
+    #include <emmintrin.h>
+    #if defined(__AVX2__)
+        #define FL_SIMD_AVX2 1
+        #include <immintrin.h>
+    #endif
+#elif !FL_DISABLE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+    #define FL_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+#ifndef FL_SIMD_SSE2
+    #define FL_SIMD_SSE2 0
+#endif
+#ifndef FL_SIMD_AVX2
+    #define FL_SIMD_AVX2 0
+#endif
+#ifndef FL_SIMD_NEON
+    #define FL_SIMD_NEON 0
+#endif
+
+#define FL_SIMD (FL_SIMD_SSE2 || FL_SIMD_NEON)
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace fleece {
+
+    /** Returns the index of the lowest set bit. The input must be nonzero. */
+    static inline unsigned countTrailingZeros(uint32_t bits) {
+    #ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return (unsigned)index;
+    #else
+        return (unsigned)__builtin_ctz(bits);
+    #endif
+    }
+
+    /** Returns the index of the lowest set bit. The input must be nonzero. */
+    static inline unsigned countTrailingZeros64(uint64_t bits) {
+    #if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return (unsigned)index;
+    #elif defined(_MSC_VER)
+        uint32_t lo = (uint32_t)bits;
+        return lo ? countTrailingZeros(lo) : 32 + countTrailingZeros((uint32_t)(bits >> 32));
+    #else
+        return (unsigned)__builtin_ctzll(bits);
+    #endif
+    }
+
+}
@@ -43,12 +43,21 @@ namespace fleece {
     }
 
 
+    Writer::Writer(OutputCallback callback, size_t chunkSize)
+    :Writer(chunkSize)
+    {
+        assert(callback);
+        _outputCallback = std::move(callback);
+    }
+
+
     Writer::Writer(Writer&& w) noexcept
     :_available(std::move(w._available))
     ,_chunks(std::move(w._chunks))
     ,_chunkSize(w._chunkSize)
     ,_length(w._length)
     ,_outputFile(w._outputFile)
+    ,_outputCallback(std::move(w._outputCallback))
     {
         migrateInitialBuf(w);
         memcpy(_initialBuf, w._initialBuf, sizeof(_initialBuf));
@@ -70,6 +79,7 @@ namespace fleece {
         _chunks = std::move(w._chunks);
         migrateInitialBuf(w);
         _outputFile = w._outputFile;
+        _outputCallback = std::move(w._outputCallback);
         memcpy(_initialBuf, w._initialBuf, sizeof(_initialBuf));
         w._outputFile = nullptr;
         return *this;
@@ -77,7 +87,7 @@ namespace fleece {
 
 
     void Writer::_reset() {
-        if (_outputFile)
+        if (isStreaming())
             return;
 
         size_t nChunks = _chunks.size();
@@ -98,7 +108,7 @@ namespace fleece {
 
 #if DEBUG
     void Writer::assertLengthCorrect() const {
-        if (!_outputFile) {
+        if (!isStreaming()) {
             size_t len = 0;
             forEachChunk([&](slice chunk) {
                 len += chunk.size;
@@ -111,7 +121,7 @@ namespace fleece {
 
     const void* Writer::writeToNewChunk(slice s) {
         // If we got here, a call to write(s) would not fit in the current chunk
-        if (_outputFile) {
+        if (isStreaming()) {
             flush();
             if (s.size > _chunkSize) {
                 freeChunk(_chunks.back());
@@ -137,14 +147,16 @@ namespace fleece {
 
 
     void Writer::flush() {
-        if (!_outputFile)
+        if (!isStreaming())
             return;
         auto chunk = _chunks.back();
         size_t writtenLength = chunk.size - _available.size;
         if (writtenLength > 0) {
-            _length -= _available.size;
-            if (fwrite(chunk.buf, 1, writtenLength, _outputFile) < writtenLength)
+            if (_outputCallback)
+                _outputCallback(slice(chunk.buf, writtenLength));
+            else if (fwrite(chunk.buf, 1, writtenLength, _outputFile) < writtenLength)
                 FleeceException::_throwErrno("Writer can't write to file");
+            _length -= _available.size;
             _available = chunk;
             _length += _available.size;
         }
@@ -206,7 +218,7 @@ namespace fleece {
 
     alloc_slice Writer::finish() {
         alloc_slice output;
-        if (_outputFile) {
+        if (isStreaming()) {
             flush();
         } else {
             output = alloc_slice(length());
@@ -223,7 +235,7 @@ namespace fleece {
 
 
     bool Writer::writeOutputToFile(FILE *f) {
-        assert(!_outputFile);
+        assert(!isStreaming());
         bool result = true;
         forEachChunk([&](slice chunk) {
             if (result && fwrite(chunk.buf, chunk.size, 1, f) < chunk.size)
@@ -244,7 +256,7 @@ namespace fleece {
     void Writer::writeBase64(slice data) {
         size_t base64size = ((data.size + 2) / 3) * 4;
         char *dst;
-        if (_outputFile)
+        if (isStreaming())
             dst = (char*)slice::newBytes(base64size);
         else
             dst = (char*)reserveSpace(base64size);
@@ -252,7 +264,7 @@ namespace fleece {
         enc.set_chars_per_line(0);
         size_t written = enc.encode(data.buf, data.size, dst);
         written += enc.encode_end(dst + written);
-        if (_outputFile) {
+        if (isStreaming()) {
             write(dst, written);
             free(dst);
         }
@@ -20,6 +20,7 @@
 
 #include "fleece/slice.hh"
 #include "SmallVector.hh"
+#include <functional>
 #include <stdio.h>
 #include <vector>
 
@@ -30,9 +31,20 @@ namespace fleece {
     class Writer {
     public:
         static const size_t kDefaultInitialCapacity = 256;
+        static const size_t kDefaultStreamChunkSize = 32 * 1024;
+
+        /** Receives the output of a streaming Writer, one chunk at a time. */
+        using OutputCallback = std::function<void(slice)>;
 
         Writer(size_t initialCapacity =kDefaultInitialCapacity);
         Writer(FILE * NONNULL outputFile);
+
+        /** Constructs a Writer that streams its output to a callback instead of keeping it.
+            Whenever the buffer fills up, and on flush() or finish(), the buffered data is passed
+            to the callback and the buffer is reused; so memory use is bounded by `chunkSize`
+            (or by the largest single write, if that's bigger.) Unlike a Writer to a FILE, the
+            destructor doesn't flush; call finish() when done. */
+        explicit Writer(OutputCallback, size_t chunkSize =kDefaultStreamChunkSize);
         ~Writer();
 
         Writer(Writer&&) noexcept;
@@ -44,12 +56,15 @@ namespace fleece {
         const void* curPos() const              {return _available.buf;}
         FILE* outputFile() const                {return _outputFile;}
 
+        /** True if output is being written to a file or callback, not kept in memory. */
+        bool isStreaming() const                {return _outputFile || _outputCallback;}
+
         void flush();
 
         /** Invokes the callback for each range of bytes in the output. */
         template <class T>
         void forEachChunk(T callback) const {
-            assert(!_outputFile);
+            assert(!isStreaming());
             auto n = _chunks.size();
             for (auto chunk : _chunks) {
                 if (_usuallyFalse(--n == 0)) {
@@ -102,6 +117,13 @@ namespace fleece {
             return (void*) result;
         }
 
+        /** Gives back the last `length` bytes of the space most recently reserved by
+            reserveSpace(). Nothing else may have been written since then. */
+        void unreserveSpace(size_t length) {
+            _available.moveStart(-(ptrdiff_t)length);
+            assertLengthCorrect();
+        }
+
         /** Reserves space for \ref count values of type \ref T. */
         template <class T>
         T* reserveSpace(size_t count)           {return (T*) reserveSpace(count * sizeof(T));}
@@ -138,6 +160,7 @@ namespace fleece {
         size_t _chunkSize;              // Size of next chunk to allocate
         size_t _length {0};             // Output length, offset by _available.size
         FILE* _outputFile;              // File writing to, or NULL
+        OutputCallback _outputCallback; // Callback writing to, or empty
         uint8_t _initialBuf[kDefaultInitialCapacity];   // Inline buffer to avoid a malloc
     };
 
@@ -124,6 +124,50 @@ TEST_CASE("API Encoder", "[API][Encoder]") {
 }
 
 
+TEST_CASE("API Dict GetMany", "[API]") {
+    Encoder enc;
+    enc.beginDict();
+    enc["bar"_sl] = "wow";
+    enc["bool"_sl] = true;
+    enc["foo"_sl] = 17;
+    enc.endDict();
+    Doc doc = enc.finishDoc();
+
+    FLDictKey keys[4] = {FLDictKey_Init("bar"_sl), FLDictKey_Init("baz"_sl),
+                         FLDictKey_Init("bool"_sl), FLDictKey_Init("foo"_sl)};
+    FLValue values[4];
+    CHECK(FLDict_GetMany(doc.root().asDict(), keys, 4, values) == 3);
+    CHECK(Value(values[0]).asString() == "wow"_sl);
+    CHECK(values[1] == nullptr);
+    CHECK(Value(values[2]).asBool() == true);
+    CHECK(Value(values[3]).asInt() == 17);
+
+    CHECK(FLDict_GetMany(nullptr, keys, 4, values) == 0);
+    CHECK(values[3] == nullptr);
+}
+
+
+TEST_CASE("API Array Copy", "[API]") {
+    Doc doc = Doc::fromJSON("[1, -2, 3.5, \"four\", 5, 6, 7, 8, 9000, 10]"_sl);
+    FLArray a = doc.root().asArray();
+    double doubles[10];
+    int64_t ints[10];
+    FLString strings[10];
+    CHECK(FLArray_CopyDoubles(a, 0, 10, doubles) == 10);
+    CHECK(doubles[1] == -2.0);
+    CHECK(doubles[2] == 3.5);
+    CHECK(doubles[3] == 0.0);
+    CHECK(doubles[8] == 9000.0);
+    CHECK(FLArray_CopyInts(a, 7, 10, ints) == 3);
+    CHECK(ints[0] == 8);
+    CHECK(ints[2] == 10);
+    CHECK(FLArray_CopyStrings(a, 2, 2, strings) == 2);
+    CHECK(slice(strings[0]) == nullslice);
+    CHECK(slice(strings[1]) == "four"_sl);
+    CHECK(FLArray_CopyInts(nullptr, 0, 10, ints) == 0);
+}
+
+
 TEST_CASE("API Paths", "[API][Encoder]") {
     alloc_slice fleeceData = readTestFile(kBigJSONTestFileName);
     Doc doc = Doc::fromJSON(fleeceData);
@@ -149,6 +193,51 @@ TEST_CASE("API Paths", "[API][Encoder]") {
 }
 
 
+TEST_CASE("API Streaming JSON", "[API]") {
+    Doc doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    Value root = doc.root();
+    alloc_slice expected = root.toJSON();
+
+    struct Output {
+        std::string json;
+        size_t chunks = 0, maxChunk = 0, abortAfter = SIZE_MAX;
+    };
+    auto callback = [](void *context, FLSlice chunk) -> bool {
+        auto out = (Output*)context;
+        out->json.append((const char*)chunk.buf, chunk.size);
+        out->maxChunk = std::max(out->maxChunk, chunk.size);
+        return ++out->chunks < out->abortAfter;
+    };
+
+    Output out;
+    FLError error = kFLNoError;
+    REQUIRE(FLValue_WriteJSON(root, false, false, callback, &out, &error));
+    CHECK(slice(out.json) == slice(expected));
+    if (expected.size > 100000) {
+        CHECK(out.chunks > 1);
+        CHECK(out.maxChunk < 100000);   // Output was never all in memory at once
+    }
+
+    // The callback can abort the conversion:
+    Output aborted;
+    aborted.abortAfter = 1;
+    CHECK(!FLValue_WriteJSON(root, false, false, callback, &aborted, &error));
+    CHECK(error == kFLEncodeError);
+    CHECK(aborted.chunks == 1);
+
+    // Writing to a file:
+    FILE *f = tmpfile();
+    REQUIRE(f);
+    REQUIRE(FLValue_WriteJSONToFile(root, false, false, f, &error));
+    std::string fromFile(expected.size, '\0');
+    rewind(f);
+    CHECK(fread(&fromFile[0], 1, fromFile.size(), f) == expected.size);
+    CHECK(fgetc(f) == EOF);
+    fclose(f);
+    CHECK(slice(fromFile) == slice(expected));
+}
+
+
 TEST_CASE("API Undefined", "[API]") {
     Encoder enc;
     enc.beginArray();
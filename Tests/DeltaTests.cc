@@ -19,7 +19,10 @@
 #include "FleeceTests.hh"
 #include "FleeceImpl.hh"
 #include "JSONDelta.hh"
+#include "FleeceDelta.hh"
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 namespace fleece { namespace impl {
     extern bool gCompatibleDeltas;
@@ -36,6 +39,19 @@ static std::string toJSONString(const Value *v) {
 }
 
 
+// Sets `JSONDelta::gMaxArrayDiffEdits`, which enables array diffs, for the object's lifetime.
+struct ArrayDiffEdits {
+    explicit ArrayDiffEdits(unsigned maxEdits = 100)
+    :_saved(JSONDelta::gMaxArrayDiffEdits)
+    {
+        JSONDelta::gMaxArrayDiffEdits = maxEdits;
+    }
+    ~ArrayDiffEdits()       {JSONDelta::gMaxArrayDiffEdits = _saved;}
+private:
+    unsigned _saved;
+};
+
+
 static void checkDelta(const char *json1, const char *json2, const char *deltaExpected) {
     auto sk = retained(new SharedKeys());
 
@@ -104,11 +120,11 @@ TEST_CASE("Delta strings", "[delta]") {
     // Modify string
     checkDelta("'to wound the autumnal city. So howled out for the world to give him a name.  The in-dark answered with the wind.'",
                "'To wound the eternal city. So he howled out for the world to give him its name. The in-dark answered with wind.'",
-               "[\"1-1+T|12=5-4+eter|13=3+he |37=1-3+its|6=1-27=4-5=\",0,2]");
+               "[\"1-1+T|12=5-4+eter|14=3+e h|36=1-3+its|7=1-25=4-6=\",0,2]");
     // Insert in middle
     checkDelta("'to wound the autumnal city. The in-dark answered with the wind.'",
                "'to wound the autumnal city. So howled out for the world to give him a name. The in-dark answered with the wind.'",
-               "[\"27=48+ So howled out for the world to give him a name.|36=\",0,2]");
+               "[\"28=48+So howled out for the world to give him a name. |35=\",0,2]");
     // Inefficient delta
     checkDelta("'Lorem ipsum dolor sit amet, assueverit sadipscing usu ea, mei efficiantur intellegebat in, iudico ullamcorper ei ius. Ius quaeque eripuit instructior ea, et ipsum doctus quo, pri decore ornatus et. Te wisi omittantur interpretaris quo, in audire prompta nominati vim. Dicat epicuri delectus sit eu.'",
                "'Ex quo prima efficiantur, an pro modus pertinax. Magna tractatos qualisque vim id. Eum at omnis inani, labore possim nec id. Exerci audire eam eu, summo liberavisse mel ei. Homero ponderum ea his, cum id impedit fuisset.'",
@@ -116,11 +132,34 @@ TEST_CASE("Delta strings", "[delta]") {
     // Delta control chars in string
     checkDelta("'ABC+DEF-HIJ=KLM|NOP *******************************'",
                "'AbC-def+HIJKLM|NOP= *******************************'",
-               "[\"1=7-7+bC-def+|3=1-7=1+=|32=\",0,2]");
+               "[\"1=11-10+bC-def+HIJ|7=1+=|32=\",0,2]");
+    // Too many edits to diff:
+    unsigned savedMax = JSONDelta::gMaxTextDiffEdits;
+    JSONDelta::gMaxTextDiffEdits = 20;
+    checkDelta("'to wound the autumnal city. So howled out for the world to give him a name.  The in-dark answered with the wind.'",
+               "'To wound the eternal city. So he howled out for the world to give him its name. The in-dark answered with wind.'",
+               "[\"To wound the eternal city. So he howled out for the world to give him its name. The in-dark answered with wind.\"]");
+    JSONDelta::gMaxTextDiffEdits = savedMax;
 
     JSONDelta::gMinStringDiffLength = 60;
 }
 
+
+TEST_CASE("Delta string errors", "[delta]") {
+    Retained<Doc> doc = Doc::fromJSON("\"The fog comes in on little cat feet\""_sl);
+    const Value *old = doc->root();
+    CHECK(Value::fromData(JSONDelta::apply(old, "[\"4=1-1+d|30=\",0,2]"_sl))->asString() ==
+          "The dog comes in on little cat feet"_sl);
+    for (const char *bad : {"[\"4=1-1+d|29=\",0,2]", "[\"4=1-1+d|31=\",0,2]",
+                            "[\"4=1-1+d30=\",0,2]", "[\"4=1-2+d|30=\",0,2]",
+                            "[\"4=1-1+d|30\",0,2]", "[\"=1-1+d|30=\",0,2]",
+                            "[\"4=1*1+d|30=\",0,2]", "[\"99999999999=\",0,2]",
+                            "[\"4=1-1+dd|30=\",0,2]"}) {
+        INFO("Delta: " << bad);
+        CHECK_THROWS(JSONDelta::apply(old, slice(bad)));
+    }
+}
+
 TEST_CASE("Delta strings UTF-8", "[delta]") {
     // See issue #40 -- JSONDelta must take care not to put a string patch boundary in the middle
     // of a UTF-8 multibyte character sequence, or the output will contain invalid UTF-8.
@@ -129,7 +168,7 @@ TEST_CASE("Delta strings UTF-8", "[delta]") {
     // Multi-byte UTF-8 chars, with patches occurring in midst of UTF-8 sequences:
     checkDelta(u8"'モバイルデータベースは将来のものです。 ある日、私たちのデータが端に集まります。'",
                u8"'モバイルデータベースがここにあります。 あなたのデータはすべて端にあります。'",
-               u8"[\"30=49-37+がここにあります。 あなた|12=3-12+はすべて|6=3-3-3+あ|12=\",0,2]");
+               u8"[\"30=52-40+がここにあります。 あなたの|9=3-12+はすべて|6=6-3+あ|12=\",0,2]");
 
     // Here the C7/C6 bytes can't be included in the preceding XXX/YYY diff:
     checkDelta("'<aaaaaaaaXXX\xC7\x88zzzzzzzz>'",
@@ -138,7 +177,7 @@ TEST_CASE("Delta strings UTF-8", "[delta]") {
 
     checkDelta(u8"'யாமறிந்த மொழிகளிலே தமிழ்மொழி போல் இனிதாவது எங்கும் காணோம், பாமரராய் விலங்குகளாய், உலகனைத்தும் இகழ்ச்சிசொலப் பான்மை கெட்டு, நாமமது தமிழரெனக் கொண்டு இங்கு வாழ்ந்திடுதல் நன்றோ? சொல்லீர்! தேமதுரத் இகழ்ச்சிசொலப் உலகமெலாம் பரவும்வகை செய்தல் வேண்டும்.'",
                u8"'யாமறிந்த மொழிகளிலே தமிழ்மொழி போல் இனிதாவது எங்கும் காணோம், பாமரராய் விலங்குகளாய், உலகனைத்தும் இகழ்ச்சிசொலப் பான்மை கெட்டு, நாமமது தமிழரெனக் கொண்டு இங்கு வாழ்ந்திடுதல் நன்றோ? கொண்டு! தேமதுரத் தமிழோசை உலகமெலாம் பரவும்வகை செய்தல் வேண்டும்.'",
-               "[\"476=3-3+க|3=3-3+ண|3=12-6+டு|27=21-6+தம|3=15-12+ழோசை|104=\",0,2]");
+               "[\"476=24-18+கொண்டு|27=39-21+தமிழோசை|104=\",0,2]");
 
     JSONDelta::gMinStringDiffLength = 60;
 }
@@ -151,7 +190,7 @@ TEST_CASE("Delta simple dicts", "[delta]") {
 
     checkDelta("{}", "{bar: 2}", "{bar:2}");
     checkDelta("{foo: 1}", "{}", "{foo:[]}");
-    checkDelta("{foo: 1}", "{bar: 2}", "{bar:2,foo:[]}");
+    checkDelta("{foo: 1}", "{bar: 2}", "{foo:[],bar:2}");
     checkDelta("{foo: 1}", "{foo: 2}", "{foo:2}");
     checkDelta("{foo: 1}", "{foo: 1, bar: 2}", "{bar:2}");
     checkDelta("{foo: 1, bar: 2, baz: 3}", "{foo: 1, bar: 17, baz: 3}", "{bar:17}");
@@ -163,6 +202,45 @@ TEST_CASE("Delta simple dicts", "[delta]") {
 }
 
 
+TEST_CASE("Delta wide dicts", "[delta]") {
+    // Dicts with many keys, some changed, some shared keys and some not:
+    std::stringstream oldJSON, nuuJSON;
+    oldJSON << "{";
+    nuuJSON << "{";
+    for (int i = 0; i < 500; ++i) {
+        if (i > 0) oldJSON << ",";
+        oldJSON << "\"key" << i << (i % 3 ? "" : "-not-shared-because-it-is-long") << "\":" << i;
+        if (i % 7 == 0)
+            continue;                                   // delete
+        if (i > 1) nuuJSON << ",";
+        nuuJSON << "\"key" << i << (i % 3 ? "" : "-not-shared-because-it-is-long") << "\":"
+                << (i % 5 ? i : -i);                    // modify
+        if (i % 11 == 0)
+            nuuJSON << ",\"new" << i << "\":" << i;   // insert
+    }
+    oldJSON << "}";
+    nuuJSON << "}";
+
+    auto sk1 = retained(new SharedKeys()), sk2 = retained(new SharedKeys());
+    Retained<Doc> nuuDoc = Doc::fromJSON(slice(nuuJSON.str()), sk1);
+    alloc_slice firstDelta;
+    for (SharedKeys *oldSK : {sk1.get(), sk2.get(), (SharedKeys*)nullptr}) {
+        Retained<Doc> oldDoc = Doc::fromJSON(slice(oldJSON.str()), oldSK);
+        alloc_slice delta = JSONDelta::create(oldDoc->root(), nuuDoc->root());
+        Encoder enc;
+        enc.setSharedKeys(oldSK);
+        JSONDelta::apply(oldDoc->root(), delta, false, enc);
+        Retained<Doc> resultDoc = enc.finishDoc();
+        CHECK(resultDoc->root()->isEqual(nuuDoc->root()));
+        // The delta has the same contents however the keys are encoded:
+        alloc_slice canonical = Doc::fromJSON(delta)->root()->toJSON(true);
+        if (!firstDelta)
+            firstDelta = canonical;
+        CHECK(canonical == firstDelta);
+    }
+}
+
+
 TEST_CASE("Delta nested dicts", "[delta]") {
     checkDelta("{}", "{bar: {baz: 9}}", "{bar:[{baz:9}]}");
     checkDelta("{foo: {bar: [1], baz:{goo:[3]},wow:0}}", "{foo: {bar: [1], baz:{goo:[3]},wow:0}}", nullptr);
@@ -201,6 +279,395 @@ TEST_CASE("Delta nested arrays", "[delta]") {
 }
 
 
+TEST_CASE("Delta array diffs", "[delta]") {
+    ArrayDiffEdits enabled;
+    checkDelta("[1, 2, 3, 5, 6, 7]", "[1, 2, 3, 4, 5]", "[[3,[4],1,-2],0,4]");
+    // Insertions & deletions in the middle:
+    checkDelta("[1, 2, 3, 4, 5, 6]", "[1, 2, 9, 3, 4, 5, 6]", "[[2,[9],4],0,4]");
+    checkDelta("[1, 2, 3, 4, 5, 6]", "[1, 2, 4, 5, 6]", "[[2,-1,3],0,4]");
+    checkDelta("[1, 2, 3, 4, 5, 6]", "[0, 1, 2, 3, 4, 5, 6]", "[[[0],6],0,4]");
+    checkDelta("[1, 2, 3, 4, 5, 6]", "[2, 3, 4, 5, 6]", "[[-1,5],0,4]");
+    // Reordering; moved collections and long strings are copied, not repeated:
+    checkDelta("[[1, 2], 'x', 'y', 'z']", "['x', 'y', 'z', [1, 2]]", "[[-1,3,\"@0\"],0,4]");
+    checkDelta("['a long string', 'b', 'c', 'another long string']",
+               "['b', 'c', 'another long string', 'a long string']",
+               "[[-1,3,\"@0\"],0,4]");
+    checkDelta("[{a: 1}, {b: 2}, 'x', 'y']", "['x', 'y', {a: 1}, {b: 2}]", "[[-2,2,\"@0:2\"],0,4]");
+    checkDelta("[1, 2, 3, 4]", "[2, 1, 3, 4]", "[[-1,1,[1],2],0,4]");
+    // Modified dicts among insertions/deletions are patched:
+    checkDelta("[{id: 1, n: 'a'}, {id: 2, n: 'b'}, {id: 3, n: 'c'}]",
+               "[{id: 0, n: 'z'}, {id: 1, n: 'a'}, {id: 2, n: 'B'}]",
+               "[[[{id:0,n:\"z\"}],1,{n:\"B\"},-1],0,4]");
+    // Changes in place still use the index-by-index form:
+    checkDelta("[1, 2, 3, 4]", "[1, 7, 8, 4]", "{\"1\":7,\"2\":8}");
+    checkDelta("[1, 2, 3, 4]", "[1, 2, 3, 4, 5]", "{\"4-\":[5]}");
+    // Nested:
+    checkDelta("{list: [1, 2, 3, 4]}", "{list: [1, 3, 4]}", "{list:[[1,-1,2],0,4]}");
+
+    // Too many edits to diff:
+    {
+        ArrayDiffEdits tooFew(1);
+        checkDelta("[1, 2, 3, 4]", "[0, 1, 2, 4]", "{\"0\":0,\"1\":1,\"2\":2}");
+    }
+}
+
+
+// By default, deltas only use the original format, so older implementations can apply them:
+TEST_CASE("Delta array diffs are opt-in", "[delta]") {
+    REQUIRE(JSONDelta::gMaxArrayDiffEdits == 0);
+    checkDelta("[1, 2, 3, 4, 5, 6]", "[1, 2, 9, 3, 4, 5, 6]",
+               "{\"2\":9,\"3\":3,\"4\":4,\"5\":5,\"6-\":[6]}");
+    checkDelta("[[1, 2], 'x', 'y', 'z']", "['x', 'y', 'z', [1, 2]]",
+               "{\"0\":\"x\",\"1\":\"y\",\"2\":\"z\",\"3\":[[1,2]]}");
+    checkDelta("{list: [1, 2, 3, 4]}", "{list: [1, 3, 4]}",
+               "{list:{\"1\":3,\"2\":4,\"3-\":[]}}");
+}
+
+
+TEST_CASE("Delta array diff errors", "[delta]") {
+    Retained<Doc> doc = Doc::fromJSON("[1, 2, 3]"_sl);
+    const Value *old = doc->root();
+    CHECK(slice(JSONDelta::apply(old, "[[1,\"@2\",2],0,4]"_sl)) ==
+          slice(Doc::fromJSON("[1,3,2,3]"_sl)->allocedData()));
+    for (const char *bad : {"[[2],0,4]", "[[4],0,4]", "[[-4,[1]],0,4]", "[[0,3],0,4]",
+                            "[[1.5],0,4]", "[[\"@3\",3],0,4]", "[[\"@1:3\",3],0,4]",
+                            "[[\"@\",3],0,4]", "[[\"@1x\",3],0,4]", "[[{\"a\":1},2],0,4]",
+                            "[[true,3],0,4]", "[5,0,4]"}) {
+        INFO("Delta: " << bad);
+        CHECK_THROWS(JSONDelta::apply(old, slice(bad)));
+    }
+}
+
+
+// Reports delta sizes for typical edits to an array of records:
+TEST_CASE("Delta array edit workloads", "[delta]") {
+    auto makeDoc = [](std::vector<int> ids, int modified = -1) {
+        std::stringstream json;
+        json << "[";
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (i > 0) json << ",";
+            json << "{\"id\":" << ids[i] << ",\"name\":\"Person number " << ids[i]
+                 << (ids[i] == modified ? " (edited)" : "")
+                 << "\",\"tags\":[\"alpha\",\"beta\"],\"score\":" << (ids[i] * 7 % 100) << "}";
+        }
+        json << "]";
+        return Doc::fromJSON(slice(json.str()));
+    };
+    std::vector<int> ids;
+    for (int i = 0; i < 200; ++i)
+        ids.push_back(i);
+
+    struct Workload {const char *name; std::vector<int> nuuIDs; int modified;};
+    std::vector<Workload> workloads;
+    auto edit = ids;
+    edit.insert(edit.begin() + 50, 1000);
+    workloads.push_back({"insert 1 in middle", edit, -1});
+    edit = ids;
+    edit.erase(edit.begin() + 50);
+    workloads.push_back({"delete 1 in middle", edit, -1});
+    edit = ids;
+    edit.insert(edit.begin(), 1000);
+    workloads.push_back({"insert 1 at start", edit, -1});
+    edit = ids;
+    std::rotate(edit.begin() + 20, edit.begin() + 21, edit.begin() + 180);
+    workloads.push_back({"move 1 item", edit, -1});
+    edit = ids;
+    edit.erase(edit.begin() + 10, edit.begin() + 15);
+    edit.insert(edit.begin() + 100, {2000, 2001, 2002});
+    workloads.push_back({"delete 5, insert 3", edit, 100});
+    workloads.push_back({"modify 1 in place", ids, 100});
+
+    Retained<Doc> oldDoc = makeDoc(ids);
+    for (auto &w : workloads) {
+        Retained<Doc> nuuDoc = makeDoc(w.nuuIDs, w.modified);
+        alloc_slice indexDelta = JSONDelta::create(oldDoc->root(), nuuDoc->root());
+        alloc_slice diffDelta;
+        {
+            ArrayDiffEdits enabled;
+            diffDelta = JSONDelta::create(oldDoc->root(), nuuDoc->root());
+        }
+        fprintf(stderr, "    %-20s: delta is %5zu bytes by index, %5zu bytes diffed\n",
+                w.name, indexDelta.size, diffDelta.size);
+        CHECK(diffDelta.size <= indexDelta.size);
+        alloc_slice result = JSONDelta::apply(oldDoc->root(), diffDelta);
+        CHECK(Value::fromData(result)->isEqual(nuuDoc->root()));
+    }
+}
+
+
+// Creates deltas between successive versions, then checks that composing them, or applying
+// them as a chain, produces the last version.
+static void checkComposedDeltas(std::vector<const char*> versions,
+                                const char *composedExpected =nullptr)
+{
+    std::vector<Retained<Doc>> docs;
+    for (auto json : versions)
+        docs.push_back(Doc::fromJSON(slice("[" + ConvertJSON5(std::string(json)) + "]")));
+    auto version = [&](size_t i) {return docs[i]->root()->asArray()->get(0);};
+
+    std::vector<alloc_slice> deltas;
+    for (size_t i = 1; i < docs.size(); ++i)
+        deltas.push_back(JSONDelta::create(version(i-1), version(i)));
+    alloc_slice composed = deltas[0];
+    for (size_t i = 1; i < deltas.size(); ++i)
+        composed = JSONDelta::compose(composed, deltas[i]);
+    std::cerr << "Composed delta: " << std::string(composed) << "\n";
+    if (composedExpected)
+        CHECK(composed == slice(ConvertJSON5(std::string(composedExpected))));
+
+    const Value *last = version(docs.size() - 1);
+    alloc_slice result = JSONDelta::apply(version(0), composed);
+    INFO("result:  " << toJSONString(Value::fromData(result)) << " ;  should be:  "
+         << toJSONString(last));
+    CHECK(Value::fromData(result)->isEqual(last));
+
+    std::vector<slice> chain(deltas.begin(), deltas.end());
+    alloc_slice chained = JSONDelta::applyChain(version(0), chain);
+    CHECK(Value::fromData(chained)->isEqual(last));
+}
+
+
+TEST_CASE("Delta composition", "[delta]") {
+    ArrayDiffEdits enabled;
+    // Replacements and dicts:
+    checkComposedDeltas({"1", "2", "3"}, "[3]");
+    checkComposedDeltas({"{a: 1}", "{a: 1, b: 2}", "{a: 1}"}, "{b:[]}");
+    checkComposedDeltas({"{a: 1, b: 2}", "{a: 3, b: 2}", "{a: 3, b: 4, c: 5}"},
+                        "{a:3,b:4,c:5}");
+    checkComposedDeltas({"{a: {x: 1}}", "{a: {x: 2}}", "{a: {x: 2, y: 3}}", "{b: 1}"},
+                        "{a:[],b:1}");
+    checkComposedDeltas({"{a: 1}", "{a: [1, 2]}", "{a: [1, 2, 3]}"}, "{a:[[1,2,3]]}");
+    checkComposedDeltas({"{a: 1}", "{}", "{a: {b: 2}}"});
+    // Strings:
+    JSONDelta::gMinStringDiffLength = 10;
+    checkComposedDeltas({"'The fog comes in on little cat feet'",
+                         "'The dog comes in on little cat feet'",
+                         "'The dog comes in on little rat feet!'"},
+                        "['4=1-1+d|22=1-1+r|7=1+!|',0,2]");
+    checkComposedDeltas({"'The fog comes in on little cat feet'",
+                         "'The dog comes in on big cat feet'",
+                         "'The dog comes in on big cat'"},
+                        "['4=1-1+d|15=6-3+big|4=5-',0,2]");
+    JSONDelta::gMinStringDiffLength = 60;
+    // Arrays:
+    checkComposedDeltas({"[1, 2, 3]", "[1, 9, 3]", "[1, 9, 3, 4]"}, "{'1':9,'3-':[4]}");
+    checkComposedDeltas({"[1, 2, 3, 4, 5, 6]", "[1, 2, 9, 3, 4, 5, 6]", "[9, 3, 4, 5, 6, 1]",
+                         "[{a: 1}, 9, 3, 4, 5, 6, 1]"},
+                        "[[[{a:1},9],-2,4,[1]],0,4]");
+    checkComposedDeltas({"{list: [1, 2, 3, 4, 5, 6]}", "{list: [6, 1, 2, 3, 4, 5]}",
+                         "{list: [6, 1, 2, 3, 4, 5], x: 1}", "{list: [6, 2, 3, 4, 5]}"},
+                        "{list:[[[6],-1,4,-1],0,4],x:[]}");
+    checkComposedDeltas({"[{a: 1}, {b: 2}, 3]", "[{b: 2}, {a: 1}, 3]", "[{b: 2}, {a: 2}, 3]"});
+    checkComposedDeltas({"['a', 'b', 'c']", "['c', 'a', 'b']", "['c', 'a', 'b', 'd']",
+                         "['d', 'c', 'b']"});
+}
+
+
+TEST_CASE("Delta composition in the original format", "[delta]") {
+    // By default (without array diffs) composing deltas gives an old-format delta, even when
+    // the deltas change an array's length:
+    checkComposedDeltas({"[1, 2, 3]", "[1, 2, 3, 4, 5]", "[1, 9, 3, 4]"}, "{'1':9,'3-':[4]}");
+    checkComposedDeltas({"[1, 2, 3, 4, 5]", "[1, 2, 3]", "[7, 2]"}, "{'0':7,'2-':[]}");
+    checkComposedDeltas({"[1, 2, 3]", "[1, 2, 3, {a: 1}]", "[1, 2, 3, {a: 2}]"},
+                        "{'3-':[{a:2}]}");
+    checkComposedDeltas({"[1, 2, 3]", "[1, 5, 3]", "[1]"}, "{'1-':[]}");
+    checkComposedDeltas({"[1, 2]", "[1, 2, 3, 4]", "[1, 2, 3, 8, 9]"}, "{'2-':[3,8,9]}");
+    checkComposedDeltas({"{list: [1, 2]}", "{list: [1, 2, 3]}", "{list: [0, 2, 3, 4]}"},
+                        "{list:{'0':0,'2-':[3,4]}}");
+    checkComposedDeltas({"[1, 2, 3]", "[1, 2]", "[1, 2, 4]", "[0]", "[0, 5, 6]"},
+                        "{'0':0,'1-':[5,6]}");
+}
+
+
+TEST_CASE("Delta composition errors", "[delta]") {
+    CHECK_THROWS(JSONDelta::compose("[]"_sl, "{\"a\":1}"_sl));
+    CHECK_THROWS(JSONDelta::compose("[\"3=\",0,2]"_sl, "[\"4=\",0,2]"_sl));
+    CHECK_THROWS(JSONDelta::compose("{"_sl, "{}"_sl));
+    Retained<Doc> doc = Doc::fromJSON("{\"a\": [1, 2, 3]}"_sl);
+    CHECK_THROWS(JSONDelta::apply(doc->root(), "[[[],{\"a\":1}],0,5]"_sl));
+    CHECK_THROWS(JSONDelta::apply(doc->root(), "[[],0,5]"_sl));
+}
+
+
+static void checkFleeceDelta(const char *json1, const char *json2, const char *deltaExpected) {
+    Retained<Doc> doc1, doc2;
+    const Value *v1 = nullptr, *v2 = nullptr;
+    if (json1) {
+        doc1 = Doc::fromJSON(slice("[" + ConvertJSON5(std::string(json1)) + "]"));
+        v1 = doc1->root()->asArray()->get(0);
+    }
+    doc2 = Doc::fromJSON(slice("[" + ConvertJSON5(std::string(json2)) + "]"));
+    v2 = doc2->root()->asArray()->get(0);
+
+    alloc_slice delta = FleeceDelta::create(v1, v2);
+    const Value *deltaValue = Value::fromData(delta);
+    REQUIRE(deltaValue);
+    CHECK(deltaValue->toJSONString() == ConvertJSON5(std::string(deltaExpected)));
+
+    alloc_slice reconstituted = FleeceDelta::apply(v1, delta);
+    auto v2_reconstituted = Value::fromData(reconstituted);
+    INFO("reconstituted:  " << toJSONString(v2_reconstituted) << " ;  should be:  "
+         << toJSONString(v2) << " ;  delta: " << deltaValue->toJSONString());
+    CHECK(v2_reconstituted->isEqual(v2));
+}
+
+
+TEST_CASE("Fleece delta", "[delta]") {
+    // Scalars:
+    checkFleeceDelta("5", "5", "{}");
+    checkFleeceDelta("5", "6", "6");
+    checkFleeceDelta("false", "[]", "[1,[]]");
+    checkFleeceDelta(nullptr, "{a: 1}", "[1,{a:1}]");
+    // Dicts:
+    checkFleeceDelta("{age: 8, grade: 3, name: {first: 'Bobby', last: 'Briggs'}}",
+                     "{age: 18, name: {first: 'Robert', last: 'Briggs'}}",
+                     "{age:18,grade:[0],name:{first:'Robert'}}");
+    checkFleeceDelta("{top: [2]}", "{top: {foo: 1}}", "{top:[1,{foo:1}]}");
+    checkFleeceDelta("{a: 1, c: 3, e: 5, g: 7}", "{b: 2, c: 3, e: 6, h: 8}",
+                     "{a:[0],b:2,e:6,g:[0],h:8}");
+    // Strings:
+    JSONDelta::gMinStringDiffLength = 36;
+    checkFleeceDelta("'to wound the autumnal city. The in-dark answered with the wind.'",
+                     "'to wound the autumnal city. So howled out for the world to give him a name. The in-dark answered with the wind.'",
+                     "[2,'28=48+So howled out for the world to give him a name. |35=']");
+    JSONDelta::gMinStringDiffLength = 60;
+    // Arrays:
+    checkFleeceDelta("[1, 2, 3]", "[1, 2, 3]", "{}");
+    checkFleeceDelta("[1, 2, 3]", "[1, 9, 3]", "[3,1,[5,9],1]");
+    checkFleeceDelta("[1, 2, 3]", "[1, 2, 3, 4, 5]", "[3,3,[1,4,5]]");
+    checkFleeceDelta("[1, 2, 3, 4, 5]", "[1, 2, 3]", "[3,3,-2]");
+    checkFleeceDelta("[1, 2, 3, 4, 5, 6]", "[1, 2, 9, 3, 4, 5, 6]", "[3,2,[1,9],4]");
+    checkFleeceDelta("[[1, 2], 'x', 'y', 'z']", "['x', 'y', 'z', [1, 2]]", "[3,-1,3,[4,0,1]]");
+    checkFleeceDelta("[1, [21, 22], {hi: 'there'}]", "[1, [21, 222], {hi: 'ho'}]",
+                     "[3,1,[5,[3,1,[5,222]]],{hi:'ho'}]");
+    checkFleeceDelta("{list: [1, 2, 3, 4]}", "{list: [1, 3, 4]}", "{list:[3,1,-1,2]}");
+}
+
+
+TEST_CASE("Fleece delta errors", "[delta]") {
+    Retained<Doc> doc = Doc::fromJSON("{\"a\": [1, 2, 3], \"s\": \"hi\"}"_sl);
+    const Value *old = doc->root();
+    for (const char *bad : {"[]", "[9]", "[0,1]", "[1]", "{\"a\":[3,4]}", "{\"a\":[3,2]}",
+                            "{\"a\":[3,-4,[1,1]]}", "{\"a\":[3,[4,2,2],3]}", "{\"a\":[3,[5],3]}",
+                            "{\"a\":[3,[7],3]}", "{\"a\":[3,\"x\",3]}", "{\"a\":[2,\"x\"]}",
+                            "{\"s\":[2,\"\"]}", "{\"s\":[3,1]}", "{\"s\":{\"x\":1}}"}) {
+        INFO("Delta: " << bad);
+        Retained<Doc> delta = Doc::fromJSON(slice(bad));
+        CHECK_THROWS(FleeceDelta::apply(old, delta->allocedData()));
+    }
+    CHECK_THROWS(FleeceDelta::apply(old, alloc_slice("not Fleece!")));
+}
+
+
+#if FL_HAVE_TEST_FILES
+// Compares the sizes of JSON and Fleece deltas for some typical changes to a big array.
+TEST_CASE("Fleece delta vs JSON delta", "[delta]") {
+    alloc_slice input = readTestFile("1000people.json");
+    Retained<Doc> oldDoc = Doc::fromJSON(input);
+    // Make some typical changes: modify, insert, delete and move a few records:
+    Encoder enc;
+    enc.beginArray();
+    auto array = oldDoc->root()->asArray();
+    for (uint32_t i = 0; i < array->count(); ++i) {
+        if (i == 10 || i == 500)
+            continue;                                   // delete
+        if (i == 200)
+            enc.writeValue(array->get(900));            // move
+        if (i == 900)
+            continue;
+        if (i == 300) {
+            enc.beginDictionary();                      // modify
+            for (Dict::iterator d(array->get(i)->asDict()); d; ++d) {
+                enc.writeKey(d.keyString());
+                if (d.keyString() == "name"_sl)
+                    enc.writeString("Somebody Else");
+                else
+                    enc.writeValue(d.value());
+            }
+            enc.endDictionary();
+            continue;
+        }
+        enc.writeValue(array->get(i));
+        if (i == 700)
+            enc.writeValue(array->get(3));              // insert
+    }
+    enc.endArray();
+    Retained<Doc> nuuDoc = enc.finishDoc();
+
+    ArrayDiffEdits enabled;
+    alloc_slice jsonDelta = JSONDelta::create(oldDoc->root(), nuuDoc->root());
+    alloc_slice fleeceDelta = FleeceDelta::create(oldDoc->root(), nuuDoc->root());
+    fprintf(stderr, "    JSON delta is %zu bytes, Fleece delta is %zu bytes\n",
+            jsonDelta.size, fleeceDelta.size);
+    // Both should describe the moves with an array diff, not by rewriting most of the records
+    // (the re-encoded records are equal but not byte-identical to the originals):
+    CHECK(jsonDelta.size < 2000);
+    CHECK(fleeceDelta.size < 2000);
+    alloc_slice r1 = JSONDelta::apply(oldDoc->root(), jsonDelta);
+    alloc_slice r2 = FleeceDelta::apply(oldDoc->root(), fleeceDelta);
+    CHECK(Value::fromData(r1)->isEqual(nuuDoc->root()));
+    CHECK(Value::fromData(r2)->isEqual(nuuDoc->root()));
+}
+
+
+// Applies a chain of deltas to a big array, composed vs. one at a time.
+TEST_CASE("Delta chain", "[delta]") {
+    ArrayDiffEdits enabled;
+    alloc_slice input = readTestFile("1000people.json");
+    std::vector<Retained<Doc>> docs {Doc::fromJSON(input)};
+    std::vector<alloc_slice> deltas;
+    for (uint32_t n = 0; n < 10; ++n) {
+        // Each version renames one person and moves another one to the end:
+        auto array = docs.back()->root()->asArray();
+        Encoder enc;
+        enc.beginArray();
+        for (uint32_t i = 0; i < array->count(); ++i) {
+            if (i == 100 * n + 50)
+                continue;
+            if (i == 97 * n) {
+                enc.beginDictionary();
+                for (Dict::iterator d(array->get(i)->asDict()); d; ++d) {
+                    enc.writeKey(d.keyString());
+                    if (d.keyString() == "name"_sl)
+                        enc.writeString("Person " + std::to_string(n));
+                    else
+                        enc.writeValue(d.value());
+                }
+                enc.endDictionary();
+            } else {
+                enc.writeValue(array->get(i));
+            }
+        }
+        enc.writeValue(array->get(100 * n + 50));
+        enc.endArray();
+        docs.push_back(enc.finishDoc());
+        deltas.push_back(JSONDelta::create(docs[n]->root(), docs[n+1]->root()));
+    }
+
+    alloc_slice sequential;
+    {
+        Stopwatch st;
+        Retained<Doc> doc = docs[0];
+        for (auto &delta : deltas)
+            doc = new Doc(JSONDelta::apply(doc->root(), delta), Doc::kTrusted);
+        sequential = doc->allocedData();
+        fprintf(stderr, "    Applying %zu deltas one at a time: %.3f ms\n",
+                deltas.size(), st.elapsedMS());
+    }
+    alloc_slice chained;
+    {
+        Stopwatch st;
+        std::vector<slice> chain(deltas.begin(), deltas.end());
+        chained = JSONDelta::applyChain(docs[0]->root(), chain);
+        fprintf(stderr, "    Applying %zu deltas as a chain:    %.3f ms\n",
+                deltas.size(), st.elapsedMS());
+    }
+    CHECK(Value::fromData(sequential)->isEqual(docs.back()->root()));
+    CHECK(Value::fromData(chained)->isEqual(docs.back()->root()));
+}
+#endif
+
+
 static void checkDelta(const Value *left, const Value *right, const Value *expectedDelta) {
     if (!expectedDelta)
         expectedDelta = Dict::kEmpty;
@@ -19,13 +19,19 @@
 #include "FleeceTests.hh"
 #include "Pointer.hh"
 #include "JSONConverter.hh"
+#include "JSONParser.hh"
+#include "JSONLinesConverter.hh"
+#include "JSONEncoder.hh"
 #include "KeyTree.hh"
 #include "Path.hh"
+#include "PathSet.hh"
 #include "Internal.hh"
+#include "MutableArray.hh"
 #include "jsonsl.h"
 #include "mn_wordlist.h"
 #include "NumConversion.hh"
 #include <iostream>
+#include <sstream>
 #include <float.h>
 
 #ifndef _MSC_VER
@@ -414,6 +420,274 @@ public:
 #endif
     }
 
+    TEST_CASE_METHOD(EncoderTests, "Array copyTo", "[Encoder]") {
+        // Mostly short ints (so whole groups of 8 take the fast path), plus a few other values:
+        static const unsigned kCount = 37;
+        auto itemAt = [](unsigned i) -> double {
+            if (i == 11)  return 123456;
+            if (i == 12)  return -3.5;
+            if (i == 30)  return -2048;
+            return (int)i * 97 % 4096 - 2048;
+        };
+        for (int wide = false; wide <= true; ++wide) {
+            enc.beginArray();
+            for (unsigned i = 0; i < kCount; i++) {
+                if (i == 20)
+                    enc.writeString("twenty");
+                else if (i == 12)
+                    enc.writeDouble(itemAt(i));
+                else
+                    enc.writeInt((int64_t)itemAt(i));
+            }
+            if (wide)
+                enc.writeString(std::string(100000, '*'));    // forces a wide array
+            enc.endArray();
+            endEncoding();
+            auto array = Value::fromData(result)->asArray();
+            REQUIRE(array);
+            CHECK(((((const uint8_t*)array)[0] & 0x08) != 0) == (bool)wide);
+
+            for (uint32_t start : {0u, 1u, 5u, 30u}) {
+                double doubles[kCount + 10];
+                int64_t ints[kCount + 10];
+                slice strings[kCount + 10];
+                uint32_t expected = kCount + wide - start;
+                REQUIRE(array->copyTo(doubles, kCount + 10, start) == expected);
+                REQUIRE(array->copyTo(ints, kCount + 10, start) == expected);
+                REQUIRE(array->copyTo(strings, kCount + 10, start) == expected);
+                for (uint32_t i = start; i < kCount; i++) {
+                    auto item = array->get(i);
+                    CHECK(doubles[i - start] == item->asDouble());
+                    CHECK(ints[i - start] == item->asInt());
+                    CHECK(strings[i - start] == item->asString());
+                    if (i != 20)
+                        CHECK(doubles[i - start] == itemAt(i));
+                }
+                if (start <= 20)
+                    CHECK(strings[20 - start] == "twenty"_sl);
+            }
+            double d[3];
+            CHECK(array->copyTo(d, 3, 10) == 3);
+            CHECK(d[0] == itemAt(10));
+            CHECK(d[2] == itemAt(12));
+            CHECK(array->copyTo(d, 3, kCount + wide) == 0);
+            CHECK(Array::kEmpty->copyTo(d, 3) == 0);
+        }
+
+        Retained<MutableArray> mut = MutableArray::newArray();
+        mut->append(17);
+        mut->append(-3.5);
+        mut->append("x"_sl);
+        int64_t ints[5];
+        CHECK(mut->copyTo(ints, 5, 1) == 2);
+        CHECK(ints[0] == -3);
+        CHECK(ints[1] == 0);
+        slice strings[5];
+        CHECK(mut->copyTo(strings, 5) == 3);
+        CHECK(strings[2] == "x"_sl);
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "Typed arrays", "[Encoder]") {
+        static const size_t kCount = 768;
+        std::vector<float> floats(kCount);
+        std::vector<int16_t> shorts(kCount);
+        std::vector<double> doubles(kCount);
+        for (size_t i = 0; i < kCount; i++) {
+            floats[i] = i * 0.25f - 17.125f;
+            shorts[i] = int16_t(i * 77 - 30000);
+            doubles[i] = i / 3.0;
+        }
+        const int8_t bytes[3] = {-128, 0, 127};
+        const int64_t longs[2] = {INT64_MIN, 1234567890123};
+
+        enc.beginDictionary();
+        enc.writeKey("bytes");      enc.writeTypedArray(bytes, 3);
+        enc.writeKey("doubles");    enc.writeTypedArray(doubles.data(), kCount);
+        enc.writeKey("empty");      enc.writeTypedArray((const int32_t*)nullptr, 0);
+        enc.writeKey("floats");     enc.writeTypedArray(floats.data(), kCount);
+        enc.writeKey("longs");      enc.writeTypedArray(longs, 2);
+        enc.writeKey("shorts");     enc.writeTypedArray(shorts.data(), kCount);
+        enc.endDictionary();
+        endEncoding();
+        Retained<Doc> doc = new Doc(result);
+        auto root = doc->asDict();
+        REQUIRE(root);
+
+        // Zero-copy access:
+        auto fa = root->get("floats"_sl)->asArray();
+        REQUIRE(fa->count() == kCount);
+        CHECK(!fa->empty());
+        auto fspan = fa->asTypedSpan<float>();
+        REQUIRE(fspan.size == kCount);
+        CHECK(((size_t)fspan.data % sizeof(float)) == 0);
+        CHECK(std::equal(fspan.begin(), fspan.end(), floats.begin()));
+        CHECK(fa->asTypedSpan<double>().empty());     // wrong type
+        // 8-byte items are aligned relative to the start of the data, which an alloc_slice
+        // only guarantees to 4 bytes:
+        auto dspan = root->get("doubles"_sl)->asArray()->asTypedSpan<double>();
+        auto lspan = root->get("longs"_sl)->asArray()->asTypedSpan<int64_t>();
+        if ((size_t)result.buf % 8 == 0) {
+            REQUIRE(dspan.size == kCount);
+            CHECK(std::equal(dspan.begin(), dspan.end(), doubles.begin()));
+            REQUIRE(lspan.size == 2);
+            CHECK(lspan[0] == INT64_MIN);
+            CHECK(lspan[1] == 1234567890123);
+        } else {
+            CHECK(dspan.empty());
+            CHECK(lspan.empty());
+        }
+
+        // Access as a regular Array:
+        auto sa = root->get("shorts"_sl)->asArray();
+        REQUIRE(sa->count() == kCount);
+        CHECK(sa->get(kCount) == nullptr);
+        size_t i = 0;
+        for (Array::iterator iter(sa); iter; ++iter, ++i)
+            CHECK(iter.value()->asInt() == shorts[i]);
+        CHECK(i == kCount);
+        for (i = 0; i < kCount; i += 37)
+            CHECK(fa->get(uint32_t(i))->asFloat() == floats[i]);
+        CHECK(root->get("empty"_sl)->asArray()->empty());
+        CHECK(root->get("bytes"_sl)->toJSONString() == "[-128,0,127]");
+        CHECK(root->get("longs"_sl)->toJSONString() == "[-9223372036854775808,1234567890123]");
+
+        // Bulk copying:
+        std::vector<double> out(kCount);
+        CHECK(fa->copyTo(out.data(), kCount, 10) == kCount - 10);
+        CHECK(out[0] == floats[10]);
+        CHECK(out[kCount - 11] == floats[kCount - 1]);
+        int64_t ints[3];
+        CHECK(root->get("bytes"_sl)->asArray()->copyTo(ints, 5) == 3);
+        CHECK(ints[0] == -128);
+        CHECK(ints[2] == 127);
+
+        // Compactness: 4 bytes per float, vs. a pointer plus a 6-byte float Value:
+        CHECK(result.size < kCount * (2 * 4 + 2 + 4 + 8 + 10));
+
+        // Copying preserves the format:
+        enc.writeValue(root);
+        endEncoding();
+        Retained<Doc> copy = new Doc(result);
+        CHECK(copy->root()->isEqual(root));
+        auto fspan2 = copy->asDict()->get("floats"_sl)->asArray()->asTypedSpan<float>();
+        REQUIRE(fspan2.size == kCount);
+        CHECK(std::equal(fspan2.begin(), fspan2.end(), floats.begin()));
+
+        // Mutable copy:
+        Retained<MutableArray> mut = MutableArray::newArray(sa);
+        REQUIRE(mut->count() == kCount);
+        CHECK(mut->get(5)->asInt() == shorts[5]);
+        mut->set(5, 1);
+        CHECK(mut->get(5)->asInt() == 1);
+        CHECK(mut->get(6)->asInt() == shorts[6]);
+
+        // NaN is rejected:
+        float nan[2] = {1.0f, NAN};
+        CHECK_THROWS_AS(enc.writeTypedArray(nan, 2), FleeceException&);
+        enc.reset();
+
+        // Out-of-range floats saturate when copied as ints, just like regular arrays:
+        const double big[4] = {1e300, -1e300, 2.75, -2.75};
+        enc.beginArray();
+        enc.writeTypedArray(big, 4);
+        enc.beginArray();
+        for (double d : big)
+            enc.writeDouble(d);
+        enc.endArray();
+        enc.endArray();
+        endEncoding();
+        Retained<Doc> bigDoc = new Doc(result);
+        int64_t typedInts[4], untypedInts[4];
+        REQUIRE(bigDoc->asArray()->get(0)->asArray()->copyTo(typedInts, 4) == 4);
+        REQUIRE(bigDoc->asArray()->get(1)->asArray()->copyTo(untypedInts, 4) == 4);
+        CHECK(typedInts[0] == INT64_MAX);
+        CHECK(typedInts[1] == INT64_MIN);
+        CHECK(typedInts[2] == 2);
+        CHECK(typedInts[3] == -2);
+        CHECK(std::equal(&typedInts[0], &typedInts[4], &untypedInts[0]));
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "Typed arrays appended to a base", "[Encoder]") {
+        // Base data whose size isn't a multiple of 8:
+        enc.beginArray();
+        enc.writeString("hello");
+        enc.endArray();
+        alloc_slice base = enc.finish();
+        enc.reset();
+        REQUIRE(base.size % 8 != 0);
+
+        const double doubles[3] = {0.5, -1.25, 1e100};
+        enc.setBase(base);
+        enc.writeTypedArray(doubles, 3);
+        alloc_slice output = enc.finish();
+        enc.reset();
+
+        // Put the combined data in an 8-byte-aligned buffer, as a mapped file would be:
+        std::vector<uint64_t> buffer((base.size + output.size + 7) / 8);
+        memcpy(buffer.data(), base.buf, base.size);
+        memcpy((uint8_t*)buffer.data() + base.size, output.buf, output.size);
+        auto array = Value::fromData(slice(buffer.data(), base.size + output.size))->asArray();
+        REQUIRE(array);
+        auto span = array->asTypedSpan<double>();
+        REQUIRE(span.size == 3);
+        CHECK(std::equal(span.begin(), span.end(), &doubles[0]));
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "Typed arrays without a Doc", "[Encoder]") {
+        const int32_t ints[4] = {1, 2, 3, 4};
+        enc.writeTypedArray(ints, 4);
+        endEncoding();
+        // Older readers see a wide array with an impossible count, and reject it:
+        REQUIRE(result.size > kTypedArrayHeaderSize);
+        CHECK(memcmp(result.buf, kTypedArrayHeader, kTypedArrayHeaderSize) == 0);
+
+        // Without a Doc, everything but get() and Array::iterator reads the packed items:
+        auto array = Value::fromData(result)->asArray();
+        REQUIRE(array);
+        CHECK(array->isTyped());
+        CHECK(array->count() == 4);
+        CHECK(!array->empty());
+        CHECK(array->toJSONString() == "[1,2,3,4]");
+        CHECK(array->asTypedSpan<int32_t>().size == 4);
+        int64_t out[4];
+        CHECK(array->copyTo(out, 4) == 4);
+        CHECK(out[3] == 4);
+
+        Retained<Doc> regular = Doc::fromJSON("[1,2,3,4]"_sl);
+        CHECK(array->isEqual(regular->root()));
+        CHECK(regular->root()->isEqual(array));
+        CHECK(array->contentHash() == regular->root()->contentHash());
+        Retained<Doc> other = Doc::fromJSON("[1,2,3,5]"_sl);
+        CHECK(!array->isEqual(other->root()));
+        CHECK(array->contentHash() != other->root()->contentHash());
+        CHECK(!array->isEqual(Array::kEmpty));
+        CHECK(array->contentHash() != Array::kEmpty->contentHash());
+
+        // Items are decoded the way the Encoder would write them, so they compare equal to
+        // regular arrays of the same numbers:
+        const double doubles[5] = {1.0, -2.5, 1e100, 3e9, 0.1};
+        enc.writeTypedArray(doubles, 5);
+        endEncoding();
+        array = Value::fromData(result)->asArray();
+        REQUIRE(array);
+        enc.beginArray();
+        for (double d : doubles)
+            enc.writeDouble(d);
+        enc.endArray();
+        alloc_slice regularData = enc.finish();
+        enc.reset();
+        auto regularArray = Value::fromData(regularData);
+        CHECK(array->toJSONString() == regularArray->toJSONString());
+        CHECK(array->isEqual(regularArray));
+        CHECK(array->contentHash() == regularArray->contentHash());
+
+        // In a Doc, items can be accessed as Values:
+        Retained<Doc> doc = new Doc(result);
+        REQUIRE(doc->asArray()->count() == 5);
+        CHECK(doc->asArray()->get(2)->asDouble() == 1e100);
+        CHECK(doc->asArray()->get(3)->isInteger());
+    }
+
     TEST_CASE_METHOD(EncoderTests, "Dictionaries", "[Encoder]") {
         {
             enc.beginDictionary();
@@ -574,6 +848,331 @@ public:
         REQUIRE((slice)output == json);
     }
 
+    TEST_CASE_METHOD(EncoderTests, "JSON Escaped Strings", "[Encoder]") {
+        // Escaped strings of various lengths, as JSON and unescaped. Long ones are unescaped
+        // directly into the output, which must be identical to writing them normally.
+        std::vector<std::pair<std::string,std::string>> strings = {
+            {"\\u0041\\u0042\\u0043", "ABC"},                              // shrinks to shareable
+            {"tab\\there\\nand\\\"quotes\\\"", "tab\there\nand\"quotes\""},  // shared
+            {"line\\none\\nline\\ntwo", "line\none\nline\ntwo"},           // not shared
+            {"odd length\\n!", "odd length\n!"},
+        };
+        std::string longStr(120, 'x');
+        strings.push_back({longStr + "\\\"", longStr + "\""});        // 1-byte size either way
+        strings.push_back({longStr + "\\u00e9\\uD83D\\uDE1C", longStr + "é😜"}); // size shrinks
+        strings.push_back({std::string(20, 'y') + "\\\\" + std::string(150, 'z'),
+                           std::string(20, 'y') + "\\" + std::string(150, 'z')});
+
+        std::stringstream json;
+        json << "[";
+        for (int rep = 0; rep < 2; ++rep) {
+            for (auto &s : strings)
+                json << "\"" << s.first << "\",{\"" << s.first << "\":\"" << s.first << "\"},";
+        }
+        json << "1]";
+
+        JSONConverter j(enc);
+        REQUIRE(j.encodeJSON(slice(json.str())));
+        alloc_slice converted = enc.finish();
+        enc.reset();
+
+        enc.beginArray();
+        for (int rep = 0; rep < 2; ++rep) {
+            for (auto &s : strings) {
+                enc.writeString(s.second);
+                enc.beginDictionary();
+                enc.writeKey(slice(s.second));
+                enc.writeString(s.second);
+                enc.endDictionary();
+            }
+        }
+        enc.writeInt(1);
+        enc.endArray();
+        alloc_slice expected = enc.finish();
+        enc.reset();
+        CHECK(converted == expected);
+
+        auto root = Value::fromData(converted)->asArray();
+        REQUIRE(root);
+        for (size_t i = 0; i < strings.size(); ++i)
+            CHECK(root->get(uint32_t(2*i))->asString() == slice(strings[i].second));
+    }
+
+    TEST_CASE("JSONEncoder String Escapes", "[Encoder]") {
+        // Put each escapable character at every position of a long string, so that it lands
+        // in each lane of a vector as well as in the scalar tail:
+        std::vector<std::pair<char, std::string>> escapes = {
+            {'"', "\\\""}, {'\\', "\\\\"}, {'\n', "\\n"}, {'\r', "\\r"}, {'\t', "\\t"},
+            {'\0', "\\u0000"}, {'\x1f', "\\u001f"}, {'\x7f', "\\u007f"}};
+        std::string clean = "The quick brown fox jumps over the lazy dog. \xC3\xA9\xE2\x82\xAC 0123456789";
+        JSONEncoder je;
+        for (auto &esc : escapes) {
+            for (size_t pos = 0; pos <= clean.size(); ++pos) {
+                std::string str = clean;
+                str.insert(pos, 1, esc.first);
+                std::string expected = "\"" + clean.substr(0, pos) + esc.second
+                                     + clean.substr(pos) + "\"";
+                je.writeString(slice(str));
+                alloc_slice json = je.finish();
+                je.reset();
+                CHECK(std::string(json) == expected);
+            }
+        }
+        je.writeString(std::string(100, '\n'));
+        CHECK(je.finish().size == 2 + 200);
+    }
+
+    TEST_CASE("JSONEncoder Parallel", "[Encoder]") {
+        // The people array is big enough to be split; wrapping it in a dict checks that a large
+        // collection nested in a small one gets split too:
+        auto people = readTestFile(kBigJSONTestFileName);
+        std::string wrapped = "{\"count\":1000,\"people\":" + std::string(people) + "}";
+        for (auto json : {slice(people), slice(wrapped)}) {
+            auto doc = Doc::fromJSON(json);
+            for (int mode = 0; mode < 3; ++mode) {
+                INFO("mode " << mode);
+                JSONEncoder expected, parallel;
+                expected.setJSON5(mode == 1);
+                parallel.setJSON5(mode == 1);
+                expected.setCanonical(mode == 2);
+                parallel.setCanonical(mode == 2);
+                expected.writeValue(doc->root());
+                parallel.writeValueParallel(doc->root(), 4);
+                CHECK(parallel.finish() == expected.finish());
+            }
+        }
+
+        // A big dict, as an item of an array:
+        Encoder enc;
+        enc.beginArray();
+        enc.writeNull();
+        enc.beginDictionary();
+        for (int i = 0; i < 1000; ++i) {
+            char key[10];
+            sprintf(key, "k%d", i);
+            enc.writeKey(key);
+            enc.writeInt(i);
+        }
+        enc.endDictionary();
+        enc.endArray();
+        alloc_slice data = enc.finish();
+        JSONEncoder expected, parallel;
+        expected.writeValue(Value::fromData(data));
+        parallel.writeValueParallel(Value::fromData(data), 3);
+        CHECK(parallel.finish() == expected.finish());
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSON Parser Errors", "[Encoder]") {
+        struct {const char *json; int err; size_t pos;} kCases[] = {
+            {"[1,2,]",      JSONSL_ERROR_TRAILING_COMMA,    5},
+            {"{\"a\":1,}",  JSONSL_ERROR_TRAILING_COMMA,    7},
+            {"[1}",         JSONSL_ERROR_BRACKET_MISMATCH,  2},
+            {"]",           JSONSL_ERROR_STRAY_TOKEN,       0},
+            {"{\"a\" 1}",   JSONSL_ERROR_MISSING_TOKEN,     5},
+            {"[1 2]",       JSONSL_ERROR_MISSING_TOKEN,     3},
+            {"{1:2}",       JSONSL_ERROR_HKEY_EXPECTED,     1},
+            {"[] x",        JSONSL_ERROR_GARBAGE_TRAILING,  3},
+            {"nul",         JSONSL_ERROR_SPECIAL_EXPECTED,  0},
+            {"[tru]",       JSONSL_ERROR_SPECIAL_EXPECTED,  1},
+            {"[.5]",        JSONSL_ERROR_SPECIAL_EXPECTED,  1},
+            {"[01]",        JSONSL_ERROR_INVALID_NUMBER,    1},
+            {"[-]",         JSONSL_ERROR_INVALID_NUMBER,    1},
+            {"[1.]",        JSONSL_ERROR_INVALID_NUMBER,    1},
+            {"[1e]",        JSONSL_ERROR_INVALID_NUMBER,    1},
+            {"",            JSONConverter::kErrTruncatedJSON, 0},
+            {"   ",         JSONConverter::kErrTruncatedJSON, 3},
+            {"[1",          JSONConverter::kErrTruncatedJSON, 2},
+            {"{\"a\":",     JSONConverter::kErrTruncatedJSON, 5},
+            {"\"abc",       JSONConverter::kErrTruncatedJSON, 4},
+        };
+        for (auto &c : kCases) {
+            INFO("JSON: " << c.json);
+            JSONConverter j(enc);
+            CHECK(!j.encodeJSON(slice(c.json)));
+            CHECK(j.jsonError() == c.err);
+            CHECK(j.errorPos() == c.pos);
+            enc.reset();
+        }
+
+        // A bad escape in a long string, which is unescaped right into the output, leaves the
+        // Encoder usable:
+        std::string longStr(120, 'x');
+        JSONConverter j(enc);
+        CHECK(!j.encodeJSON(slice("\"" + longStr + "\\q\"")));
+        CHECK(j.jsonError() == JSONSL_ERROR_ESCAPE_INVALID);
+        REQUIRE(j.encodeJSON(slice("\"" + longStr + "\\n\"")));
+        endEncoding();
+        CHECK(Value::fromData(result)->asString() == slice(longStr + "\n"));
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSON Parser Nesting Limit", "[Encoder]") {
+        for (size_t depth : {JSONParser::kMaxDepth, JSONParser::kMaxDepth + 1, size_t(100000)}) {
+            INFO("depth " << depth);
+            std::string json = std::string(depth, '[') + std::string(depth, ']');
+            bool ok = (depth <= JSONParser::kMaxDepth);
+            JSONConverter j(enc);
+            CHECK(j.encodeJSON(slice(json)) == ok);
+            if (ok) {
+                enc.end();
+                CHECK(enc.finish());
+            } else {
+                CHECK(j.jsonError() == JSONSL_ERROR_LEVELS_EXCEEDED);
+                CHECK(j.errorPos() == JSONParser::kMaxDepth);
+            }
+            enc.reset();
+        }
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSON Parser Numbers", "[Encoder][Numeric]") {
+        JSONConverter j(enc);
+        REQUIRE(j.encodeJSON("[0,-0,7,-7,9223372036854775807,-9223372036854775808,"
+                             "18446744073709551615,18446744073709551616,1.5e3,-2.5E-2,0.125]"_sl));
+        endEncoding();
+        auto a = checkArray(11);
+        CHECK(a->get(0)->asInt() == 0);
+        CHECK(a->get(1)->asInt() == 0);
+        CHECK(a->get(2)->asInt() == 7);
+        CHECK(a->get(3)->asInt() == -7);
+        CHECK(a->get(4)->asInt() == INT64_MAX);
+        CHECK(a->get(5)->asInt() == INT64_MIN);
+        CHECK(a->get(6)->isUnsigned());
+        CHECK(a->get(6)->asUnsigned() == UINT64_MAX);
+        CHECK(!a->get(7)->isInteger());
+        CHECK(a->get(7)->asDouble() == 18446744073709551616.0);
+        CHECK(a->get(8)->asDouble() == 1500.0);
+        CHECK(a->get(9)->asDouble() == -0.025);
+        CHECK(a->get(10)->asDouble() == 0.125);
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSON Parser Block Boundaries", "[Encoder]") {
+        // The parser scans its input in 64-byte blocks; make sure strings and escapes that
+        // straddle a block boundary are handled, by sliding them across one.
+        for (size_t pad = 50; pad < 70; ++pad) {
+            std::string padding(pad, ' ');
+            std::string json = padding + "[\"a\\\\\\\"b\\uD83D\\uDE1C\\\\\",\"x,]\",12345,true]";
+            INFO("pad = " << pad);
+            JSONConverter j(enc);
+            REQUIRE(j.encodeJSON(slice(json)));
+            endEncoding();
+            auto a = checkArray(4);
+            CHECK(a->get(0)->asString() == "a\\\"b😜\\"_sl);
+            CHECK(a->get(1)->asString() == "x,]"_sl);
+            CHECK(a->get(2)->asInt() == 12345);
+            CHECK(a->get(3)->asBool() == true);
+        }
+
+        // More structural characters than fit in one batch of the index:
+        std::stringstream json;
+        json << "[";
+        for (int i = 0; i < 5000; ++i)
+            json << (i ? "," : "") << "{\"k\":[" << i << ",\"\\\"]\"]}";
+        json << "]";
+        JSONConverter j(enc);
+        REQUIRE(j.encodeJSON(slice(json.str())));
+        endEncoding();
+        auto a = checkArray(5000);
+        for (int i = 0; i < 5000; i += 499) {
+            auto item = a->get(i)->asDict()->get("k"_sl)->asArray();
+            CHECK(item->get(0)->asInt() == i);
+            CHECK(item->get(1)->asString() == "\"]"_sl);
+        }
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSON Streaming", "[Encoder]") {
+        std::stringstream str;
+        str << "{\"long\":\"" << std::string(200, 'x') << "\\\\\\\"\\uD83D\\uDE1C\",\"nums\":[";
+        for (int i = 0; i < 300; ++i)
+            str << (i ? "," : "") << (i * 1234567) << ",-" << i << ".25e-1";
+        str << "],\"lits\":[true,false,null],\"empty\":{}}";
+        std::string json = str.str();
+
+        JSONConverter j(enc);
+        REQUIRE(j.encodeJSON(slice(json)));
+        endEncoding();
+        alloc_slice expected = Value::fromData(result)->toJSON();
+
+        for (size_t chunkSize : {1, 2, 3, 7, 63, 64, 65, 100, 129, 1000, 100000}) {
+            INFO("chunkSize = " << chunkSize);
+            for (size_t pos = 0; pos < json.size(); pos += chunkSize)
+                REQUIRE(j.feed(slice(&json[pos], std::min(chunkSize, json.size() - pos))));
+            REQUIRE(j.finish());
+            endEncoding();
+            CHECK(Value::fromData(result)->toJSON() == expected);
+        }
+
+        // Truncated:
+        CHECK(j.feed(slice(json).upTo(&json[json.size() / 2])));
+        CHECK(!j.finish());
+        CHECK(j.jsonError() == JSONConverter::kErrTruncatedJSON);
+        CHECK(j.errorPos() == json.size() / 2);
+        enc.reset();
+
+        // Error in a later chunk reports its position in the whole input:
+        std::string bad = json;
+        bad.insert(bad.size() - 1, ",");
+        bool ok = true;
+        for (size_t pos = 0; pos < bad.size() && ok; pos += 100)
+            ok = j.feed(slice(&bad[pos], std::min(size_t(100), bad.size() - pos)));
+        CHECK(!j.finish());
+        CHECK(j.jsonError() == JSONSL_ERROR_TRAILING_COMMA);
+        CHECK(j.errorPos() == bad.size() - 1);
+        enc.reset();
+    }
+
+    TEST_CASE("JSON Lines", "[Encoder]") {
+        std::stringstream in;
+        const int kNumLines = 5000;
+        for (int i = 0; i < kNumLines; ++i) {
+            in << "{\"id\":" << i << ",\"name\":\"Person " << i << "\",\"tags\":[\"a\",\"b\"]}";
+            in << (i % 3 ? "\n" : "\r\n");
+            if (i % 1000 == 0)
+                in << "   \n";     // blank lines are skipped
+        }
+        std::string input = in.str();
+
+        Retained<SharedKeys> sk = new SharedKeys();
+        JSONLinesConverter converter(sk, 4);
+        auto docs = converter.convertToDocs(slice(input));
+        REQUIRE(docs.size() == kNumLines);
+        for (int i = 0; i < kNumLines; ++i) {
+            auto dict = docs[i]->asDict();
+            REQUIRE(dict);
+            CHECK(dict->get("id"_sl)->asInt() == i);
+            CHECK(dict->get("name"_sl)->asString() == slice("Person " + std::to_string(i)));
+        }
+        CHECK(sk->count() == 3);
+
+        alloc_slice data = converter.convertToArray(slice(input));
+        Scope scope(data, sk);
+        auto array = Value::fromData(data)->asArray();
+        REQUIRE(array);
+        REQUIRE(array->count() == kNumLines);
+        CHECK(array->get(4321)->asDict()->get("id"_sl)->asInt() == 4321);
+        for (int i = 0; i < kNumLines; ++i)
+            REQUIRE(array->get(i)->isEqual(docs[i]->root()));
+
+        // Scalars, which the array stores inline rather than as pointers to the lines' data:
+        alloc_slice scalars = converter.convertToArray("1\n-5000\n\"x\"\n\n[true]\n{}\nnull"_sl);
+        CHECK(Value::fromData(scalars)->toJSON() == "[1,-5000,\"x\",[true],{},null]"_sl);
+
+        // An invalid line:
+        std::string bad = input;
+        bad.insert(bad.find("{\"id\":2001,"), "[");
+        try {
+            converter.convertToDocs(slice(bad));
+            FAIL("Should have thrown");
+        } catch (const FleeceException &x) {
+            CHECK(x.code == JSONError);
+            CHECK(std::string(x.what()).find("line 2005:") != std::string::npos);
+        }
+        try {
+            converter.convertToArray(slice(bad));
+            FAIL("Should have thrown");
+        } catch (const FleeceException &x) {
+            CHECK(std::string(x.what()).find("line 2005:") != std::string::npos);
+        }
+    }
+
     TEST_CASE_METHOD(EncoderTests, "JSONBinary", "[Encoder]") {
         enc.beginArray();
         enc.writeData(slice("not-really-binary"));
@@ -759,6 +1358,43 @@ public:
 #endif
     }
 
+    TEST_CASE_METHOD(EncoderTests, "Dict::getMany", "[Encoder]") {
+        enc.beginDictionary();
+        for (char c = 'a'; c <= 'z'; c += 2) {
+            enc.writeKey(slice(&c, 1));
+            enc.writeInt(c);
+        }
+        enc.endDictionary();
+        endEncoding();
+        auto dict = Value::fromData(result)->asDict();
+        REQUIRE(dict);
+
+        // Keys in ascending order, with some missing ones (the odd letters):
+        Dict::key keys[6] = {{"0"_sl}, {"a"_sl}, {"b"_sl}, {"m"_sl}, {"y"_sl}, {"~"_sl}};
+        const Value* values[6];
+        for (int pass = 0; pass < 2; ++pass) {      // 2nd pass uses the cached hints
+            CHECK(dict->getMany(keys, 6, values) == 3);
+            CHECK(values[0] == nullptr);
+            CHECK(values[1] == dict->get("a"_sl));
+            CHECK(values[2] == nullptr);
+            CHECK(values[3] == dict->get("m"_sl));
+            CHECK(values[4] == dict->get("y"_sl));
+            CHECK(values[5] == nullptr);
+        }
+
+        // Keys out of order, and repeated:
+        Dict::key jumbled[5] = {{"w"_sl}, {"c"_sl}, {"c"_sl}, {"x"_sl}, {"e"_sl}};
+        CHECK(dict->getMany(jumbled, 5, values) == 4);
+        CHECK(values[0]->asInt() == 'w');
+        CHECK(values[1]->asInt() == 'c');
+        CHECK(values[2]->asInt() == 'c');
+        CHECK(values[3] == nullptr);
+        CHECK(values[4]->asInt() == 'e');
+
+        CHECK(Dict::kEmpty->getMany(keys, 6, values) == 0);
+        CHECK(values[1] == nullptr);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "Paths", "[Encoder]") {
         auto input = readTestFile(kBigJSONTestFileName);
         JSONConverter jr(enc);
@@ -785,6 +1421,192 @@ public:
 #endif
     }
 
+    TEST_CASE_METHOD(EncoderTests, "PathSet", "[Encoder]") {
+        auto input = readTestFile(kBigJSONTestFileName);
+        JSONConverter jr(enc);
+        jr.encodeJSON(input);
+        enc.end();
+        alloc_slice fleeceData = enc.finish();
+        const Value *root = Value::fromData(fleeceData);
+
+        const char* specs[] = {"[32].name", "[32].age", "[32].address", "[32].friends[1].name",
+                               "[32].friends[-1].id", "[32].name", "[0].tags[0]", "[-1].name",
+                               "[32].nosuchproperty", "[32].name.first", "[999999].name",
+                               "[32].friends[99].name", "[32]"};
+        const unsigned n = sizeof(specs) / sizeof(specs[0]);
+        PathSet paths;
+        for (unsigned i = 0; i < n; ++i)
+            CHECK(paths.add(slice(specs[i])) == i);
+        CHECK(paths.count() == n);
+
+        const Value* values[n];
+        unsigned nFound = 0;
+        for (unsigned i = 0; i < n; ++i) {
+            values[i] = Path(slice(specs[i])).eval(root);
+            if (values[i])
+                ++nFound;
+        }
+        CHECK(nFound == 9);
+        const Value* results[n];
+        for (int pass = 0; pass < 2; ++pass) {
+            CHECK(paths.eval(root, results) == nFound);
+            for (unsigned i = 0; i < n; ++i) {
+                INFO("path " << specs[i]);
+                CHECK(results[i] == values[i]);
+            }
+        }
+        REQUIRE(results[0]);
+        CHECK(results[0]->asString() == "Mendez Tran"_sl);
+
+        Encoder enc2;
+        paths.writeTo(enc2, root);
+        alloc_slice projection = enc2.finish();
+        const Array *array = Value::fromData(projection)->asArray();
+        REQUIRE(array);
+        CHECK(array->count() == n);
+        for (unsigned i = 0; i < n; ++i) {
+            INFO("path " << specs[i]);
+            if (values[i])
+                CHECK(array->get(i)->isEqual(values[i]));
+            else
+                CHECK(array->get(i)->type() == kNull);
+        }
+
+        // The empty path is the root:
+        PathSet rootSet;
+        rootSet.add(Path());
+        CHECK(rootSet.eval(root, results) == 1);
+        CHECK(results[0] == root);
+
+        // With shared keys, so the dicts have int keys:
+        Retained<SharedKeys> sk = new SharedKeys();
+        Retained<Doc> doc = Doc::fromJSON(input, sk);
+        const Value *skRoot = doc->root();
+        int nameKey;
+        CHECK(sk->encode("name"_sl, nameKey));
+        for (int pass = 0; pass < 2; ++pass) {
+            nFound = 0;
+            for (unsigned i = 0; i < n; ++i) {
+                values[i] = Path(slice(specs[i])).eval(skRoot);
+                if (values[i])
+                    ++nFound;
+            }
+            CHECK(nFound == 9);
+            CHECK(paths.eval(skRoot, results) == nFound);
+            for (unsigned i = 0; i < n; ++i) {
+                INFO("path " << specs[i]);
+                CHECK(results[i] == values[i]);
+            }
+        }
+        REQUIRE(results[0]);
+        CHECK(results[0]->asString() == "Mendez Tran"_sl);
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSONPath queries", "[Encoder]") {
+        JSONConverter jr(enc);
+        jr.encodeJSON(slice(json5("{store:{book:[{title:'A',price:8,tags:['x']},"
+                                                "{title:'B',price:12},"
+                                                "{title:'C',price:9,isbn:'123'}],"
+                                         "bicycle:{color:'red',price:20}}}")));
+        alloc_slice data = enc.finish();
+        const Value *root = Value::fromData(data);
+        REQUIRE(root);
+
+        auto query = [&](const char *spec) {
+            std::string result;
+            Path path{slice(spec)};
+            for (Path::iterator i(path, root); i; ++i) {
+                if (!result.empty())
+                    result += ",";
+                result += i.value()->toJSONString();
+            }
+            return result;
+        };
+        CHECK(query("store.book[*].title") == "\"A\",\"B\",\"C\"");
+        CHECK(query("$.store.book.*.price") == "8,12,9");
+        CHECK(query("$..price") == "20,8,12,9");
+        CHECK(query("$..book[0].title") == "\"A\"");
+        CHECK(query("..tags[*]") == "\"x\"");
+        CHECK(query("$.store.*.color") == "\"red\"");
+        CHECK(query("$.store.book[1:].title") == "\"B\",\"C\"");
+        CHECK(query("$.store.book[-2:].title") == "\"B\",\"C\"");
+        CHECK(query("$.store.book[:-1].title") == "\"A\",\"B\"");
+        CHECK(query("$.store.book[::2].title") == "\"A\",\"C\"");
+        CHECK(query("$.store.book[5:9]").empty());
+        CHECK(query("$.store.book[?(@.price < 10)].title") == "\"A\",\"C\"");
+        CHECK(query("$.store.book[?(@.price >= 9)].title") == "\"B\",\"C\"");
+        CHECK(query("$.store.book[?(@.isbn)].title") == "\"C\"");
+        CHECK(query("$.store.book[?(@.title == 'B')].price") == "12");
+        CHECK(query("$.store.book[?( @.title != \"B\" )].price") == "8,9");
+        CHECK(query("$.store.book[?(@.tags[0] == 'x')].title") == "\"A\"");
+        CHECK(query("$.store.book[?(@.price == 'B')]").empty());
+        CHECK(query("$..[?(@ == 'red')]") == "\"red\"");
+        CHECK(query("$.store.book[1].title") == "\"B\"");
+        CHECK(query("$.store.nosuchproperty[*]").empty());
+
+        // eval returns the first match:
+        Path prices("$..price");
+        CHECK(!prices.isSingular());
+        CHECK(Path("store.book[-1].price").isSingular());
+        CHECK(prices.eval(root)->asInt() == 20);
+        CHECK(Path::eval("$..title"_sl, root)->asString() == "A"_sl);
+
+        // Converting back to a string:
+        CHECK(std::string(Path("$..book[?(@.price < 10)].title"))
+              == "..book[?(@.price < 10)].title");
+        CHECK(std::string(Path("store.*[1:-1]")) == "store[*][1:-1]");
+        CHECK(std::string(Path("store.\\*")) == "store.\\*");
+
+        CHECK_THROWS(Path("store..."));
+        CHECK_THROWS(Path("store.."));
+        CHECK_THROWS(Path("book[1:2:0]"));
+        CHECK_THROWS(Path("book[1:x]"));
+        CHECK_THROWS(Path("book[?(@.price = 1)]"));
+        CHECK_THROWS(Path("book[?(@.price > )]"));
+        CHECK_THROWS(Path("book[?(@.price > 1 2)]"));
+        CHECK_THROWS(Path("book[?(@.price > 1"));
+        CHECK_THROWS(Path("book[?(@[*].price > 1)]"));
+        CHECK_THROWS(Path("book[?(price > 1)]"));
+        PathSet paths;
+        CHECK_THROWS(paths.add("..price"_sl));
+    }
+
+    TEST_CASE_METHOD(EncoderTests, "JSONPath queries on people", "[Encoder]") {
+        auto input = readTestFile(kBigJSONTestFileName);
+        JSONConverter jr(enc);
+        jr.encodeJSON(input);
+        alloc_slice fleeceData = enc.finish();
+        const Value *root = Value::fromData(fleeceData);
+
+        // Compare with the same queries done by hand:
+        unsigned nOld = 0, nFriends = 0;
+        for (Array::iterator i(root->asArray()); i; ++i) {
+            if (i->asDict()->get("age"_sl)->asInt() > 30)
+                ++nOld;
+            nFriends += i->asDict()->get("friends"_sl)->asArray()->count();
+        }
+
+        Path old("$[?(@.age > 30)].name");
+        unsigned n = 0;
+        for (Path::iterator i(old, root); i; ++i) {
+            REQUIRE(i.value()->type() == kString);
+            ++n;
+        }
+        CHECK(n == nOld);
+
+        Path friends("[*].friends[*].name");
+        n = 0;
+        for (Path::iterator i(friends, root); i; ++i)
+            ++n;
+        CHECK(n == nFriends);
+
+        Path deepFriends("..friends..name");
+        n = 0;
+        for (Path::iterator i(deepFriends, root); i; ++i)
+            ++n;
+        CHECK(n == nFriends);
+    }
+
     TEST_CASE_METHOD(EncoderTests, "Resuse Encoder", "[Encoder]") {
         enc.beginDictionary();
         enc.writeKey("foo");
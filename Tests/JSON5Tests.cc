@@ -17,6 +17,7 @@
 //
 
 #include "JSON5.hh"
+#include "FleeceImpl.hh"
 #include "catch.hpp"
 
 using namespace fleece;
@@ -49,6 +50,11 @@ TEST_CASE("JSON5 Numbers") {
     CHECK(ConvertJSON5("6.02e23") == "6.02e23");
     CHECK(ConvertJSON5("6.02E+23") == "6.02E+23");
     CHECK(ConvertJSON5("6.02E-23") == "6.02E-23");
+    CHECK(ConvertJSON5("-.5") == "-0.5");
+    CHECK(ConvertJSON5("5.") == "5.0");
+    CHECK_THROWS_AS(ConvertJSON5("-"), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("."), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("1e"), const json5_error&);
 }
 
 TEST_CASE("JSON5 Strings") {
@@ -58,6 +64,10 @@ TEST_CASE("JSON5 Strings") {
     CHECK(ConvertJSON5("'hi'") == "\"hi\"");
     CHECK(ConvertJSON5("'hi \"there\"'") == "\"hi \\\"there\\\"\"");
     CHECK(ConvertJSON5("'can\\'t'") == "\"can't\"");
+    CHECK(ConvertJSON5("'tab\\there'") == "\"tab\\there\"");
+    CHECK(ConvertJSON5("'\\x41\\u00e9\\ud83d\\ude00'") == "\"A\u00e9\U0001F600\"");
+    CHECK_THROWS_AS(ConvertJSON5("'\\ud83d'"), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("'unterminated"), const json5_error&);
 }
 
 TEST_CASE("JSON5 Arrays") {
@@ -76,3 +86,44 @@ TEST_CASE("JSON5 Objects") {
     CHECK(ConvertJSON5("{key:false,$other:'hey',}") == "{\"key\":false,\"$other\":\"hey\"}");
     CHECK(ConvertJSON5("{_key : false, _Oth3r:null,}") == "{\"_key\":false,\"_Oth3r\":null}");
 }
+
+
+TEST_CASE("JSON5 Errors") {
+    try {
+        ConvertJSON5("[1, 2 3]");
+        FAIL("Should have thrown");
+    } catch (const json5_error &x) {
+        CHECK(x.inputPos == 6);
+    }
+    CHECK_THROWS_AS(ConvertJSON5("{key false}"), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("nul"), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("[1] 2"), const json5_error&);
+    CHECK_THROWS_AS(ConvertJSON5("/* unterminated"), const json5_error&);
+}
+
+TEST_CASE("JSON5 To Fleece") {
+    impl::Encoder enc;
+    ConvertJSON5("{name: 'Zeb', 'ages': [0, -7, .5, 6.02e23, 18446744073709551615, "
+                 "-9223372036854775808, 1.25e-2], "
+                 "/* comment */ ok: true, nil: null, quote: 'can\\'t',}"_sl, enc);
+    alloc_slice data = enc.finish();
+    const impl::Value *root = impl::Value::fromData(data);
+    REQUIRE(root);
+    auto dict = root->asDict();
+    REQUIRE(dict);
+    CHECK(dict->get("name"_sl)->asString() == "Zeb"_sl);
+    CHECK(dict->get("ok"_sl)->asBool() == true);
+    CHECK(dict->get("nil"_sl)->type() == impl::kNull);
+    CHECK(dict->get("quote"_sl)->asString() == "can't"_sl);
+    auto ages = dict->get("ages"_sl)->asArray();
+    REQUIRE(ages->count() == 7);
+    CHECK(ages->get(0)->isInteger());
+    CHECK(ages->get(0)->asInt() == 0);
+    CHECK(ages->get(1)->asInt() == -7);
+    CHECK(ages->get(2)->asDouble() == 0.5);
+    CHECK(ages->get(3)->asDouble() == 6.02e23);
+    CHECK(ages->get(4)->isUnsigned());
+    CHECK(ages->get(4)->asUnsigned() == UINT64_MAX);
+    CHECK(ages->get(5)->asInt() == INT64_MIN);
+    CHECK(ages->get(6)->asDouble() == 1.25e-2);
+}
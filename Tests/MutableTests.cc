@@ -724,6 +724,106 @@ namespace fleece {
     }
 
 
+    // Appends a delta to `doc` that changes one key of its root Dict; returns the new root.
+    static const Dict* appendDictChange(Retained<Doc> &doc, Encoder &enc,
+                                        const char *key, int value)
+    {
+        Retained<MutableDict> update = MutableDict::newDict(doc->asDict());
+        if (value >= 0)
+            update->set(slice(key), value);
+        else
+            update->remove(slice(key));
+        alloc_slice data = doc->allocedData();
+        enc.setBase(data);
+        enc.writeValue(update);
+        data.append(enc.finish());
+        enc.reset();
+        doc = Doc::fromFleece(data, Doc::kTrusted);
+        return doc->asDict();
+    }
+
+    TEST_CASE("Flattening inherited dicts", "[Mutable]") {
+        Retained<Doc> doc;
+        {
+            Encoder enc;
+            enc.beginDictionary();
+            for (int i = 0; i < 10; i++) {
+                char key[16];
+                sprintf(key, "key%d", i);
+                enc.writeKey(slice(key));
+                enc.writeInt(i);
+            }
+            enc.endDictionary();
+            doc = enc.finishDoc();
+        }
+        const Dict *dict = doc->asDict();
+        CHECK(dict->parentDepth() == 0);
+
+        Encoder enc;
+        SECTION("Default limits") {
+            for (int i = 1; i <= 5; i++) {
+                dict = appendDictChange(doc, enc, "counter", i);
+                CHECK(dict->parentDepth() == (i % 3));
+                CHECK(dict->count() == 11);
+                CHECK(dict->get("counter"_sl)->asInt() == i);
+            }
+        }
+        SECTION("No inheritance") {
+            enc.setDictInheritanceLimits(0, 1.0);
+            for (int i = 1; i <= 3; i++) {
+                dict = appendDictChange(doc, enc, "counter", i);
+                CHECK(dict->parentDepth() == 0);
+                CHECK(dict->get("counter"_sl)->asInt() == i);
+            }
+        }
+        SECTION("Overlay ratio") {
+            enc.setDictInheritanceLimits(10, 0.1f);     // 1 change out of 11 keys is too many
+            dict = appendDictChange(doc, enc, "counter", 1);
+            CHECK(dict->parentDepth() == 0);
+            enc.setDictInheritanceLimits(10, 0.5f);
+            dict = appendDictChange(doc, enc, "counter", 2);
+            CHECK(dict->parentDepth() == 1);
+        }
+        SECTION("Overlay ratio boundary") {
+            // The default ratio of 1.0 inherits only if the delta is smaller than the full Dict:
+            alloc_slice data = doc->allocedData();
+            enc.setBase(data);
+            CHECK(enc.shouldInheritFrom(dict, 8, 10));
+            CHECK(!enc.shouldInheritFrom(dict, 9, 10));
+            enc.setDictInheritanceLimits(10, 0.5f);
+            CHECK(enc.shouldInheritFrom(dict, 3, 10));
+            CHECK(!enc.shouldInheritFrom(dict, 4, 10));
+            enc.reset();
+
+            // The delta is 1 changed key plus the parent key, vs. 11 keys in the full Dict:
+            enc.setDictInheritanceLimits(10, 0.18f);    // 2 < 11 * 0.18 is false
+            dict = appendDictChange(doc, enc, "counter", 1);
+            CHECK(dict->parentDepth() == 0);
+            enc.setDictInheritanceLimits(10, 0.19f);    // 2 < 11 * 0.19 is true
+            dict = appendDictChange(doc, enc, "counter", 2);
+            CHECK(dict->parentDepth() == 1);
+        }
+        SECTION("writeFlattened") {
+            appendDictChange(doc, enc, "counter", 1);
+            dict = appendDictChange(doc, enc, "key3", -1);
+            REQUIRE(dict->parentDepth() == 2);
+            CHECK(dict->count() == 10);
+            alloc_slice json = dict->toJSON();
+
+            alloc_slice data = doc->allocedData();
+            enc.setBase(data);
+            enc.writeFlattened(dict);
+            data.append(enc.finish());
+            const Dict *flat = Value::fromData(data)->asDict();
+            CHECK(flat->parentDepth() == 0);
+            CHECK(flat->count() == 10);
+            CHECK(flat->get("key3"_sl) == nullptr);
+            CHECK(flat->get("key4"_sl)->asInt() == 4);
+            CHECK(flat->toJSON() == json);
+        }
+    }
+
+
     TEST_CASE("Larger mutable dict", "[Mutable]") {
         auto data = readTestFile("1person.fleece");
         auto doc = Doc::fromFleece(data, Doc::kTrusted);
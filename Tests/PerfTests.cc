@@ -19,7 +19,10 @@
 #include "FleeceTests.hh"
 #include "FleeceImpl.hh"
 #include "JSONConverter.hh"
+#include "JSONEncoder.hh"
+#include "NumConversion.hh"
 #include "Doc.hh"
+#include "fleece/Fleece.h"
 #include "varint.hh"
 #include <chrono>
 #include <stdlib.h>
@@ -109,6 +112,107 @@ TEST_CASE("Perf Convert1000People", "[.Perf]") {
     writeToFile(lastResult, kTestFilesDir "1000people.fleece");
 }
 
+TEST_CASE("Perf ParseDouble", "[.Perf]") {
+    static const int kSamples = 500;
+
+    // Collect the latitude, longitude and balance strings of the 1000 people:
+    auto doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    std::vector<std::string> numbers;
+    for (Array::iterator i(doc->root()->asArray()); i; ++i) {
+        auto person = i->asDict();
+        char buf[32];
+        for (const char *key : {"latitude", "longitude"}) {
+            WriteFloat(person->get(slice(key))->asDouble(), buf, sizeof(buf));
+            numbers.push_back(buf);
+        }
+        std::string balance;                // "$1,458.82" --> "1458.82"
+        for (char c : person->get("balance"_sl)->asString().asString())
+            if (c != '$' && c != ',')
+                balance += c;
+        numbers.push_back(balance);
+    }
+
+    for (int useStrtod = false; useStrtod <= true; ++useStrtod) {
+        fprintf(stderr, "Parsing %zu numbers with %s...\n",
+                numbers.size(), (useStrtod ? "strtod" : "ParseDouble"));
+        Benchmark bench;
+        double total = 0;
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            for (auto &str : numbers)
+                total += useStrtod ? strtod(str.c_str(), nullptr) : ParseDouble(str.c_str());
+            bench.stop();
+        }
+        CHECK(total != 0);
+        bench.printReport(1.0/numbers.size(), "number");
+    }
+}
+
+TEST_CASE("Perf ToJSON1000People", "[.Perf]") {
+    static const int kSamples = 500;
+    auto doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+    FLValue root = (FLValue)doc->root();
+
+    fprintf(stderr, "Converting Fleece to JSON...\n");
+    Benchmark bench;
+    size_t jsonSize = 0;
+    for (int i = 0; i < kSamples; i++) {
+        bench.start();
+        FLSliceResult json = FLValue_ToJSON(root);
+        bench.stop();
+        jsonSize = json.size;
+        FLSliceResult_Release(json);
+    }
+    bench.printReport();
+    fprintf(stderr, "JSON size: %zu bytes\n", jsonSize);
+}
+
+TEST_CASE("Perf ToJSONParallel", "[.Perf]") {
+    static const int kSamples = 200;
+    auto doc = Doc::fromJSON(readTestFile(kBigJSONTestFileName));
+
+    for (int parallel = false; parallel <= true; ++parallel) {
+        fprintf(stderr, "Converting Fleece to JSON %s...\n",
+                (parallel ? "on all cores" : "on one thread"));
+        Benchmark bench;
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            JSONEncoder enc;
+            if (parallel)
+                enc.writeValueParallel(doc->root());
+            else
+                enc.writeValue(doc->root());
+            alloc_slice json = enc.finish();
+            bench.stop();
+            CHECK(json.size > 0);
+        }
+        bench.printReport();
+    }
+}
+
+TEST_CASE("Perf ToJSONCanonical", "[.Perf]") {
+    static const int kSamples = 200;
+    Retained<SharedKeys> sk = new SharedKeys();
+    Encoder enc;
+    enc.setSharedKeys(sk);
+    JSONConverter jc(enc);
+    REQUIRE(jc.encodeJSON(readTestFile(kBigJSONTestFileName)));
+    Retained<Doc> doc = enc.finishDoc();
+
+    for (int canonical = false; canonical <= true; ++canonical) {
+        fprintf(stderr, "Converting Fleece with shared keys to %s JSON...\n",
+                (canonical ? "canonical" : "non-canonical"));
+        Benchmark bench;
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            alloc_slice json = doc->root()->toJSON(canonical);
+            bench.stop();
+            CHECK(json.size > 0);
+        }
+        bench.printReport();
+    }
+}
+
 TEST_CASE("Perf LoadFleece", "[.Perf]") {
     static const int kIterations = 1000;
     auto doc = readTestFile("1000people.fleece");
@@ -276,4 +380,41 @@ TEST_CASE("Perf DictSearch", "[.Perf]") {
     bench.printReport();
 }
 
+
+TEST_CASE("Perf SharedKeyDictLookup", "[.Perf]") {
+    // Times lookups of integer (shared) keys in dicts of various sizes.
+    static const int kSamples = 50;
+    static const int kIterations = 100000;
+    for (int count : {4, 8, 16, 32, 64}) {
+        Retained<SharedKeys> sk = new SharedKeys();
+        Encoder enc;
+        enc.setSharedKeys(sk);
+        enc.beginDictionary();
+        for (int i = 0; i < count; i++) {
+            char key[16];
+            sprintf(key, "key%d", i);
+            enc.writeKey(slice(key));
+            enc.writeInt(i);
+        }
+        enc.endDictionary();
+        Retained<Doc> doc = enc.finishDoc();
+        const Dict *dict = doc->asDict();
+
+        Benchmark bench;
+        fprintf(stderr, "Looking up keys in a %d-key dict...\n", count);
+        for (int i = 0; i < kSamples; i++) {
+            bench.start();
+            size_t n = 0;
+            for (int j = 0; j < kIterations; j++) {
+                if (dict->get(j % count) != nullptr)
+                    n++;
+            }
+            bench.stop();
+            REQUIRE(n == kIterations);
+        }
+        bench.printReport(1.0/kIterations, "lookup");
+    }
+}
+
+
 #endif // !FL_EMBEDDED
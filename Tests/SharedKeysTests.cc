@@ -20,6 +20,7 @@
 #include "FleeceImpl.hh"
 #include "Path.hh"
 #include "Doc.hh"
+#include "JSONEncoder.hh"
 #include <iostream>
 #include <limits.h>
 
@@ -402,6 +403,22 @@ TEST_CASE("encoding", "[SharedKeys]") {
         Dict::key thumbKey("thumbnail.jpg"_sl);
         REQUIRE(atts->get(thumbKey) != nullptr);
     }
+    SECTION("Dict::getMany") {
+        Dict::key keys[4] = {{"_attachments"_sl}, {"mass"_sl}, {"thumbnail.jpg"_sl}, {"type"_sl}};
+        const Value* values[4];
+        CHECK(root->getMany(keys, 4, values) == 3);
+        CHECK(values[0] == root->get("_attachments"_sl));
+        CHECK(values[1]->asDouble() == 123.456);
+        CHECK(values[2] == nullptr);
+        CHECK(values[3]->asString() == "animal"_sl);
+
+        const Dict *atts = values[0]->asDict();
+        CHECK(atts->getMany(keys, 4, values) == 2);
+        CHECK(values[0] == nullptr);
+        CHECK(values[1] == nullptr);
+        CHECK(values[2]->type() == kData);
+        CHECK(values[3]->type() == kBoolean);
+    }
     SECTION("Path lookup") {
         Path attsTypePath("_attachments.type");
         const Value *t = attsTypePath.eval(root);
@@ -417,6 +434,127 @@ TEST_CASE("encoding", "[SharedKeys]") {
 }
 
 
+TEST_CASE("canonical JSON", "[SharedKeys]") {
+    // Shared keys are numbered in a different order than they sort in, and string keys that
+    // aren't eligible to be shared ("x.y", "long key...") have to be merged in between them:
+    Retained<SharedKeys> sk = new SharedKeys();
+    Encoder enc;
+    enc.setSharedKeys(sk);
+    enc.beginArray();
+    for (int i = 0; i < 3; ++i) {
+        enc.beginDictionary();
+        for (const char *key : {"zebra", "x.y", "mass", "type", "_id", "a very long key name"}) {
+            enc.writeKey(slice(key));
+            enc.writeInt(i);
+        }
+        enc.endDictionary();
+    }
+    enc.endArray();
+    Retained<Doc> doc = enc.finishDoc();
+    REQUIRE(sk->count() == 4);
+
+    std::string expectedDict = "{\"_id\":#,\"a very long key name\":#,\"mass\":#,"
+                               "\"type\":#,\"x.y\":#,\"zebra\":#}";
+    std::string expected = "[";
+    for (char i = '0'; i < '3'; ++i) {
+        std::string dict = expectedDict;
+        for (auto &c : dict)
+            if (c == '#')
+                c = i;
+        expected += (i > '0' ? "," : "") + dict;
+    }
+    expected += "]";
+    CHECK(doc->root()->toJSON(true).asString() == expected);
+    CHECK(doc->root()->toJSON(true).asString() == expected);     // (this time order is cached)
+
+    // Many different sets of keys, more than an encoder caches the orders of, written serially
+    // and in parallel; the result must match the same data without shared keys:
+    {
+        const char* kKeys[] = {"zebra", "mass", "type", "apple", "kiwi", "lime", "x.y"};
+        std::string json = "[";
+        for (int i = 0; i < 400; ++i) {
+            json += (i ? ",{" : "{");
+            bool first = true;
+            for (int k = 0; k < 7; ++k) {
+                if ((i * 37 + 1) & (1 << k)) {
+                    json += std::string(first ? "" : ",") + "\"" + kKeys[k] + "\":" + std::to_string(k);
+                    first = false;
+                }
+            }
+            json += "}";
+        }
+        json += "]";
+        Retained<Doc> plain = Doc::fromJSON(slice(json));
+        Retained<Doc> shared = Doc::fromJSON(slice(json), retained(new SharedKeys));
+        alloc_slice expectedJSON = plain->root()->toJSON(true);
+        CHECK(shared->root()->toJSON(true) == expectedJSON);
+        JSONEncoder parallel;
+        parallel.setCanonical(true);
+        parallel.writeValueParallel(shared->root(), 4);
+        CHECK(parallel.finish() == expectedJSON);
+    }
+
+    // Cached orders are cleared when keys are reverted, since their numbers can be reused:
+    uint16_t keys[2] = {0, 1};          // "zebra", "mass"
+    auto order = sk->sortedKeyOrder(keys, 2);
+    REQUIRE(order);
+    CHECK(*order == (vector<uint16_t>{1, 0}));
+    sk->revertToCount(1);
+    CHECK(sk->sortedKeyOrder(keys, 2) == nullptr);
+    int key;
+    REQUIRE(sk->encodeAndAdd("zzz"_sl, key));
+    CHECK(key == 1);
+    order = sk->sortedKeyOrder(keys, 2);
+    REQUIRE(order);
+    CHECK(*order == (vector<uint16_t>{0, 1}));
+}
+
+
+TEST_CASE("small dict lookup", "[SharedKeys]") {
+    // Exercises the vectorized lookup of integer keys, in narrow and wide dicts of various sizes.
+    // The values are also small ints that look like other keys, which must not be matched.
+    for (int wide = false; wide <= true; ++wide) {
+        for (int n : {1, 2, 3, 5, 8, 15, 16, 17, 31, 32, 33, 40}) {
+            Retained<SharedKeys> sk = new SharedKeys();
+            int missingKey;
+            sk->encodeAndAdd("missing"_sl, missingKey);
+            Encoder enc;
+            enc.setSharedKeys(sk);
+            enc.beginDictionary();
+            if (wide) {
+                // A string this big is too far away for a narrow pointer, forcing a wide dict:
+                enc.writeKey("big"_sl);
+                enc.writeString(std::string(100000, '*'));
+            }
+            for (int i = 0; i < n; i++) {
+                char key[16];
+                sprintf(key, "k%d", i);
+                enc.writeKey(slice(key));
+                enc.writeInt(n - 1 - i);
+            }
+            enc.endDictionary();
+            Retained<Doc> doc = enc.finishDoc();
+            const Dict *root = doc->asDict();
+            REQUIRE(root);
+            CHECK(((((const uint8_t*)root)[0] & 0x08) != 0) == (bool)wide);
+
+            for (int i = 0; i < n; i++) {
+                char key[16];
+                sprintf(key, "k%d", i);
+                int intKey;
+                REQUIRE(sk->encode(slice(key), intKey));
+                const Value *v = root->get(intKey);
+                REQUIRE(v);
+                CHECK(v->asInt() == n - 1 - i);
+                CHECK(root->get(slice(key)) == v);
+            }
+            CHECK(root->get(missingKey) == nullptr);
+            CHECK(root->get(2047) == nullptr);
+        }
+    }
+}
+
+
 TEST_CASE("big JSON encoding", "[SharedKeys]") {
     Retained<SharedKeys> sk = new SharedKeys();
     Encoder enc;
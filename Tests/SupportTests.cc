@@ -21,6 +21,7 @@
 #include "Bitmap.hh"
 #include "TempArray.hh"
 #include "sliceIO.hh"
+#include "NumConversion.hh"
 #include <iostream>
 
 using namespace std;
@@ -110,3 +111,56 @@ TEST_CASE("Bitmap") {
     CHECK(b.bitCount() == 13);
     CHECK(b.indexOfBit(8) == 4);
 }
+
+
+TEST_CASE("ParseDouble", "[Numeric]") {
+    // Each string must parse to the same double as strtod's correctly rounded result:
+    static const char* const kStrings[] = {
+        "0", "-0", "1", "-1.5", "0.1", "123.456", "40.941286", "-21.152958", "1458.82",
+        "6.02e+23", "6.02E23", "1e22", "1e23", "2e23", "3.2e24",            // 1e23 is a halfway case
+        "9007199254740993", "9211283038626057.", "7.2057594037927933e+16",
+        "1.7976931348623157e308", "1.7976931348623158e308",                 // DBL_MAX
+        "2.2250738585072011e-308", "2.2250738585072014e-308",               // near DBL_MIN
+        "4.9406564584124654e-324", "2.4703282292062328e-324",               // subnormals
+        "2.4703282292062327e-324",                                          // rounds to 0
+        "1e-400", "-1e-400", "1e400", "-1e400",                             // underflow/overflow
+        "0.000000000000000000000000000001234", "12345678901234567890123",   // > 19 digits
+        "5.", ".5", "1e", "1e+", "3.14abc", "+2.5", "0x1p3",                // odd syntax
+    };
+    for (const char *str : kStrings) {
+        INFO("str = " << str);
+        double expected = strtod(str, nullptr);
+        double parsed = ParseDouble(str);
+        CHECK(memcmp(&parsed, &expected, sizeof(double)) == 0);
+        parsed = ParseDouble(str, strlen(str));
+        CHECK(memcmp(&parsed, &expected, sizeof(double)) == 0);
+    }
+
+    // Length-limited parsing doesn't need a NUL terminator:
+    CHECK(ParseDouble("1.25e3xyz", 6) == 1.25e3);
+    CHECK(ParseDouble("3.14159", 4) == 3.14);
+}
+
+TEST_CASE("WriteInt", "[Numeric]") {
+    char buf[kMaxIntStringSize];
+    auto checkInt = [&](int64_t n) {
+        INFO("n = " << n);
+        CHECK(std::string(buf, WriteInt(n, buf)) == std::to_string(n));
+        if (n >= 0)
+            CHECK(std::string(buf, WriteUInt(uint64_t(n), buf)) == std::to_string(uint64_t(n)));
+    };
+    // Each power of 10, and its neighbors, positive and negative:
+    for (int64_t p = 1; ; p *= 10) {
+        for (int64_t n : {p - 1, p, p + 1}) {
+            checkInt(n);
+            checkInt(-n);
+        }
+        if (p > INT64_MAX / 10)
+            break;
+    }
+    checkInt(INT64_MAX);
+    checkInt(INT64_MIN);
+    checkInt(INT64_MIN + 1);
+    CHECK(std::string(buf, WriteUInt(UINT64_MAX, buf)) == "18446744073709551615");
+    CHECK(std::string(buf, WriteUInt(10000000000000000000u, buf)) == "10000000000000000000");
+}
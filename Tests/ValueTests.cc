@@ -25,6 +25,8 @@
 #include "Pointer.hh"
 #include "varint.hh"
 #include "DeepIterator.hh"
+#include "ValueVisitor.hh"
+#include "Encoder.hh"
 #include "SharedKeys.hh"
 #include "Doc.hh"
 #include <sstream>
@@ -176,6 +178,177 @@ namespace fleece {
     }
 
 
+    // Counts what it visits, and checks that collections are begun and ended in order.
+    struct CountingVisitor : public ValueVisitor {
+        VisitAction value(const Value*)             {++values; return check();}
+        VisitAction beginArray(const Array *a)      {return begin(a);}
+        VisitAction endArray(const Array *a)        {return end(a);}
+        VisitAction beginDict(const Dict *d)        {return begin(d);}
+        VisitAction endDict(const Dict *d)          {return end(d);}
+
+        VisitAction key(const Dict::iterator &i) {
+            ++keys;
+            if (skipKey && i.keyString() == skipKey)
+                return kVisitSkipChildren;
+            return check();
+        }
+
+        VisitAction begin(const Value *c) {
+            ++collections;
+            open.push_back(c);
+            maxDepth = std::max(maxDepth, open.size());
+            if (skipNested && open.size() > 1)
+                return kVisitSkipChildren;
+            return check();
+        }
+
+        VisitAction end(const Value *c) {
+            CHECK(open.back() == c);
+            open.pop_back();
+            return kVisitContinue;
+        }
+
+        VisitAction check() {
+            return (stopAfter && values + keys >= stopAfter) ? kVisitStop : kVisitContinue;
+        }
+
+        size_t values = 0, keys = 0, collections = 0, maxDepth = 0;
+        vector<const Value*> open;
+        slice skipKey;
+        bool skipNested = false;
+        size_t stopAfter = 0;
+    };
+
+    TEST_CASE("Value visitor") {
+        auto input = readTestFile("1person.fleece");
+        auto person = Value::fromData(input);
+
+        size_t nValues = 0, nCollections = 0, nKeys = 0;
+        for (DeepIterator i(person); i; ++i) {
+            auto type = i.value()->type();
+            if (type == kArray || type == kDict) {
+                ++nCollections;
+                if (type == kDict)
+                    nKeys += i.value()->asDict()->count();
+            } else {
+                ++nValues;
+            }
+        }
+
+        {
+            CountingVisitor v;
+            CHECK(person->visit(v));
+            CHECK(v.values == nValues);
+            CHECK(v.collections == nCollections);
+            CHECK(v.keys == nKeys);
+            CHECK(v.open.empty());
+        }
+        {
+            // Skip the value of a key:
+            CountingVisitor v;
+            v.skipKey = "_id"_sl;
+            CHECK(person->visit(v));
+            CHECK(v.values == nValues - 1);
+            CHECK(v.keys == nKeys);
+        }
+        {
+            // Skip nested collections; their ends are still visited:
+            CountingVisitor v;
+            v.skipNested = true;
+            CHECK(person->visit(v));
+            CHECK(v.keys == person->asDict()->count());
+            CHECK(v.maxDepth == 2);
+            CHECK(v.open.empty());
+        }
+        {
+            // Stop partway:
+            CountingVisitor v;
+            v.stopAfter = 5;
+            CHECK(!person->visit(v));
+            CHECK(v.values + v.keys == 5);
+        }
+        {
+            // A scalar:
+            CountingVisitor v;
+            CHECK(person->asDict()->get("_id"_sl)->visit(v));
+            CHECK(v.values == 1);
+            CHECK(v.collections == 0);
+        }
+        {
+            // Nesting deeper than the visitor's inline stack:
+            Encoder enc;
+            for (int depth = 0; depth < 100; ++depth) {
+                enc.beginArray();
+                enc.writeInt(depth);
+            }
+            for (int depth = 0; depth < 100; ++depth)
+                enc.endArray();
+            alloc_slice data = enc.finish();
+            CountingVisitor v;
+            CHECK(Value::fromData(data)->visit(v));
+            CHECK(v.values == 100);
+            CHECK(v.collections == 100);
+            CHECK(v.maxDepth == 100);
+            CHECK(v.open.empty());
+        }
+    }
+
+
+    TEST_CASE("Content hash", "[SharedKeys]") {
+        auto hashOf = [](const char *json, SharedKeys *sk =nullptr) {
+            return Doc::fromJSON(slice(json), sk)->contentHash();
+        };
+        const char *json = "{\"name\":\"Sam\",\"tags\":[\"a\",1,2.5,0.0],"
+                            "\"nested\":{\"b\":true,\"a\":null}}";
+        auto hash = hashOf(json);
+        CHECK(hash != (ContentHash{0, 0}));
+        CHECK(hashOf(json) == hash);
+
+        // Independent of SharedKeys, key order, and the sign of zero:
+        CHECK(hashOf(json, retained(new SharedKeys)) == hash);
+        CHECK(hashOf("{\"tags\":[\"a\",1,2.5,-0.0],\"nested\":{\"a\":null,\"b\":true},"
+                     "\"name\":\"Sam\"}") == hash);
+
+        // But sensitive to any change in contents:
+        CHECK(hashOf("{\"name\":\"Pat\",\"tags\":[\"a\",1,2.5,0.0],"
+                     "\"nested\":{\"b\":true,\"a\":null}}") != hash);
+        CHECK(hashOf("{\"name\":\"Sam\",\"tags\":[1,\"a\",2.5,0.0],"
+                     "\"nested\":{\"b\":true,\"a\":null}}") != hash);
+        CHECK(hashOf("{\"name\":\"Sam\",\"tags\":[\"a\",1,2.5,0.0],"
+                     "\"nested\":{\"a\":true,\"b\":null}}") != hash);
+        CHECK(hashOf("{\"a\":1}") != hashOf("{\"b\":1}"));
+        CHECK(hashOf("{\"a\":1}") != hashOf("{\"a\":\"1\"}"));
+        CHECK(hashOf("[[1],2]") != hashOf("[1,[2]]"));
+        CHECK(hashOf("[\"ab\",\"c\"]") != hashOf("[\"a\",\"bc\"]"));
+
+        // Comparing Dicts with different SharedKeys uses the hash to reject mismatches:
+        Retained<Doc> doc1 = Doc::fromJSON(slice(json));
+        Retained<Doc> doc2 = Doc::fromJSON(slice(json), retained(new SharedKeys));
+        CHECK(doc1->root()->contentHash() == hash);
+        CHECK(doc1->root()->isEqual(doc2->root()));
+        Retained<Doc> doc3 = Doc::fromJSON("{\"name\":\"Sam\",\"tags\":[\"a\",1,2.5,1.0],"
+                                           "\"nested\":{\"b\":true,\"a\":null}}"_sl,
+                                           retained(new SharedKeys));
+        CHECK(!doc1->root()->isEqual(doc3->root()));
+
+        // Nested Dicts with different SharedKeys, where only the outermost Dict checks the hash:
+        const char *deepJSON = "{\"a\":{\"b\":{\"c\":{\"d\":[1,{\"e\":{\"f\":\"x\"}}]}},\"g\":7}}";
+        Retained<Doc> deep1 = Doc::fromJSON(slice(deepJSON), retained(new SharedKeys));
+        Retained<Doc> deep2 = Doc::fromJSON(slice(deepJSON), retained(new SharedKeys));
+        REQUIRE(deep1->sharedKeys() != deep2->sharedKeys());
+        CHECK(deep1->root()->isEqual(deep2->root()));
+        CHECK(deep1->asDict()->get("a"_sl)->isEqual(deep2->asDict()->get("a"_sl)));
+        Retained<Doc> deep3 = Doc::fromJSON("{\"a\":{\"b\":{\"c\":{\"d\":[1,{\"e\":{\"f\":\"y\"}}]}},"
+                                            "\"g\":7}}"_sl, retained(new SharedKeys));
+        CHECK(!deep1->root()->isEqual(deep3->root()));
+        CHECK(!deep3->asDict()->get("a"_sl)->isEqual(deep1->asDict()->get("a"_sl)));
+        Retained<Doc> deep4 = Doc::fromJSON("{\"a\":{\"b\":{\"c\":{\"d\":[1,{\"e\":{\"f\":\"x\",\"h\":0}}]}},"
+                                            "\"g\":7}}"_sl, retained(new SharedKeys));
+        CHECK(!deep1->root()->isEqual(deep4->root()));
+        CHECK(!deep4->root()->isEqual(deep1->root()));
+    }
+
+
     TEST_CASE("Doc", "[SharedKeys]") {
         const Dict *root;
         {
@@ -18,6 +18,7 @@
 
 #include "fleece/Fleece.hh"
 #include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
 #include <sstream>
 #ifndef _MSC_VER
@@ -36,9 +37,11 @@ using namespace std;
 
 static void usage(void) {
     fprintf(stderr, "usage: fleece [--hex] encode [JSON file]\n");
+    fprintf(stderr, "       fleece [--hex] [--threads N] encodelines [JSON Lines file]\n");
     fprintf(stderr, "       fleece [--hex] decode [Fleece file]\n");
     fprintf(stderr, "       fleece dump [Fleece file]\n");
     fprintf(stderr, "  Reads stdin unless a file is given; always writes to stdout.\n");
+    fprintf(stderr, "  `encodelines` converts each line to an item of an array, in parallel.\n");
 }
 
 
@@ -120,7 +123,8 @@ static void writeOutput(slice output, bool asHex =false) {
 
 int main(int argc, const char * argv[]) {
     try {
-        bool encode = false, decode = false, dump = false, hex = false;
+        bool encode = false, encodeLines = false, decode = false, dump = false, hex = false;
+        unsigned threads = 0;
 
         int i;
         for (i = 1; i < argc; ++i) {
@@ -131,12 +135,16 @@ int main(int argc, const char * argv[]) {
                     break;
                 } else if (strcmp(arg, "--encode") == 0) {
                     encode = true;
+                } else if (strcmp(arg, "--encodelines") == 0) {
+                    encodeLines = true;
                 } else if (strcmp(arg, "--decode") == 0) {
                     decode = true;
                 } else if (strcmp(arg, "--dump") == 0) {
                     dump = true;
                 } else if (strcmp(arg, "--hex") == 0) {
                     hex = true;
+                } else if (strcmp(arg, "--threads") == 0 && i + 1 < argc) {
+                    threads = (unsigned)atoi(argv[++i]);
                 } else if (strcmp(arg, "--help") == 0) {
                     usage();
                     return 0;
@@ -145,10 +153,12 @@ int main(int argc, const char * argv[]) {
                     usage();
                     return 1;
                 }
-            } else if (encode+decode+dump == 0) {
+            } else if (encode+encodeLines+decode+dump == 0) {
                 // Also allow mode without '--' prefix, if none was chosen yet:
                 if (strcmp(arg, "encode") == 0) {
                     encode = true;
+                } else if (strcmp(arg, "encodelines") == 0) {
+                    encodeLines = true;
                 } else if (strcmp(arg, "decode") == 0) {
                     decode = true;
                 } else if (strcmp(arg, "dump") == 0) {
@@ -161,8 +171,8 @@ int main(int argc, const char * argv[]) {
             }
         }
 
-        if (encode + decode + dump != 1) {
-            fprintf(stderr, "Choose one of --encode, --decode, or --dump\n");
+        if (encode + encodeLines + decode + dump != 1) {
+            fprintf(stderr, "Choose one of --encode, --encodelines, --decode, or --dump\n");
             usage();
             return 1;
         }
@@ -183,7 +193,7 @@ int main(int argc, const char * argv[]) {
             return 1;
         }
 
-        if (encode && !hex && _isatty(STDOUT_FILENO))
+        if ((encode || encodeLines) && !hex && _isatty(STDOUT_FILENO))
             throw "Let's not spew binary Fleece data to a terminal! Please redirect stdout.";
 
         auto input = readInput(in, (decode && hex));
@@ -194,12 +204,20 @@ int main(int argc, const char * argv[]) {
                 throw "Invalid JSON input";
             slice output = doc.data();
             writeOutput(output, hex);
+        } else if (encodeLines) {
+            FLError error;
+            alloc_slice output = FLData_ConvertJSONLines(input, nullptr, threads, &error);
+            if (!output)
+                throw "Invalid JSON Lines input";
+            writeOutput(output, hex);
         } else if (decode) {
             Doc doc(input);
             if (!doc)
                 throw "Couldn't parse input as Fleece";
-            auto json = doc.root().toJSON();
-            writeOutput(json);
+            // Stream the JSON to stdout rather than building it all in memory first:
+            FLError error;
+            if (!FLValue_WriteJSONToFile(doc.root(), false, false, stdout, &error))
+                throw "Couldn't write JSON output";
             fprintf(stdout, "\n");
         } else if (dump) {
             alloc_slice output = Doc::dump(input);
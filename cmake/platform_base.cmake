@@ -14,9 +14,13 @@ function(set_source_files_base)
         Fleece/Core/Dict.cc
         Fleece/Core/Doc.cc
         Fleece/Core/Encoder.cc
+        Fleece/Core/FleeceDelta.cc
         Fleece/Core/JSONConverter.cc
+        Fleece/Core/JSONLinesConverter.cc
+        Fleece/Core/JSONParser.cc
         Fleece/Core/JSONDelta.cc
         Fleece/Core/Path.cc
+        Fleece/Core/PathSet.cc
         Fleece/Core/Pointer.cc
         Fleece/Core/SharedKeys.cc
         Fleece/Core/Value+Dump.cc
@@ -36,6 +40,7 @@ function(set_source_files_base)
         Fleece/Support/JSON5.cc
         Fleece/Support/JSONEncoder.cc
         Fleece/Support/LibC++Debug.cc
+        Fleece/Support/Parallel.cc
         Fleece/Support/ParseDate.cc
         Fleece/Support/RefCounted.cc
         Fleece/Support/slice.cc